@@ -0,0 +1,47 @@
+#include "Stats.h"
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
+
+// The global operator new and delete of ptx-analyze and ptx-bench, which
+// report every block to -memstats. They are linked into the executables
+// only, so that a program embedding libptxanalyze keeps its own allocator
+
+#ifdef PTX_STATS
+static inline void * TrackedNew(size_t size)
+{
+	void *ptr = malloc(size ? size : 1);
+	if (ptr == 0) throw std::bad_alloc();
+	MemStatsAllocated(ptr, malloc_usable_size(ptr));
+	return ptr;
+}
+
+static inline void TrackedDelete(void *ptr)
+{
+	if (ptr == 0) return;
+	MemStatsFreed(ptr);
+	free(ptr);
+}
+
+void * operator new(size_t size) {return TrackedNew(size);}
+void * operator new[](size_t size) {return TrackedNew(size);}
+void operator delete(void *ptr) noexcept {TrackedDelete(ptr);}
+void operator delete[](void *ptr) noexcept {TrackedDelete(ptr);}
+
+void * operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	try {
+		return TrackedNew(size);
+	} catch (...) {
+		return 0;
+	}
+}
+
+void * operator new[](size_t size, const std::nothrow_t& nt) noexcept
+{
+	return operator new(size, nt);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept {TrackedDelete(ptr);}
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept {TrackedDelete(ptr);}
+#endif
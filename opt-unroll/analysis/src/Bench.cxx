@@ -0,0 +1,370 @@
+#include "Generator.h"
+#include "Parser.h"
+#include "Reader.h"
+#include "Kernel.h"
+#include "CFG.h"
+#include "Emitter.h"
+#include "Stats.h"
+#include "Utils.h"
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <unistd.h>
+
+// Per-phase benchmark of the analyzer on synthetic ptx. For each size, a
+// kernel of that many instructions is generated to a temporary file and
+// run through read, parse, construct, CFG, loop detection, the coalescing
+// analysis and cycle counting, repeating small sizes so that every size
+// runs for a while.
+// Reported are nanoseconds per instruction in each phase, and from a
+// separate run with memory accounting on, the bytes allocated and the
+// peak footprint per instruction
+// Usage: ptx-bench [-loops=<n>] [-depth=<n>] [-branches=<f>] [-seed=<n>] [sizes...]
+//
+// As a regression tracker, ptx-bench runs a fixed corpus of generated
+// kernels instead, and either records the per-phase times, the peak
+// footprint and a fingerprint of the analysis output of each case to a
+// baseline file, or compares against one. The comparison fails if any
+// phase got slower, or the footprint larger, by more than the threshold,
+// or if the output changed at all
+// Usage: ptx-bench -record=<file> | -check=<file> [-threshold=<percent>]
+
+#ifndef PTX_STATS
+#error "ptx-bench needs the phase timers, build it with -DPTX_STATS"
+#endif
+
+// Aim for about this many instructions analyzed per size
+static const unsigned long long BENCH_WORK = 2000000;
+static const unsigned long long CORPUS_WORK = 200000;
+static const unsigned MAX_REPEATS = 100;
+// Corpus cases are timed this many times and the fastest run is kept, to
+// keep other load on the machine out of the comparison
+static const unsigned CORPUS_ROUNDS = 3;
+static const double DEFAULT_THRESHOLD = 25.0;
+// Phases that take less than this many ns/instruction are too short to
+// time reliably, and are only compared once they grow past it
+static const double MIN_COMPARED_NS = 5.0;
+
+static const Phase bench_phases[] = {PHASE_READER, PHASE_PARSE, PHASE_CONSTRUCT, PHASE_CFG,
+	PHASE_LOOPS, PHASE_COALESCING, PHASE_CYCLES};
+static const char *bench_phase_names[] = {"read", "parse", "construct", "cfg", "loops", "coalescing", "cycles"};
+static const unsigned NUM_BENCH_PHASES = sizeof(bench_phases) / sizeof(bench_phases[0]);
+
+// The regression corpus. Changing a case invalidates its baseline
+class CorpusCase
+{
+	public:
+	const char *name;
+	unsigned long long instructions;
+	unsigned kernels, loops, depth;
+	double branches, global_ops, shared_ops;
+};
+
+static const CorpusCase corpus[] = {
+	{"straight", 20000, 1, 0, 1, 0.25, 0.1, 0.05},
+	{"loops", 20000, 1, 16, 1, 0.25, 0.1, 0.05},
+	{"nested", 20000, 1, 4, 3, 0.25, 0.1, 0.05},
+	{"memory", 20000, 1, 8, 1, 0.25, 0.3, 0.2},
+	{"kernels", 5000, 8, 2, 2, 0.25, 0.1, 0.05},
+	{"large", 50000, 1, 8, 2, 0.25, 0.1, 0.05},
+};
+static const unsigned NUM_CORPUS_CASES = sizeof(corpus) / sizeof(corpus[0]);
+
+class BenchResult
+{
+	public:
+	unsigned long long instructions;
+	unsigned repeats;
+	double ns[NUM_BENCH_PHASES]; // per instruction
+	double allocated, peak; // bytes per instruction
+	string report;
+};
+
+// Analyze every kernel in the file once, charging the phases to the
+// current stats. With a report, the instruction counts, loops and cycles
+// of every kernel are written to it; otherwise only the cycles are counted
+static unsigned long long RunOnce(const string& path, string *report)
+{
+	unsigned long long ninstrs = 0;
+	Reader rdr(path);
+	Parser parser(&rdr);
+	Emitter& out = Out();
+	ostringstream os;
+
+	while (parser.HasMoreKernels()) {
+		parser.Reinit();
+		Kernel *kernel = new Kernel(&parser);
+		kernel->Construct();
+		kernel->BuildCFG();
+		if (report) {
+			out.BeginKernel(parser.GetKernelName());
+			kernel->DumpInstCounts();
+			kernel->DumpLoopInfo();
+			kernel->DumpCycles(0);
+			out.EndKernel();
+		}
+		else
+			kernel->CountCycles(0);
+		// the loop reports of the cycle model are dropped unless asked for
+		out.Flush(os);
+		ninstrs += kernel->GetNumInstrs();
+		delete kernel;
+	}
+	if (report) *report = os.str();
+	return ninstrs;
+}
+
+// Time the phases on the given config, keeping the fastest of the given
+// number of rounds, and measure the allocations of a single run
+static void Measure(const GeneratorConfig& config, unsigned long long work, unsigned rounds,
+		bool with_report, BenchResult& result)
+{
+	char path[] = "/tmp/ptx-bench.XXXXXX";
+	int fd = mkstemp(path);
+	Assert(fd >= 0, "Unable to create a temporary file");
+	close(fd);
+	{
+		ofstream file(path);
+		Generator(config).Write(file);
+	}
+
+	unsigned long long size = config.instructions * config.kernels;
+	result.repeats = (size >= work) ? 1 : work / size;
+	if (result.repeats > MAX_REPEATS) result.repeats = MAX_REPEATS;
+	result.report.clear();
+
+	Emitter *out = Emitter::Create(FORMAT_TEXT);
+	SetOutput(out);
+
+	try {
+		for (unsigned round = 0; round < rounds; ++round) {
+			PhaseStats stats;
+			unsigned long long ninstrs = 0;
+			SetStats(&stats);
+			stats.Start();
+			for (unsigned r = 0; r < result.repeats; ++r)
+				ninstrs += RunOnce(path, (with_report && round == 0 && r == 0) ? &result.report : 0);
+			stats.Checkpoint();
+			SetStats(0);
+
+			result.instructions = ninstrs / result.repeats;
+			for (unsigned i = 0; i < NUM_BENCH_PHASES; ++i) {
+				double ns = stats.secs[bench_phases[i]] * 1e9 / ninstrs;
+				if (round == 0 || ns < result.ns[i])
+					result.ns[i] = ns;
+			}
+		}
+
+		// memory accounting slows down allocation, so it gets a run of its own
+		MemStats mem_stats;
+		SetMemStats(&mem_stats);
+		RunOnce(path, 0);
+		SetMemStats(0);
+
+		unsigned long long allocated = 0;
+		for (unsigned i = 0; i < NUM_BENCH_PHASES; ++i)
+			allocated += mem_stats.GetAllocatedBytes(bench_phases[i]);
+		result.allocated = double(allocated) / result.instructions;
+		result.peak = double(mem_stats.GetPeakBytes()) / result.instructions;
+	} catch (...) {
+		SetStats(0);
+		SetMemStats(0);
+		SetOutput(0);
+		delete out;
+		unlink(path);
+		throw;
+	}
+	SetOutput(0);
+	delete out;
+	unlink(path);
+}
+
+static void Bench(const GeneratorConfig& config)
+{
+	BenchResult result;
+	Measure(config, BENCH_WORK, 1, false, result);
+
+	double total = 0;
+	cout << setw(10) << config.instructions << setw(6) << result.repeats << fixed << setprecision(1);
+	for (unsigned i = 0; i < NUM_BENCH_PHASES; ++i) {
+		total += result.ns[i];
+		cout << setw(10) << result.ns[i];
+	}
+	cout << setw(10) << total << setw(12) << result.allocated << setw(12) << result.peak << endl;
+}
+
+static GeneratorConfig CorpusConfig(const CorpusCase& c)
+{
+	GeneratorConfig config;
+	config.instructions = c.instructions;
+	config.kernels = c.kernels;
+	config.loops = c.loops;
+	config.depth = c.depth;
+	config.branches = c.branches;
+	config.global_ops = c.global_ops;
+	config.shared_ops = c.shared_ops;
+	return config;
+}
+
+// The output is compared by fingerprint and size, so that the baseline
+// stays small
+static string OutputDigest(const string& report)
+{
+	ostringstream digest;
+	digest << hex << setw(16) << setfill('0') << Fingerprint(report) << dec << " " << report.size();
+	return digest.str();
+}
+
+// Baseline files hold one "<case> <metric> <value>" line per measurement,
+// where the metrics are the phase names, "peak" in bytes/instruction and
+// "output", whose value is the digest of the analysis output
+static void RecordBaseline(const string& file)
+{
+	ostringstream os;
+	os << "# ptx-bench baseline: <case> <metric> <value>, times in ns/instruction," << '\n';
+	os << "# peak in bytes/instruction. Regenerate with make benchbaseline" << '\n';
+	os << fixed << setprecision(1);
+	for (unsigned c = 0; c < NUM_CORPUS_CASES; ++c) {
+		BenchResult result;
+		Measure(CorpusConfig(corpus[c]), CORPUS_WORK, CORPUS_ROUNDS, true, result);
+		for (unsigned i = 0; i < NUM_BENCH_PHASES; ++i)
+			os << corpus[c].name << " " << bench_phase_names[i] << " " << result.ns[i] << '\n';
+		os << corpus[c].name << " peak " << result.peak << '\n';
+		os << corpus[c].name << " output " << OutputDigest(result.report) << '\n';
+		cout << "Recorded " << corpus[c].name << endl;
+	}
+
+	ofstream baseline(file.c_str());
+	Assert(baseline.good(), "Unable to write baseline " << file);
+	baseline << os.str();
+	cout << "Baseline written to " << file << endl;
+}
+
+static void CompareLine(const string& name, const string& metric, double was, double now, double threshold,
+		double floor, unsigned& regressions)
+{
+	double change = (was > 0) ? 100 * (now - was) / was : 0;
+	bool regressed = (change > threshold && now >= floor);
+	if (regressed) ++regressions;
+	cout << left << setw(12) << name << setw(12) << metric << right << setw(12) << was << setw(12) << now
+		 << setw(9) << showpos << change << "%" << noshowpos << (regressed ? "  REGRESSED" : "") << endl;
+}
+
+// Returns the number of regressions against the baseline
+static unsigned CheckBaseline(const string& file, double threshold)
+{
+	ifstream baseline(file.c_str());
+	Assert(baseline.good(), "Unable to read baseline " << file);
+	map <string, string> values;
+	string line;
+	while (getline(baseline, line)) {
+		if (line.empty() || line[0] == '#') continue;
+		istringstream is(line);
+		string name, metric, value;
+		is >> name >> metric;
+		getline(is >> ws, value);
+		values[name + " " + metric] = value;
+	}
+
+	unsigned regressions = 0;
+	cout << left << setw(12) << "Case" << setw(12) << "Metric" << right << setw(12) << "Baseline"
+		 << setw(12) << "Current" << setw(10) << "Change" << endl;
+	cout << fixed << setprecision(1);
+	for (unsigned c = 0; c < NUM_CORPUS_CASES; ++c) {
+		const string name = corpus[c].name;
+		if (values.find(name + " output") == values.end()) {
+			cout << left << setw(12) << name << "no baseline, run make benchbaseline" << right << endl;
+			continue;
+		}
+
+		BenchResult result;
+		Measure(CorpusConfig(corpus[c]), CORPUS_WORK, CORPUS_ROUNDS, true, result);
+		for (unsigned i = 0; i < NUM_BENCH_PHASES; ++i)
+			CompareLine(name, bench_phase_names[i], atof(values[name + " " + bench_phase_names[i]].c_str()),
+				result.ns[i], threshold, MIN_COMPARED_NS, regressions);
+		CompareLine(name, "peak", atof(values[name + " peak"].c_str()), result.peak, threshold, 0, regressions);
+
+		const string& digest = OutputDigest(result.report);
+		if (digest != values[name + " output"]) {
+			++regressions;
+			const GeneratorConfig& config = CorpusConfig(corpus[c]);
+			ostringstream command;
+			command << "ptx-gen -instrs=" << config.instructions << " -kernels=" << config.kernels
+				 << " -loops=" << config.loops << " -depth=" << config.depth << " -branches=" << config.branches
+				 << " -global=" << config.global_ops << " -shared=" << config.shared_ops
+				 << " | ptx-analyze -counts -loopinfo -cycles /dev/stdin";
+			cout << left << setw(12) << name << "output changed: " << digest << ", baseline "
+				 << values[name + " output"] << right << endl;
+			cout << "  reproduce with: " << command.str() << endl;
+		}
+	}
+
+	if (regressions)
+		cout << regressions << " regression(s) against " << file << " (threshold " << threshold << "%)" << endl;
+	else
+		cout << "No regressions against " << file << " (threshold " << threshold << "%)" << endl;
+	return regressions;
+}
+
+int main(int argc, char **argv)
+{
+	GeneratorConfig config;
+	vector <unsigned long long> sizes;
+	string record, check;
+	double threshold = DEFAULT_THRESHOLD;
+
+	for (int i = 1; i < argc; ++i) {
+		string option = argv[i];
+		string value = (option.find('=') != option.npos) ? option.substr(option.find('=') + 1) : "";
+		if (option.find("-loops=") == 0) config.loops = atoi(value.c_str());
+		else if (option.find("-depth=") == 0) config.depth = atoi(value.c_str());
+		else if (option.find("-branches=") == 0) config.branches = atof(value.c_str());
+		else if (option.find("-seed=") == 0) config.seed = atoi(value.c_str());
+		else if (option.find("-record=") == 0) record = value;
+		else if (option.find("-check=") == 0) check = value;
+		else if (option.find("-threshold=") == 0) threshold = atof(value.c_str());
+		else if (option[0] != '-' && strtoull(option.c_str(), 0, 10) > 0) sizes.push_back(strtoull(option.c_str(), 0, 10));
+		else {
+			cerr << "Usage: ptx-bench [-loops=<n>] [-depth=<n>] [-branches=<f>] [-seed=<n>] [sizes...]" << endl;
+			cerr << "       ptx-bench -record=<file> | -check=<file> [-threshold=<percent>]" << endl;
+			return -1;
+		}
+	}
+
+	try {
+		if (!record.empty()) {
+			RecordBaseline(record);
+			return 0;
+		}
+		if (!check.empty())
+			return CheckBaseline(check, threshold) ? 1 : 0;
+	} catch (exception& e) {
+		cerr << e.what() << endl;
+		return -1;
+	}
+
+	if (sizes.empty()) {
+		for (unsigned long long n = 1000; n <= 10000000; n *= 10)
+			sizes.push_back(n);
+	}
+
+	cout << "Phase times in ns/instruction, memory in bytes/instruction" << endl;
+	cout << setw(10) << "Instrs" << setw(6) << "Reps";
+	for (unsigned i = 0; i < NUM_BENCH_PHASES; ++i)
+		cout << setw(10) << bench_phase_names[i];
+	cout << setw(10) << "Total" << setw(12) << "Allocated" << setw(12) << "Peak" << endl;
+
+	try {
+		for (unsigned i = 0; i < sizes.size(); ++i) {
+			config.instructions = sizes[i];
+			Bench(config);
+		}
+	} catch (exception& e) {
+		cerr << e.what() << endl;
+		return -1;
+	}
+	return 0;
+}
@@ -1,34 +1,33 @@
 #include "CFG.h"
 #include "Utils.h"
-#include <fstream>
+#include "Emitter.h"
+#include "Stats.h"
+#include "TripCount.h"
 #include <algorithm>
 using namespace std;
 
-#define GLOBAL_MEM_LATENCY 500
-
-extern bool exp_mode;
+// temporary flag to turn on experimental features. Set from the -exp
+// option of whichever analysis is running on the thread
+__thread bool exp_mode = false;
 
 BasicBlock::BasicBlock(Instruction *b, Instruction *e, unsigned u)
 	: begin_instr(b), end_instr(e), loop_header(false), loop_footer(false), 
 	id(u), vi(COLOR_WHITE), alu_op_count(0), global_op_count(0), shared_op_count(0), 
 	local_op_count(0), branch_op_count(0), sync_op_count(0), total_op_count(0) 
 {
+	InstCounts counts;
 	for (Instruction *iter = b; 
 			b && e && iter != e->GetNext(); 
 			iter = (iter->GetNext())) {
-		// check the instruction type and increment appropriate count
-		if (iter->IsAluOp()) ++alu_op_count;
-		else if (iter->IsBranchOp()) ++branch_op_count;
-		else if (iter->IsSharedOp()) ++shared_op_count;
-		else if (iter->IsLocalOp()) ++local_op_count;
-		else if (iter->IsGlobalOp()) ++global_op_count;
-		else {
-			Assert(iter->IsSyncOp(), "Unknown op type");
-			++sync_op_count;
-		}
+		counts.Add(iter);
 	}
-	total_op_count = alu_op_count + global_op_count + shared_op_count +\
-									 local_op_count + branch_op_count + sync_op_count;
+	alu_op_count = counts.alu;
+	global_op_count = counts.global;
+	shared_op_count = counts.shared;
+	local_op_count = counts.local;
+	branch_op_count = counts.branch;
+	sync_op_count = counts.sync;
+	total_op_count = counts.GetTotal();
 }
 
 void BasicBlock::AddSucc(BasicBlock *b)
@@ -42,15 +41,20 @@ void BasicBlock::AddPred(BasicBlock *b)
 }
 
 // This is the only tested way to construct a CFG for now
-CFG::CFG(InstIter begin, InstIter end, bool unrolled) : entry(0), exit(0), constructed(0), has_loops(0), unrolled_loops(unrolled)
+CFG::CFG(InstIter begin, InstIter end, bool unrolled)
+: entry(0), exit(0), num_loops(0), stall_cycles(0), coalescing(0), constructed(0), has_loops(0),
+	unrolled_loops(unrolled)
 {
+	TIME_PHASE(PHASE_CFG);
 	block_map = new map<const Instruction *, BasicBlock *>();
+	loop_header_map = new map<BasicBlock *, Loop *>();
+	loops = new vector<Loop *>();
 	ComputeBasicBlocks(begin, end);
 	ConstructCFG();
 }
 
 // The following 2 ctors need to be updated to ensure that all fields are inited/copied
-CFG::CFG(BBList list) : constructed(0), has_loops(0)
+CFG::CFG(BBList list) : coalescing(0), constructed(0), has_loops(0)
 {
 	for (BBListIter iter = list.begin(); iter != list.end(); ++iter) {
 		all_blocks.push_back(*iter);
@@ -58,7 +62,8 @@ CFG::CFG(BBList list) : constructed(0), has_loops(0)
 }
 
 // See note above
-CFG::CFG(const CFG& other) : entry(other.entry), exit(other.exit), constructed(other.constructed), has_loops(other.has_loops) 
+CFG::CFG(const CFG& other) : entry(other.entry), exit(other.exit), coalescing(other.coalescing),
+	constructed(other.constructed), has_loops(other.has_loops)
 {
 	// deep-copy of basic-blocks
 	for (BBListConstIter iter = other.BlocksBegin(); iter != other.BlocksEnd(); ++iter) {
@@ -74,15 +79,13 @@ CFG::~CFG()
 	}
 	all_blocks.clear();
 
-	if (has_loops) {
-		for (LoopListConstIter iter = loops->begin(), end = loops->end(); iter != end; ++iter) {
-			delete *iter;
-		}
-		loops->clear();
-		delete loops;
-		loop_header_map->clear();
-		delete loop_header_map;
+	for (LoopListConstIter iter = loops->begin(), end = loops->end(); iter != end; ++iter) {
+		delete *iter;
 	}
+	loops->clear();
+	delete loops;
+	loop_header_map->clear();
+	delete loop_header_map;
 }
 
 // This is where we look at a stream of instructions and build basic-blocks
@@ -211,17 +214,14 @@ void CFG::AddBasicBlock(BasicBlock *bb)
 
 void CFG::AddLoop(Loop *loop)
 {
-	if (has_loops == 0) {
-		has_loops = 1;
-		loops = new vector<Loop *>();
-	}
+	has_loops = 1;
 	loops->push_back(loop);
 }
 
 unsigned CFG::DetectLoops()
 {
+	TIME_PHASE(PHASE_LOOPS);
 	Assert((constructed == 1), "Detecting loops before CFG construction");
-	loop_header_map = new map<BasicBlock *, Loop *>();
 
 	BasicBlock *first = *(BlocksBegin());
 	DoDFS(first);
@@ -229,12 +229,14 @@ unsigned CFG::DetectLoops()
 	// all the loops have been identified, construct nat loops
 	for (LoopListConstIter iter = loops->begin(), end = loops->end(); iter != end; ++iter) {
 		Loop *loop = *iter;
+		CheckDeadline();
 		loop->ConstructNatLoop(loop_header_map);
 	}
 
 	// adjust nesting depths of the loops
 	bool changed = true;
 	while(changed) {
+		CheckDeadline();
 		changed = false;
 		for (LoopListConstIter iter = loops->begin(), end = loops->end(); iter != end; ++iter) {
 			Loop *loop = *iter;
@@ -247,34 +249,27 @@ unsigned CFG::DetectLoops()
 		}
 	}
 
-	// if the loops in the kernel are unrolled, read the unroll configurations
-	// from the user and update the loop iterations accordingly
-	if (unrolled_loops) {
-		ifstream uconf_file("./.uconf");
-		if (uconf_file.bad() || uconf_file.fail()) {
-			cerr << "Error reading unroll config file. Using default loop iter count" << endl;
-		}
-		else {
-			vector<unsigned> ufactors;
-			uconf_file.flags(ios::skipws);
-			for (unsigned i = 0; i < loops->size() && !(uconf_file.eof() || uconf_file.fail()); ++i) {
-				unsigned tmp = 1;
-				uconf_file >> tmp;
-				ufactors.push_back(tmp);
-			}
-			if (ufactors.size() != loops->size()) {
-				cerr << "Number of unroll factors != number of loops. Using default loop iter count" << endl;
-			}
-			else {
-				for (unsigned i = 0; i < loops->size(); ++i) {
-					Loop *loop = (*loops)[i];
-					unsigned ufactor = ufactors[loop->Id()];
-					if (ufactor == 0)
-						loop->SetNumIters(0);
-					else
-						loop->SetNumIters(loop->GetNumIters() / ufactor);
-				}
-			}
+	// count the iterations from the induction variables where possible
+	for (LoopListConstIter iter = loops->begin(), end = loops->end(); iter != end; ++iter) {
+		Loop *loop = *iter;
+		const TripCount trip(loop);
+		loop->SetTripCount(trip.GetKind(), trip.GetExpr());
+		if (trip.GetKind() == TRIP_CONSTANT) loop->SetNumIters(trip.GetIterations());
+	}
+
+	// if the loops in the kernel are unrolled, update the loop iterations
+	// by the unroll factors the kernel was given. Counts found in the
+	// unrolled code already take the factor into account
+	if (!ufactors.empty() && ufactors.size() != loops->size())
+		cerr << "Number of unroll factors != number of loops. Using default loop iter count" << endl;
+	if (!ufactors.empty() && ufactors.size() == loops->size()) {
+		for (unsigned i = 0; i < loops->size(); ++i) {
+			Loop *loop = (*loops)[i];
+			unsigned ufactor = ufactors[loop->Id()];
+			if (ufactor == 0)
+				loop->SetNumIters(0);
+			else if (loop->GetTripKind() != TRIP_CONSTANT)
+				loop->SetNumIters(loop->GetNumIters() / ufactor);
 		}
 	}
 
@@ -367,7 +362,22 @@ static void UpdateCyclesInMap(map<int, unsigned long long>& cmap, unsigned long
 	//cmap = tmp_map;
 }
 
-unsigned long long stall_cycles = 0;
+// Report the cycles spent in a loop as soon as the cycle model has costed it
+static void ReportLoopCycles(const Loop *loop, unsigned long long cycles, bool inner)
+{
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord();
+		out.Field("id", loop->Id());
+		out.Field("header", loop->GetHeader()->Id());
+		out.Field("inner", (unsigned) inner);
+		out.Field("cycles", cycles);
+		out.EndRecord();
+		return;
+	}
+	out.Stream() << "Total cycles in " << (inner ? "inner loop " : "loop ") << loop->Id()
+							 << " (Header bb: " << loop->GetHeader()->Id() << ") = " << cycles << '\n';
+}
 
 unsigned long long
 CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps) const
@@ -384,6 +394,7 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 		map<int, unsigned long long> global_load_cycles;
 
 		while (inst_iter != last_inst) {
+			CheckDeadline();
 			// walk the loop forwards
 			Instruction *block_last_inst = bb_iter->GetLastInst()->GetNext();
 			while (inst_iter != block_last_inst) {
@@ -419,14 +430,15 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 				case OPR_BRANCH:
 				case OPR_COND_BRANCH:
 					if (!exp_mode) {
-						current_cycles += 4;
+						current_cycles += IssueCycles(inst_iter);
 						break;
 					}
 				case OPR_MEM:
 					if (inst_iter->IsSharedOp() || (exp_mode && inst_iter->GetOpcode() != OPR_MEM)) {
-						current_cycles += 4;
+						unsigned long long issue_cycles = IssueCycles(inst_iter);
+						current_cycles += issue_cycles;
 						if (exp_mode) {
-							UpdateCyclesInMap(global_load_cycles, 4);
+							UpdateCyclesInMap(global_load_cycles, issue_cycles);
 						}
 					}
 					else if (inst_iter->IsGlobalOp() || inst_iter->IsLocalOp()) {
@@ -449,7 +461,8 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 						
 						// a global/local mem causes a warp-switch
 						else {
-							total_cycles += max<unsigned long long>((current_cycles * num_warps), GLOBAL_MEM_LATENCY);
+							total_cycles += max<unsigned long long>((current_cycles * num_warps),
+																											GLOBAL_MEM_LATENCY + TransactionCycles(inst_iter));
 							current_cycles = 0;
 						}
 					}
@@ -480,9 +493,10 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 			if (bb_iter->IsLoopHeader()) {
 				Loop *inner_loop = GetLoopFromHeader(bb_iter);
 				total_cycles += current_cycles * num_warps; current_cycles = 0;
+				unsigned long long stalls = stall_cycles;
 				unsigned long long tmp_cycles = CountLoopCycles(inner_loop, device, num_warps);
-				cout << "Total cycles in inner loop " << inner_loop->Id() \
-					<< " (Header bb: " << inner_loop->GetHeader()->Id() << ") = " << tmp_cycles << endl;
+				inner_loop->SetCycles(tmp_cycles, stall_cycles - stalls);
+				ReportLoopCycles(inner_loop, tmp_cycles, true);
 				total_cycles += tmp_cycles;
 				bb_iter = FindLoopFooterSuccessor(inner_loop);
 			}
@@ -508,6 +522,7 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 
 		// walk the loop backwards till we reach the first instr in the header
 		while (inst_iter != loop->GetHeader()->GetFirstInst()->GetPrev()) {
+			CheckDeadline();
 
 			// walk each bb backwards till we reach the first inst in the block
 			Instruction *block_first_inst = (bb_iter->GetFirstInst()->GetPrev());
@@ -520,7 +535,7 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 					break;
 				}
 				else {
-					later_cycles += 4;
+					later_cycles += IssueCycles(inst_iter);
 				}
 				inst_iter = (inst_iter->GetPrev());
 			}
@@ -575,14 +590,15 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 				case OPR_BRANCH:
 				case OPR_COND_BRANCH:
 					if (!exp_mode) {
-						current_cycles += 4;
+						current_cycles += IssueCycles(inst_iter);
 						break;
 					}
 				case OPR_MEM:
 					if (inst_iter->IsSharedOp() || (exp_mode && inst_iter->GetOpcode() != OPR_MEM)) {
-						current_cycles += 4;
+						unsigned long long issue_cycles = IssueCycles(inst_iter);
+						current_cycles += issue_cycles;
 						if (exp_mode) {
-							UpdateCyclesInMap(global_load_cycles, 4);
+							UpdateCyclesInMap(global_load_cycles, issue_cycles);
 						}
 					}
 					else if (inst_iter->IsGlobalOp() || inst_iter->IsLocalOp()) {
@@ -597,19 +613,24 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 								global_load_cycles.insert(pair<int, unsigned long long>(dst, 4));
 							}
 							else {
-								total_cycles += max<unsigned long long>((current_cycles *num_warps), GLOBAL_MEM_LATENCY);
+								total_cycles += max<unsigned long long>((current_cycles *num_warps),
+																												GLOBAL_MEM_LATENCY + TransactionCycles(inst_iter));
 								current_cycles = 0;
 								//current_cycles += 4;
 							}
 						}
 
 						else {
+							// the group waits for the latency once, and for the
+							// extra transactions of each of its accesses
+							unsigned long long mem_cycles = GLOBAL_MEM_LATENCY + TransactionCycles(inst_iter);
 							while (inst_iter->GetNext() && 
 									(inst_iter->GetNext()->IsGlobalOp() || inst_iter->GetNext()->IsLocalOp())) {
 								current_cycles += 4;
 								inst_iter = inst_iter->GetNext();
+								mem_cycles += TransactionCycles(inst_iter);
 							}
-							total_cycles += max<unsigned long long>((current_cycles * num_warps), GLOBAL_MEM_LATENCY);
+							total_cycles += max<unsigned long long>((current_cycles * num_warps), mem_cycles);
 							current_cycles = 0;
 						}
 						if (inst_iter == first_blocking_inst) {
@@ -647,7 +668,9 @@ CFG::CountLoopCycles(const Loop *loop, const Device *device, unsigned num_warps)
 unsigned long long 
 CFG::CountCycles(const Device *device, unsigned num_warps) const
 {
+	TIME_PHASE(PHASE_CYCLES);
 	Assert(constructed == 1, "CFG not constructed");
+	stall_cycles = 0;
 	BasicBlock *iter = entry;
 	unsigned long long total_cycles = 0, current_cycles = 0;
 	map<int, unsigned long long> global_load_cycles;
@@ -655,6 +678,7 @@ CFG::CountCycles(const Device *device, unsigned num_warps) const
 	// Walk through all the bbs in the kernel and compute
 	// the total number of cycles
 	while (true) {
+		CheckDeadline();
 		// We've reached the end of the CFG
 		if (iter->Id() == exit->Id()){
 			// flush the counters
@@ -669,10 +693,11 @@ CFG::CountCycles(const Device *device, unsigned num_warps) const
 
 			// Process the loop and compute the number of cycles
 			total_cycles += (current_cycles * num_warps); current_cycles = 0;
+			unsigned long long stalls = stall_cycles;
 			unsigned long long loop_cycles = CountLoopCycles(loop, device, num_warps);
+			loop->SetCycles(loop_cycles, stall_cycles - stalls);
 			total_cycles += loop_cycles;
-			cout << "Total cycles in loop " << loop->Id() \
-					 << " (Header bb: " << loop->GetHeader()->Id() << ") = " << loop_cycles << endl;
+			ReportLoopCycles(loop, loop_cycles, false);
 
 			iter = FindLoopFooterSuccessor(loop);
 			Assert(iter != 0, "Loop with multiple footers seen");
@@ -716,14 +741,15 @@ CFG::CountCycles(const Device *device, unsigned num_warps) const
 				case OPR_BRANCH:
 				case OPR_COND_BRANCH:
 					if (!exp_mode) {
-						current_cycles += 4;
+						current_cycles += IssueCycles(inst_iter);
 						break;
 					}
 				case OPR_MEM:
 					if (inst_iter->IsSharedOp() || (exp_mode && inst_iter->GetOpcode() != OPR_MEM)) {
-						current_cycles += 4;
+						unsigned long long issue_cycles = IssueCycles(inst_iter);
+						current_cycles += issue_cycles;
 						if (exp_mode) {
-							UpdateCyclesInMap(global_load_cycles, 4);
+							UpdateCyclesInMap(global_load_cycles, issue_cycles);
 						}
 					}
 					else if (inst_iter->IsGlobalOp() || inst_iter->IsLocalOp()) {
@@ -737,17 +763,20 @@ CFG::CountCycles(const Device *device, unsigned num_warps) const
 								global_load_cycles.insert(pair<int, unsigned long long>(dst, 4));
 							}
 							else {
-								total_cycles += max<unsigned long long>((current_cycles * num_warps), GLOBAL_MEM_LATENCY);
+								total_cycles += max<unsigned long long>((current_cycles * num_warps),
+																												GLOBAL_MEM_LATENCY + TransactionCycles(inst_iter));
 								current_cycles = 0;
 								//current_cycles += 4;
 							}
 						}
 						else {
+							unsigned long long mem_cycles = GLOBAL_MEM_LATENCY;
 							while (inst_iter && (inst_iter->IsGlobalOp() || inst_iter->IsLocalOp())) {
 								current_cycles += 4;
+								mem_cycles += TransactionCycles(inst_iter);
 								inst_iter = inst_iter->GetNext();
 							}
-							total_cycles += max<unsigned long long>((current_cycles * num_warps), GLOBAL_MEM_LATENCY);
+							total_cycles += max<unsigned long long>((current_cycles * num_warps), mem_cycles);
 							current_cycles = 0;
 						}
 					}
@@ -771,11 +800,10 @@ CFG::CountCycles(const Device *device, unsigned num_warps) const
 		iter = FindBBSuccessor(iter);
 
 	}
-	cout << "Total stall cycles = " << stall_cycles << endl;
 	return total_cycles;
 }
 
-Loop::Loop(BasicBlock *h, BasicBlock *f) : id(global_loop_index++), header(h), footer(f), enclosing_loop(0), /*num_iters(64)*/ num_iters(256), num_instrs(0), nesting_level(0), multiple_footers(0), has_inner_loops(0) {}
+Loop::Loop(BasicBlock *h, BasicBlock *f, unsigned i) : id(i), header(h), footer(f), enclosing_loop(0), /*num_iters(64)*/ num_iters(256), cycles(0), stall_cycles(0), num_instrs(0), nesting_level(0), multiple_footers(0), has_inner_loops(0), trip_kind(TRIP_DEFAULT) {}
 
 Loop::~Loop()
 {
@@ -810,7 +838,6 @@ void Loop::AddInnerLoop(Loop *inner)
 
 // Initialize the static variable
 unsigned short Loop::max_nesting_level = 0;
-unsigned Loop::global_loop_index = 0;
 
 void Loop::ConstructNatLoop(map<BasicBlock *, Loop *> *lh_map)
 {
@@ -853,26 +880,96 @@ void Loop::ConstructNatLoop(map<BasicBlock *, Loop *> *lh_map)
 	SetNumInstrs(num_instrs);
 }
 
-void CFG::DoDFS(BasicBlock *bb)
+// The blocks in post-order from the entry block, followed by those the
+// entry cannot reach. Returns the number of reachable blocks. The walk
+// keeps its own stack, since large kernels have CFGs deeper than the
+// native one
+unsigned CFG::GetPostOrder(vector<const BasicBlock *>& order) const
 {
-	Assert((!bb->GetFullyVisited()), "Invalid CFG edge detected");
+	order.clear();
+	if (all_blocks.empty()) return 0;
+
+	set <const BasicBlock *> visited;
+	vector < pair<const BasicBlock *, BBListConstIter> > stack;
+	const BasicBlock *first = all_blocks.front();
+	visited.insert(first);
+	stack.push_back(make_pair(first, first->SuccBegin()));
+	while (!stack.empty()) {
+		const BasicBlock *bb = stack.back().first;
+		BBListConstIter& next = stack.back().second;
+		if (next == bb->SuccEnd()) {
+			order.push_back(bb);
+			stack.pop_back();
+			continue;
+		}
+		const BasicBlock *succ = *next++;
+		if (visited.insert(succ).second)
+			stack.push_back(make_pair(succ, succ->SuccBegin()));
+	}
+
+	unsigned reachable = order.size();
+	for (BBListConstIter iter = BlocksBegin(); iter != BlocksEnd(); ++iter) {
+		if (visited.insert(*iter).second)
+			order.push_back(*iter);
+	}
+	return reachable;
+}
 
-	if (bb->GetPartiallyVisited())
+// The time a global access takes beyond GLOBAL_MEM_LATENCY, for the
+// transactions the warp needs past the first. Local memory is interleaved
+// by thread, so its accesses are always a single transaction
+unsigned long long CFG::TransactionCycles(const Instruction *inst) const
+{
+	if (coalescing == 0 || !inst->IsGlobalOp()) return 0;
+	return (unsigned long long) (inst->GetTransactions() - 1) * GLOBAL_TRANSACTION_CYCLES;
+}
+
+// The time a shared access is replayed for the bank conflicts of its
+// half-warps, on top of its issue. ALU ops can read a shared operand too
+unsigned long long CFG::ConflictCycles(const Instruction *inst) const
+{
+	if (coalescing == 0) return 0;
+	return (unsigned long long) (inst->GetConflicts() - 1) * SHARED_CONFLICT_CYCLES;
+}
+
+// The cycles an instruction holds the issue slot for: those of its opcode,
+// and the replays of its shared operand
+unsigned long long CFG::IssueCycles(const Instruction *inst) const
+{
+	return OpcodeIssue(inst->GetCode()) + ConflictCycles(inst);
+}
+
+void CFG::DoDFS(BasicBlock *first)
+{
+	Assert((!first->GetFullyVisited()), "Invalid CFG edge detected");
+
+	if (first->GetPartiallyVisited())
 		// we're the target of a back-edge, mostly a loop-header
 		return;
 
-	if (bb->GetNotVisited())
-		bb->SetPartiallyVisited();
+	// the walk keeps its own stack, as GetPostOrder() does, since large
+	// kernels have CFGs deeper than the native one
+	vector < pair<BasicBlock *, BBListIter> > stack;
+	first->SetPartiallyVisited();
+	stack.push_back(make_pair(first, first->SuccBegin()));
+	while (!stack.empty()) {
+		BasicBlock *bb = stack.back().first;
+		BBListIter& next = stack.back().second;
+		if (next == bb->SuccEnd()) {
+			// Finish visting this node
+			bb->SetFullyVisited();
+			stack.pop_back();
+			continue;
+		}
 
-	for (BBListIter iter = bb->SuccBegin(), end = bb->SuccEnd(); iter != end; ++iter) {
-		BasicBlock *succ = *iter;
+		BasicBlock *succ = *next++;
 		if (succ->GetPartiallyVisited()) {
 			// this is a CFG back-edge. so we're the loop-footer and the successor 
 			// is the loop-header. Mark the blocks and create a loop structure and 
 			// attach to CFG
 			if (!succ->IsLoopHeader()) {
 				succ->SetLoopHeader();
-				Loop *loop = new Loop(succ, bb);
+				Loop *loop = new Loop(succ, bb, num_loops++);
 				AddLoop(loop);
 				loop_header_map->insert(pair<BasicBlock *, Loop *>(succ, loop));
 			}
@@ -887,10 +984,9 @@ void CFG::DoDFS(BasicBlock *bb)
 			bb->SetLoopFooter();
 		}
 		if (succ->GetNotVisited()) {
-			DoDFS(succ);
+			succ->SetPartiallyVisited();
+			stack.push_back(make_pair(succ, succ->SuccBegin()));
 		}
 	}
-	// Finish visting this node
-	bb->SetFullyVisited();
 }
 
@@ -11,9 +11,17 @@
 #include <stack>
 using namespace std;
 
+// every transaction of a warp's global access past the first
+#define GLOBAL_TRANSACTION_CYCLES 32
+// every pass of a warp's shared access past the first
+#define SHARED_CONFLICT_CYCLES 4
+
 typedef enum {COLOR_WHITE, COLOR_GRAY, COLOR_BLACK} VisitState;
 typedef enum {DUMP_INFO = 1, DUMP_COUNTS = 2, DUMP_RATIOS = 4} DumpType;
 
+void DumpCounts(const InstCounts&, DumpType, const string&);
+void DumpOpcodes(const OpcodeHistogram&);
+
 class VisitInfo
 {
 	public:
@@ -31,6 +39,7 @@ class BasicBlock;
 class Loop;
 class CFG;
 class Kernel;
+class Coalescing;
 
 typedef vector<BasicBlock *> BBList;
 typedef BBList::iterator BBListIter;
@@ -46,7 +55,11 @@ typedef LoopList::const_iterator LoopListConstIter;
 typedef LoopList::reverse_iterator LoopListRevIter;
 typedef LoopList::const_reverse_iterator LoopListConstRevIter;
 
-void DumpCFGToDot(CFG *);
+typedef enum {DOT_FULL, DOT_SUMMARY} DotDetail;
+
+// Where the iteration count of a loop comes from, see TripCount.h
+typedef enum {TRIP_DEFAULT, TRIP_CONSTANT, TRIP_SYMBOLIC} TripKind;
+void DumpCFGToDot(const CFG *, const string&, DotDetail = DOT_FULL, bool fold_loops = false);
 
 class BasicBlock
 {
@@ -77,6 +90,7 @@ class BasicBlock
 	inline unsigned GetLocalOpCount() const {return local_op_count;}
 	inline unsigned GetTotalOpCount() const {return total_op_count;}
 	inline unsigned GetGlobalOpCount() const {return global_op_count;}
+	inline unsigned GetSyncOpCount() const {return sync_op_count;}
 
 	inline void SetVisitInfo(VisitInfo v) {vi = v;}
 	inline void SetPartiallyVisited() {vi.vs = COLOR_GRAY;}
@@ -114,6 +128,7 @@ class CFG
 	inline LoopListIter LoopsEnd() {return loops->end();}
 	inline LoopListConstIter LoopsBegin() const {return loops->begin();}
 	inline LoopListConstIter LoopsEnd() const {return loops->end();}
+	inline bool HasLoops() const {return has_loops == 1;}
 	void AddBasicBlock(BasicBlock *);
 	unsigned DetectLoops();
 	inline void AddLoop(Loop *l);
@@ -128,7 +143,20 @@ class CFG
 	void DumpRatios() const;
 	void DumpLoopRatios() const;
 	unsigned long long CountCycles(const Device *, unsigned) const;
+	inline unsigned long long GetStallCycles() const {return stall_cycles;}
+	inline unsigned GetNumBlocks() const {return all_blocks.size() - 2;}
+	inline unsigned GetNumLoops() const {return num_loops;}
 	unsigned long long CountLoopCycles(const Loop *, const Device *, unsigned) const;
+	unsigned GetPostOrder(vector<const BasicBlock *>&) const;
+	// the cycle model charges global accesses by their transactions, and
+	// shared ones by their bank conflicts, once set
+	inline void SetCoalescing(const Coalescing *c) {coalescing = c;}
+	// the factors the loops were unrolled by, one per loop id, for
+	// -unrolled or set through the library; set before DetectLoops()
+	inline void SetUnrollFactors(const vector<unsigned>& f) {ufactors = f;}
+	unsigned long long TransactionCycles(const Instruction *) const;
+	unsigned long long ConflictCycles(const Instruction *) const;
+	unsigned long long IssueCycles(const Instruction *) const;
 
 	private:
 	BBList all_blocks;
@@ -136,6 +164,10 @@ class CFG
 	map <const Instruction *, BasicBlock *> *block_map;
 	map <BasicBlock *, Loop *> *loop_header_map;
 	LoopList *loops;
+	unsigned num_loops;
+	mutable unsigned long long stall_cycles;
+	const Coalescing *coalescing;
+	vector <unsigned> ufactors;
 	unsigned constructed:1;
 	unsigned has_loops:1;
 	unsigned unrolled_loops:1;
@@ -144,13 +176,12 @@ class CFG
 	void ConstructCFG();
 	void DoDFS(BasicBlock *);
 
-	friend void ::DumpCFGToDot(CFG *);
 };
 
 class Loop
 {
 	public:
-	Loop(BasicBlock *, BasicBlock *);
+	Loop(BasicBlock *, BasicBlock *, unsigned);
 	~Loop();
 
 	inline void SetEnclosingLoop(Loop *l) {enclosing_loop = l;}
@@ -167,10 +198,17 @@ class Loop
 	inline LoopListConstRevIter InnerLoopsREnd() const {Assert(HasInnerLoops(), "No inner loops"); return inner_loops->rend();}
 	inline BBSetConstIter NatLoopBegin() const {return nat_loop.begin();}
 	inline BBSetConstIter NatLoopEnd() const {return nat_loop.end();}
+	inline bool InNatLoop(const BasicBlock *bb) const {return nat_loop.count(const_cast<BasicBlock *>(bb)) != 0;}
 	inline BasicBlock * GetHeader() const {return header;}
 	inline BasicBlock * GetFooter() const {return (multiple_footers == 1) ? 0 : footer;}
 	inline unsigned GetNumIters() const {return num_iters;}
 	inline void SetNumIters(unsigned n) {num_iters = n;}
+	inline TripKind GetTripKind() const {return (TripKind) trip_kind;}
+	inline const string& GetTripExpr() const {return trip_expr;}
+	inline void SetTripCount(TripKind k, const string& e) {trip_kind = k; trip_expr = e;}
+	inline unsigned long long GetCycles() const {return cycles;}
+	inline unsigned long long GetStallCycles() const {return stall_cycles;}
+	inline void SetCycles(unsigned long long c, unsigned long long s) {cycles = c; stall_cycles = s;}
 	inline unsigned GetNumInstrs() const {return num_instrs;}
 	inline void SetNumInstrs(unsigned num) {num_instrs = num;}
 	inline bool HasInnerLoops() const {return has_inner_loops == 1;}
@@ -189,12 +227,16 @@ class Loop
 	vector <BasicBlock *> *footers;
 	set <BasicBlock *> nat_loop;
 	unsigned num_iters;
+	// what the cycle model charged for one entry into the loop
+	unsigned long long cycles, stall_cycles;
+	// the trip count as inferred, symbolic or constant
+	string trip_expr;
 	unsigned num_instrs;
 	unsigned short nesting_level;
 	unsigned multiple_footers:1;
 	unsigned has_inner_loops:1;
+	unsigned trip_kind:2;
 
 	static unsigned short max_nesting_level;
-	static unsigned global_loop_index;
 };
 #endif
@@ -0,0 +1,707 @@
+#include "Coalescing.h"
+#include "Parser.h"
+#include "Emitter.h"
+#include "Stats.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+using namespace std;
+
+// Strides beyond this are taken as unknown rather than followed further
+static const long MAX_STRIDE = 1L << 24;
+
+// An affine value of the given stride, unknown if it grew too large
+static RegValue Affine(long stride, bool known = true)
+{
+	if (known && stride == 0) return RegValue(VALUE_UNIFORM);
+	if (known && labs(stride) > MAX_STRIDE) known = false;
+	return RegValue(VALUE_AFFINE, known ? stride : 0, known);
+}
+
+RegValue RegValue::Meet(const RegValue& other) const
+{
+	if (kind == VALUE_UNDEF || *this == other) return other;
+	if (other.kind == VALUE_UNDEF) return *this;
+	if (IsUniform() && other.IsUniform()) return RegValue(VALUE_UNIFORM);
+	if (kind == VALUE_AFFINE && other.kind == VALUE_AFFINE) return Affine(0, false);
+	return RegValue(VALUE_VARYING);
+}
+
+static RegValue Negate(const RegValue& a)
+{
+	if (a.kind == VALUE_CONST) return RegValue(VALUE_CONST, -a.value);
+	if (a.kind == VALUE_AFFINE) return Affine(-a.value, a.known);
+	return a;
+}
+
+static RegValue Add(const RegValue& a, const RegValue& b)
+{
+	if (a.kind == VALUE_VARYING || b.kind == VALUE_VARYING) return RegValue(VALUE_VARYING);
+	if (a.kind == VALUE_CONST && b.kind == VALUE_CONST) return RegValue(VALUE_CONST, a.value + b.value);
+	if (a.IsUniform() && b.IsUniform()) return RegValue(VALUE_UNIFORM);
+	if (b.IsUniform()) return a;
+	if (a.IsUniform()) return b;
+	return Affine(a.value + b.value, a.known && b.known);
+}
+
+static RegValue Multiply(const RegValue& a, const RegValue& b)
+{
+	if (a.kind == VALUE_VARYING || b.kind == VALUE_VARYING) return RegValue(VALUE_VARYING);
+	if (a.kind == VALUE_CONST && b.kind == VALUE_CONST) return RegValue(VALUE_CONST, a.value * b.value);
+	if (a.IsUniform() && b.IsUniform()) return RegValue(VALUE_UNIFORM);
+	if (a.kind == VALUE_AFFINE && b.kind == VALUE_AFFINE) return RegValue(VALUE_VARYING);
+
+	const RegValue& affine = (a.kind == VALUE_AFFINE) ? a : b;
+	const RegValue& factor = (a.kind == VALUE_AFFINE) ? b : a;
+	if (factor.kind == VALUE_CONST) {
+		if (factor.value == 0) return RegValue(VALUE_CONST, 0);
+		return Affine(affine.value * factor.value, affine.known);
+	}
+	return Affine(0, false);
+}
+
+static RegValue ShiftLeft(const RegValue& a, const RegValue& b)
+{
+	if (b.kind == VALUE_CONST && b.value >= 0 && b.value < 32)
+		return Multiply(a, RegValue(VALUE_CONST, 1L << b.value));
+	if (b.IsUniform()) return Multiply(a, RegValue(VALUE_UNIFORM));
+	return RegValue(VALUE_VARYING);
+}
+
+// A token of an instruction, left in place in the instruction string
+class Token
+{
+	public:
+	Token(const char *s = 0, unsigned n = 0) : str(s), len(n) {}
+	inline bool StartsWith(const char *prefix) const
+	{
+		size_t n = strlen(prefix);
+		return len >= n && strncmp(str, prefix, n) == 0;
+	}
+	inline bool Equals(const char *other) const {return len == strlen(other) && StartsWith(other);}
+	// the position of the given character or string, len if not there
+	inline unsigned Find(char c, unsigned from = 0) const
+	{
+		for (unsigned i = from; i < len; ++i) if (str[i] == c) return i;
+		return len;
+	}
+	inline unsigned Find(const char *key, unsigned from = 0) const
+	{
+		size_t n = strlen(key);
+		for (unsigned i = from; i + n <= len; ++i) if (strncmp(str + i, key, n) == 0) return i;
+		return len;
+	}
+	const char *str;
+	unsigned len;
+};
+
+static const unsigned MAX_TOKENS = 8;
+
+// Split an instruction into its opcode and operands, at spaces and commas.
+// Returns the number of tokens
+static unsigned Tokenize(const string& buf, unsigned start, Token tokens[])
+{
+	const char *str = buf.c_str();
+	unsigned size = buf.size(), count = 0;
+	while (count < MAX_TOKENS) {
+		while (start < size && (str[start] == SPACE_CHAR || str[start] == '\t' || str[start] == ',')) ++start;
+		if (start == size) break;
+		unsigned end = start;
+		while (end < size && str[end] != SPACE_CHAR && str[end] != '\t' && str[end] != ',') ++end;
+		tokens[count++] = Token(str + start, end - start);
+		start = end;
+	}
+	return count;
+}
+
+// The $ofsN registers are numbered from here while decoding, and moved
+// past the $r ones once their number is known
+static const short OFS_REG_BASE = 1 << 12;
+
+// The register named by $rN or $ofsN at the given position, -1 if there is
+// none
+static int RegisterAt(const Token& token, unsigned pos)
+{
+	if (pos + 2 < token.len && token.str[pos] == '$' && token.str[pos + 1] == 'r' && isdigit(token.str[pos + 2]))
+		return atoi(token.str + pos + 2);
+	if (pos + 4 < token.len && strncmp(token.str + pos, "$ofs", 4) == 0 && isdigit(token.str[pos + 4]))
+		return OFS_REG_BASE + atoi(token.str + pos + 4);
+	return -1;
+}
+
+static void NoteRegister(short reg, unsigned& num_gprs, unsigned& num_ofs)
+{
+	if (reg >= OFS_REG_BASE) num_ofs = max(num_ofs, (unsigned) (reg - OFS_REG_BASE + 1));
+	else num_gprs = max(num_gprs, (unsigned) (reg + 1));
+}
+
+static void MoveRegister(short& reg, unsigned num_gprs)
+{
+	if (reg >= OFS_REG_BASE) reg = reg - OFS_REG_BASE + num_gprs;
+}
+
+static AccessOperand DecodeOperand(const Token& token)
+{
+	AccessOperand operand;
+	if (token.len == 0) return operand;
+
+	unsigned bracket = token.Find('[');
+	if (bracket != token.len) {
+		// memory: loaded values differ from thread to thread, except those
+		// at fixed addresses of shared (the parameters and special registers)
+		// or constant memory. A constant indexed by a register is as uniform
+		// as the register
+		operand.reg = RegisterAt(token, token.Find('$', bracket));
+		if (token.str[0] == 'c') operand.kind = (operand.reg < 0) ? OPND_UNIFORM : OPND_DERIVED;
+		else if (token.str[0] == 's' && token.Find('$', bracket) == token.len) operand.kind = OPND_UNIFORM;
+		else operand.kind = OPND_VARYING;
+		if (operand.kind == OPND_VARYING) operand.reg = -1;
+		return operand;
+	}
+
+	if (token.str[0] == '$') {
+		operand.reg = RegisterAt(token, 0);
+		if (operand.reg < 0) {
+			// predicates and other special registers
+			operand.kind = OPND_VARYING;
+			return operand;
+		}
+		// the low half of a small value is the value itself
+		operand.kind = (token.Find(".hi") == token.len) ? OPND_REG : OPND_DERIVED;
+		return operand;
+	}
+
+	if (isdigit(token.str[0]) || (token.str[0] == '-' && token.len > 1 && isdigit(token.str[1]))) {
+		operand.kind = OPND_IMM;
+		operand.imm = strtol(string(token.str, token.len).c_str(), 0, 0);
+		return operand;
+	}
+
+	// negated registers and whatever else
+	operand.reg = RegisterAt(token, token.Find("$r"));
+	operand.kind = (operand.reg < 0) ? OPND_VARYING : OPND_DERIVED;
+	return operand;
+}
+
+// The width in bytes of the type an opcode moves, by its last type suffix
+static unsigned AccessWidth(const Token& opcode)
+{
+	unsigned width = 4;
+	for (unsigned dot = opcode.Find(DOT_CHAR); dot < opcode.len; dot = opcode.Find(DOT_CHAR, dot + 1)) {
+		char type = (dot + 2 < opcode.len) ? opcode.str[dot + 1] : 0;
+		if (type == 'u' || type == 's' || type == 'b' || type == 'f') {
+			unsigned bits = atoi(opcode.str + dot + 2);
+			if (bits == 8 || bits == 16 || bits == 32 || bits == 64 || bits == 128)
+				width = bits / 8;
+		}
+	}
+	return width;
+}
+
+Coalescing::Coalescing(const CFG *c)
+: cfg(c), num_regs(1), num_reachable(0), num_visits(0)
+{
+	TIME_PHASE(PHASE_COALESCING);
+
+	// forwards, so in reverse post-order
+	num_reachable = cfg->GetPostOrder(order);
+	reverse(order.begin(), order.begin() + num_reachable);
+	for (unsigned i = 0; i < order.size(); ++i)
+		index.insert(make_pair(order[i], i));
+
+	unsigned long long ninstrs = 0;
+	for (unsigned i = 0; i < order.size(); ++i)
+		ninstrs += order[i]->GetNumInstrs();
+	insts.reserve(ninstrs);
+	first.assign(order.size() + 1, 0);
+	unsigned num_ofs = 0;
+	for (unsigned i = 0; i < order.size(); ++i) {
+		const BasicBlock *bb = order[i];
+		first[i] = insts.size();
+		for (Instruction *inst = bb->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+			if (!inst->IsDeleted()) {
+				const AccessInst& decoded = Decode(inst);
+				insts.push_back(decoded);
+				NoteRegister(decoded.def, num_regs, num_ofs);
+				NoteRegister(decoded.addr_reg, num_regs, num_ofs);
+				NoteRegister(decoded.shared_reg, num_regs, num_ofs);
+				for (unsigned s = 0; s < decoded.num_srcs; ++s)
+					NoteRegister(decoded.srcs[s].reg, num_regs, num_ofs);
+			}
+			if (inst == bb->GetLastInst()) break;
+		}
+	}
+	first[order.size()] = insts.size();
+
+	if (num_ofs > 0) {
+		for (unsigned n = 0; n < insts.size(); ++n) {
+			AccessInst& decoded = insts[n];
+			MoveRegister(decoded.def, num_regs);
+			MoveRegister(decoded.addr_reg, num_regs);
+			MoveRegister(decoded.shared_reg, num_regs);
+			for (unsigned s = 0; s < decoded.num_srcs; ++s)
+				MoveRegister(decoded.srcs[s].reg, num_regs);
+		}
+		num_regs += num_ofs;
+	}
+
+	// the entry, and any block it cannot reach, start out with only the
+	// thread index known
+	RegState entry(num_regs);
+	entry[0] = Affine(1);
+	block_in.assign(order.size(), RegState(num_regs));
+	for (unsigned i = 0; i < order.size(); ++i) {
+		if (i == 0 || i >= num_reachable) block_in[i] = entry;
+	}
+	Solve();
+
+	for (unsigned i = 0; i < order.size(); ++i) {
+		RegState state = block_in[i];
+		for (unsigned n = first[i]; n < first[i + 1]; ++n) {
+			if (insts[n].global) Record(insts[n], order[i], state);
+			if (insts[n].shared) RecordShared(insts[n], order[i], state);
+			Apply(insts[n], state);
+		}
+	}
+
+	vector<const BasicBlock *>().swap(order);
+	index.clear();
+	vector<RegState>().swap(block_in);
+	vector<AccessInst>().swap(insts);
+	vector<unsigned>().swap(first);
+}
+
+AccessInst Coalescing::Decode(Instruction *inst)
+{
+	AccessInst decoded;
+	decoded.inst = inst;
+	const string& buf = inst->GetAscii();
+	Token tokens[MAX_TOKENS];
+	unsigned count = Tokenize(buf, Parser::IsLabel(buf) ? Parser::GetInstPos(buf) : 0, tokens);
+
+	unsigned pos = 0;
+	if (pos < count && tokens[pos].str[0] == AT_CHAR) {
+		decoded.partial = true;
+		++pos;
+	}
+	if (pos >= count) return decoded;
+	const Token& opcode = tokens[pos++];
+
+	// the global operand and the register-indexed shared one, if any; the
+	// first operand is written to. Shared operands at fixed addresses are
+	// the parameters, read by every thread alike
+	for (unsigned i = pos; i < count; ++i) {
+		if (!decoded.global && tokens[i].StartsWith(Parser::GLOBAL_OP_STR.c_str())) {
+			decoded.global = true;
+			decoded.store = (i == pos);
+			decoded.addr_reg = RegisterAt(tokens[i], tokens[i].Find('$'));
+			decoded.width = AccessWidth(opcode);
+		}
+		else if (!decoded.shared && tokens[i].StartsWith(Parser::SHARED_OP_STR.c_str())
+						 && tokens[i].Find('$') != tokens[i].len) {
+			decoded.shared = true;
+			decoded.shared_store = (i == pos);
+			decoded.shared_reg = RegisterAt(tokens[i], tokens[i].Find('$'));
+			decoded.width = AccessWidth(opcode);
+		}
+	}
+
+	// a set writes a predicate and a register, as in $p0|$r14
+	if (pos < count && tokens[pos].Find('[') == tokens[pos].len) {
+		const Token& dst = tokens[pos];
+		unsigned bar = dst.Find('|');
+		unsigned reg_pos = (bar == dst.len) ? 0 : bar + 1;
+		decoded.def = RegisterAt(dst, reg_pos);
+		if (decoded.def >= 0 && dst.Find(DOT_CHAR, reg_pos) != dst.len)
+			decoded.partial = true;
+	}
+	if (decoded.def < 0) return decoded;
+
+	bool high = (opcode.Find(".hi") != opcode.len);
+	switch (inst->GetMnemonic()) {
+		case MN_MOV:
+		case MN_CVT:
+			decoded.xfer = XFER_COPY;
+			break;
+		case MN_ADD:
+			decoded.xfer = XFER_ADD;
+			break;
+		case MN_SUB:
+			decoded.xfer = XFER_SUB;
+			break;
+		case MN_MUL:
+		case MN_MUL24:
+			decoded.xfer = high ? XFER_OTHER : XFER_MUL;
+			break;
+		case MN_MAD:
+		case MN_MAD24:
+			decoded.xfer = high ? XFER_OTHER : XFER_MAD;
+			break;
+		case MN_SHL:
+		case MN_MOVSH:
+			decoded.xfer = XFER_SHL;
+			break;
+		default:
+			decoded.xfer = XFER_OTHER;
+	}
+
+	for (unsigned i = pos + 1; i < count && decoded.num_srcs < 3; ++i)
+		decoded.srcs[decoded.num_srcs++] = DecodeOperand(tokens[i]);
+	return decoded;
+}
+
+// Registers not written yet are taken as uniform
+RegValue Coalescing::Evaluate(const AccessOperand& operand, const RegState& state) const
+{
+	switch (operand.kind) {
+		case OPND_REG:
+			return (state[operand.reg].kind == VALUE_UNDEF) ? RegValue(VALUE_UNIFORM) : state[operand.reg];
+		case OPND_DERIVED:
+			return state[operand.reg].IsUniform() ? RegValue(VALUE_UNIFORM) : RegValue(VALUE_VARYING);
+		case OPND_IMM:
+			return RegValue(VALUE_CONST, operand.imm);
+		case OPND_UNIFORM:
+			return RegValue(VALUE_UNIFORM);
+		default:
+			return RegValue(VALUE_VARYING);
+	}
+}
+
+// Update the state of the registers past the given instruction
+void Coalescing::Apply(const AccessInst& decoded, RegState& state) const
+{
+	if (decoded.def < 0) return;
+
+	RegValue src[3];
+	for (unsigned s = 0; s < 3; ++s)
+		src[s] = (s < decoded.num_srcs) ? Evaluate(decoded.srcs[s], state) : RegValue(VALUE_VARYING);
+
+	RegValue result;
+	switch (decoded.xfer) {
+		case XFER_COPY:
+			result = src[0];
+			break;
+		case XFER_ADD:
+			result = Add(src[0], src[1]);
+			break;
+		case XFER_SUB:
+			result = Add(src[0], Negate(src[1]));
+			break;
+		case XFER_MUL:
+			result = Multiply(src[0], src[1]);
+			break;
+		case XFER_MAD:
+			result = Add(Multiply(src[0], src[1]), src[2]);
+			break;
+		case XFER_SHL:
+			result = ShiftLeft(src[0], src[1]);
+			break;
+		default:
+			result = RegValue(VALUE_UNIFORM);
+			for (unsigned s = 0; s < decoded.num_srcs; ++s) {
+				if (!src[s].IsUniform()) result = RegValue(VALUE_VARYING);
+			}
+	}
+	state[decoded.def] = decoded.partial ? state[decoded.def].Meet(result) : result;
+}
+
+// Carry the register states along the edges until nothing changes. The
+// worklist always hands out the earliest block in reverse post-order
+void Coalescing::Solve()
+{
+	set <unsigned> worklist;
+	for (unsigned i = 0; i < order.size(); ++i)
+		worklist.insert(i);
+
+	RegState state;
+	while (!worklist.empty()) {
+		unsigned pos = *worklist.begin();
+		worklist.erase(worklist.begin());
+		const BasicBlock *bb = order[pos];
+		++num_visits;
+
+		state = block_in[pos];
+		for (unsigned n = first[pos]; n < first[pos + 1]; ++n)
+			Apply(insts[n], state);
+
+		for (BBListConstIter iter = bb->SuccBegin(); iter != bb->SuccEnd(); ++iter) {
+			unsigned succ = index.find(*iter)->second;
+			RegState& in = block_in[succ];
+			bool changed = false;
+			for (unsigned r = 0; r < num_regs; ++r) {
+				const RegValue& merged = in[r].Meet(state[r]);
+				if (merged != in[r]) {
+					in[r] = merged;
+					changed = true;
+				}
+			}
+			if (changed) worklist.insert(succ);
+		}
+	}
+}
+
+// Segments a warp touches when thread i accesses width bytes at base +
+// i * stride, with the base segment-aligned
+unsigned Coalescing::CountTransactions(long stride, unsigned width)
+{
+	unsigned long step = labs(stride);
+	if (step >= SEGMENT_BYTES) return WARP_THREADS;
+	unsigned long span = (WARP_THREADS - 1) * step + width;
+	return min<unsigned long>(WARP_THREADS, (span + SEGMENT_BYTES - 1) / SEGMENT_BYTES);
+}
+
+// Passes a half-warp takes when thread i accesses width bytes at base +
+// i * stride, with the base at the start of a bank. Threads after the same
+// word share its pass. The words of a thread never come before those of
+// the one ahead of it, so a word is new if it is past the last one counted
+unsigned Coalescing::CountConflicts(long stride, unsigned width)
+{
+	unsigned long step = labs(stride), next = 0;
+	unsigned banks[SHARED_BANKS] = {0}, conflicts = 1;
+	for (unsigned t = 0; t < HALF_WARP_THREADS; ++t) {
+		unsigned long start = t * step, word = max(next, start / BANK_BYTES);
+		for (; word <= (start + width - 1) / BANK_BYTES; ++word)
+			conflicts = max(conflicts, ++banks[word % SHARED_BANKS]);
+		next = word;
+	}
+	return conflicts;
+}
+
+// What the address register holds; a fixed address is uniform
+RegValue Coalescing::Address(short reg, const RegState& state) const
+{
+	AccessOperand operand;
+	operand.kind = (reg < 0) ? OPND_UNIFORM : OPND_REG;
+	operand.reg = reg;
+	return Evaluate(operand, state);
+}
+
+void Coalescing::Record(const AccessInst& decoded, const BasicBlock *bb, const RegState& state)
+{
+	MemAccess access;
+	access.inst = decoded.inst;
+	access.block = bb;
+	access.store = decoded.store;
+	access.width = decoded.width;
+
+	const RegValue& addr = Address(decoded.addr_reg, state);
+	if (addr.IsUniform()) {
+		access.pattern = ACCESS_COALESCED;
+		access.known_stride = true;
+		access.transactions = CountTransactions(0, access.width);
+	}
+	else if (addr.kind == VALUE_AFFINE && addr.known) {
+		access.stride = addr.value;
+		access.known_stride = true;
+		access.transactions = CountTransactions(addr.value, access.width);
+		access.pattern = ((unsigned long) labs(addr.value) <= access.width) ? ACCESS_COALESCED : ACCESS_STRIDED;
+	}
+	else
+		access.pattern = (addr.kind == VALUE_AFFINE) ? ACCESS_STRIDED : ACCESS_SCATTERED;
+
+	decoded.inst->SetTransactions(access.transactions);
+	accesses.push_back(access);
+}
+
+void Coalescing::RecordShared(const AccessInst& decoded, const BasicBlock *bb, const RegState& state)
+{
+	MemAccess access;
+	access.inst = decoded.inst;
+	access.block = bb;
+	access.store = decoded.shared_store;
+	access.width = decoded.width;
+
+	const RegValue& addr = Address(decoded.shared_reg, state);
+	if (addr.IsUniform()) {
+		access.pattern = ACCESS_COALESCED;
+		access.known_stride = true;
+		access.conflicts = 1;
+	}
+	else if (addr.kind == VALUE_AFFINE && addr.known) {
+		access.stride = addr.value;
+		access.known_stride = true;
+		access.conflicts = CountConflicts(addr.value, access.width);
+		access.pattern = ((unsigned long) labs(addr.value) <= access.width) ? ACCESS_COALESCED : ACCESS_STRIDED;
+	}
+	else
+		access.pattern = (addr.kind == VALUE_AFFINE) ? ACCESS_STRIDED : ACCESS_SCATTERED;
+
+	decoded.inst->SetConflicts(access.conflicts);
+	shared_accesses.push_back(access);
+}
+
+const char * Coalescing::PatternName(AccessPattern pattern)
+{
+	switch (pattern) {
+		case ACCESS_COALESCED: return "coalesced";
+		case ACCESS_STRIDED: return "strided";
+		default: return "scattered";
+	}
+}
+
+static bool CompareLines(const MemAccess *a, const MemAccess *b)
+{
+	return a->inst->GetLineNum() < b->inst->GetLineNum();
+}
+
+// Report the accesses in the order of the ptx, with the totals by pattern
+void Coalescing::Dump() const
+{
+	vector <const MemAccess *> sorted;
+	unsigned long long transactions = 0;
+	unsigned counts[ACCESS_SCATTERED + 1] = {0, 0, 0};
+	for (unsigned i = 0; i < accesses.size(); ++i) {
+		sorted.push_back(&accesses[i]);
+		transactions += accesses[i].transactions;
+		++counts[accesses[i].pattern];
+	}
+	sort(sorted.begin(), sorted.end(), CompareLines);
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("coalescing");
+		out.Field("total", GetNumAccesses());
+		out.Field("coalesced", counts[ACCESS_COALESCED]);
+		out.Field("strided", counts[ACCESS_STRIDED]);
+		out.Field("scattered", counts[ACCESS_SCATTERED]);
+		out.Field("transactions", transactions);
+		out.BeginList("accesses");
+		for (unsigned i = 0; i < sorted.size(); ++i) {
+			const MemAccess *access = sorted[i];
+			out.BeginRecord();
+			out.Field("line", access->inst->GetLineNum());
+			out.Field("kind", access->store ? "store" : "load");
+			out.Field("width", access->width);
+			out.Field("pattern", PatternName(access->pattern));
+			if (access->known_stride) out.Field("stride", (double) access->stride);
+			out.Field("transactions", access->transactions);
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << "Global accesses: " << GetNumAccesses() << " (coalesced " << counts[ACCESS_COALESCED]
+		 << ", strided " << counts[ACCESS_STRIDED] << ", scattered " << counts[ACCESS_SCATTERED]
+		 << "), transactions per warp: " << transactions << '\n';
+	for (unsigned i = 0; i < sorted.size(); ++i) {
+		const MemAccess *access = sorted[i];
+		os << "Line " << access->inst->GetLineNum() << ": " << (access->store ? "store" : "load")
+			 << " of " << access->width << " bytes, " << PatternName(access->pattern);
+		if (access->known_stride) os << ", stride " << access->stride;
+		else if (access->pattern == ACCESS_STRIDED) os << ", stride unknown";
+		os << ", " << access->transactions << (access->transactions == 1 ? " transaction" : " transactions") << '\n';
+	}
+}
+
+void Coalescing::CollectLoops(const Loop *loop, vector<const Loop *>& all) const
+{
+	all.push_back(loop);
+	if (loop->HasInnerLoops()) {
+		for (LoopListConstIter iter = loop->InnerLoopsBegin(); iter != loop->InnerLoopsEnd(); ++iter)
+			CollectLoops(*iter, all);
+	}
+}
+
+static bool CompareLoopIds(const Loop *a, const Loop *b)
+{
+	return a->Id() < b->Id();
+}
+
+static unsigned long long ReplayCycles(const MemAccess& access)
+{
+	return (unsigned long long) (access.conflicts - 1) * SHARED_CONFLICT_CYCLES;
+}
+
+// Report the shared accesses in the order of the ptx, then what they cost
+// every iteration of each loop, inner loops included
+void Coalescing::DumpBanks() const
+{
+	vector <const MemAccess *> sorted;
+	unsigned conflicting = 0;
+	unsigned long long replay_cycles = 0;
+	for (unsigned i = 0; i < shared_accesses.size(); ++i) {
+		sorted.push_back(&shared_accesses[i]);
+		if (shared_accesses[i].conflicts > 1) ++conflicting;
+		replay_cycles += ReplayCycles(shared_accesses[i]);
+	}
+	sort(sorted.begin(), sorted.end(), CompareLines);
+
+	vector <const Loop *> loops;
+	if (cfg->HasLoops()) {
+		for (LoopListConstIter iter = cfg->LoopsBegin(); iter != cfg->LoopsEnd(); ++iter)
+			CollectLoops(*iter, loops);
+	}
+	sort(loops.begin(), loops.end(), CompareLoopIds);
+
+	// the accesses, conflicting ones and replay cycles of each loop
+	vector <unsigned> loop_accesses(loops.size(), 0), loop_conflicting(loops.size(), 0);
+	vector <unsigned long long> loop_cycles(loops.size(), 0);
+	for (unsigned l = 0; l < loops.size(); ++l) {
+		for (unsigned i = 0; i < shared_accesses.size(); ++i) {
+			const MemAccess& access = shared_accesses[i];
+			if (!loops[l]->InNatLoop(access.block)) continue;
+			++loop_accesses[l];
+			if (access.conflicts > 1) ++loop_conflicting[l];
+			loop_cycles[l] += ReplayCycles(access);
+		}
+	}
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("banks");
+		out.Field("total", GetNumSharedAccesses());
+		out.Field("conflicting", conflicting);
+		out.Field("replay_cycles", replay_cycles);
+		out.BeginList("accesses");
+		for (unsigned i = 0; i < sorted.size(); ++i) {
+			const MemAccess *access = sorted[i];
+			out.BeginRecord();
+			out.Field("line", access->inst->GetLineNum());
+			out.Field("kind", access->store ? "store" : "load");
+			out.Field("width", access->width);
+			if (access->known_stride) out.Field("stride", (double) access->stride);
+			out.Field("conflicts", access->conflicts);
+			out.EndRecord();
+		}
+		out.EndList();
+		out.BeginList("loops");
+		for (unsigned l = 0; l < loops.size(); ++l) {
+			out.BeginRecord();
+			out.Field("id", loops[l]->Id());
+			out.Field("header", loops[l]->GetHeader()->Id());
+			out.Field("nesting_level", (unsigned) loops[l]->GetNestingLevel());
+			out.Field("accesses", loop_accesses[l]);
+			out.Field("conflicting", loop_conflicting[l]);
+			out.Field("replay_cycles", loop_cycles[l]);
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << "Shared accesses: " << GetNumSharedAccesses() << " (conflicting " << conflicting
+		 << "), replay cycles per warp: " << replay_cycles << '\n';
+	for (unsigned i = 0; i < sorted.size(); ++i) {
+		const MemAccess *access = sorted[i];
+		os << "Line " << access->inst->GetLineNum() << ": " << (access->store ? "store" : "load")
+			 << " of " << access->width << " bytes, ";
+		if (access->known_stride && access->stride == 0) os << "broadcast";
+		else if (access->known_stride) os << "stride " << access->stride;
+		else if (access->pattern == ACCESS_STRIDED) os << "stride unknown";
+		else os << "scattered";
+		os << ", " << access->conflicts << "-way" << (access->known_stride ? "" : " (estimated)") << '\n';
+	}
+	for (unsigned l = 0; l < loops.size(); ++l) {
+		const Loop *loop = loops[l];
+		os << "Loop " << loop->Id() << " (Header bb: " << loop->GetHeader()->Id()
+			 << ", Nesting level: " << loop->GetNestingLevel() << "): shared accesses " << loop_accesses[l]
+			 << ", conflicting " << loop_conflicting[l] << ", replay cycles per iteration " << loop_cycles[l] << '\n';
+	}
+}
@@ -0,0 +1,171 @@
+#ifndef _COALESCING_H_INCLUDED_
+#define _COALESCING_H_INCLUDED_
+
+#include "CFG.h"
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Address patterns of the global and shared memory accesses. Each register
+// is given what it holds across the threads of a warp: the same value in
+// all of them, a value growing by a fixed stride from one thread to the
+// next, or anything else. This is a forward dataflow over the CFG, seeded
+// with the thread index - decuda leaves tid.x in the low half of $r0 on
+// entry, and the kernels are taken as one-dimensional in x - and carried
+// through the arithmetic that turns it into an address (mov/cvt, add/sub,
+// mul/mul24, mad/mad24 and shl by constants, and movsh into the $ofs
+// registers that index shared memory). Kernel parameters and special
+// registers read from s[0x..], constants and immediates are the same in
+// every thread, and so are registers read before they are written.
+// Anything loaded from memory, and any other arithmetic on the thread
+// index, may differ arbitrarily.
+//
+// The stride of the address of a g[] operand then tells the pattern, and
+// the number of SEGMENT_BYTES segments the warp touches the transactions:
+//   coalesced - the threads read neighbouring words (stride at most the
+//               access width), or all the same word
+//   strided   - a fixed stride larger than the access, or an unknown one
+//   scattered - no known relation between the threads
+// Base addresses are taken as segment-aligned, so a coalesced 32-bit
+// access is one transaction per warp and a scattered one a transaction
+// per thread.
+//
+// The stride of an s[$ofsN+..] operand tells its bank conflicts instead.
+// Shared memory serves a half-warp at a time from SHARED_BANKS banks of
+// BANK_BYTES-wide words, and a bank hands out one word per pass, so an
+// access is replayed as many times as the most distinct words any one bank
+// is asked for. Threads reading the same word get it in the same pass, so
+// a uniform address is a broadcast without conflicts. An address with no
+// known stride is charged UNKNOWN_CONFLICTS, about what a half-warp of
+// random words would cost. Both counts are left on the instruction for the
+// cycle model, which walks the same instructions over and over.
+
+#define WARP_THREADS 32
+#define SEGMENT_BYTES 128
+#define HALF_WARP_THREADS 16
+#define SHARED_BANKS 16
+#define BANK_BYTES 4
+#define UNKNOWN_CONFLICTS 3
+
+typedef enum {VALUE_UNDEF, VALUE_CONST, VALUE_UNIFORM, VALUE_AFFINE, VALUE_VARYING} ValueKind;
+typedef enum {ACCESS_COALESCED, ACCESS_STRIDED, ACCESS_SCATTERED} AccessPattern;
+
+// What a register holds across a warp. A constant has its value, an
+// affine value its stride per thread, if known
+class RegValue
+{
+	public:
+	RegValue(ValueKind k = VALUE_UNDEF, long v = 0, bool s = true) : kind(k), value(v), known(s) {}
+	inline bool IsUniform() const {return kind == VALUE_UNDEF || kind == VALUE_CONST || kind == VALUE_UNIFORM;}
+	inline bool operator==(const RegValue& other) const
+	{
+		return kind == other.kind && value == other.value && known == other.known;
+	}
+	inline bool operator!=(const RegValue& other) const {return !(*this == other);}
+	RegValue Meet(const RegValue&) const;
+
+	ValueKind kind;
+	long value;
+	bool known;
+};
+
+typedef vector<RegValue> RegState;
+
+// An operand as far as the analysis cares: a register, a value derived
+// from one in a way not followed (such as its upper half), which is only
+// uniform if the register is, an immediate, or a value that is uniform or
+// varying by its form alone
+typedef enum {OPND_NONE, OPND_REG, OPND_DERIVED, OPND_IMM, OPND_UNIFORM, OPND_VARYING} OperandKind;
+
+class AccessOperand
+{
+	public:
+	AccessOperand() : kind(OPND_NONE), reg(-1), imm(0) {}
+	unsigned char kind;
+	short reg;
+	int imm;
+};
+
+typedef enum {XFER_NONE, XFER_COPY, XFER_ADD, XFER_SUB, XFER_MUL, XFER_MAD, XFER_SHL, XFER_OTHER} Transfer;
+
+// An instruction decoded once: the register it writes and how, and the
+// global or shared access it makes, if any. A predicated instruction, or
+// one that writes half of a register, may leave some of the old value
+class AccessInst
+{
+	public:
+	AccessInst() : inst(0), def(-1), addr_reg(-1), shared_reg(-1), partial(false), global(false), shared(false),
+		store(false), shared_store(false), xfer(XFER_NONE), num_srcs(0), width(4) {}
+	Instruction *inst;
+	short def;
+	short addr_reg, shared_reg;
+	bool partial;
+	bool global, shared;
+	bool store, shared_store;
+	unsigned char xfer;
+	unsigned char num_srcs;
+	unsigned char width;
+	AccessOperand srcs[3];
+};
+
+class MemAccess
+{
+	public:
+	MemAccess() : inst(0), block(0), store(false), width(4), pattern(ACCESS_SCATTERED), stride(0),
+		known_stride(false), transactions(WARP_THREADS), conflicts(UNKNOWN_CONFLICTS) {}
+	const Instruction *inst;
+	const BasicBlock *block;
+	bool store;
+	unsigned width;
+	AccessPattern pattern;
+	long stride;
+	bool known_stride;
+	// of a global access
+	unsigned transactions;
+	// the passes a shared access takes, 1 if free of conflicts
+	unsigned conflicts;
+};
+
+class Coalescing
+{
+	public:
+	Coalescing(const CFG *);
+	inline unsigned GetNumAccesses() const {return accesses.size();}
+	inline unsigned GetNumSharedAccesses() const {return shared_accesses.size();}
+	inline unsigned GetNumVisits() const {return num_visits;}
+	void Dump() const;
+	void DumpBanks() const;
+
+	static unsigned CountTransactions(long, unsigned);
+	static unsigned CountConflicts(long, unsigned);
+	static const char * PatternName(AccessPattern);
+
+	private:
+	void Solve();
+	void Apply(const AccessInst&, RegState&) const;
+	RegValue Evaluate(const AccessOperand&, const RegState&) const;
+	RegValue Address(short, const RegState&) const;
+	void Record(const AccessInst&, const BasicBlock *, const RegState&);
+	void RecordShared(const AccessInst&, const BasicBlock *, const RegState&);
+	void CollectLoops(const Loop *, vector<const Loop *>&) const;
+
+	static AccessInst Decode(Instruction *);
+
+	const CFG *cfg;
+	// scratch of the dataflow, released once the accesses are recorded:
+	// the blocks in reverse post-order, unreachable ones last
+	vector <const BasicBlock *> order;
+	map <const BasicBlock *, unsigned> index;
+	vector <RegState> block_in;
+	// the decoded instructions of every block, and where each block starts
+	vector <AccessInst> insts;
+	vector <unsigned> first;
+	unsigned num_regs;
+	unsigned num_reachable;
+	unsigned num_visits;
+	vector <MemAccess> accesses;
+	vector <MemAccess> shared_accesses;
+};
+
+#endif
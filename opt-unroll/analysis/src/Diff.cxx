@@ -0,0 +1,343 @@
+#include "Diff.h"
+#include "Parser.h"
+#include "Reader.h"
+#include "Emitter.h"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+using namespace std;
+
+void ProfileTask::Run()
+{
+	// the cycle model reports the loops as it goes; nobody reads that here
+	Emitter scratch;
+	SetOutput(&scratch);
+	try {
+		Reader rdr(file);
+		Parser parser(&rdr);
+		while (parser.HasMoreKernels()) {
+			parser.Reinit();
+			if (!parser.NextKernel()) break;
+			Kernel kernel(&parser);
+			kernel.SetNumWarps(nwarps);
+			kernel.SetUnrolled(unrolled);
+			kernel.Construct();
+			Profile(kernel, parser.GetKernelName());
+		}
+	} catch (IOException& ioe) {
+		failed = true;
+		message = "Input file not found";
+	} catch (exception& e) {
+		failed = true;
+		message = e.what();
+	} catch (...) {
+		failed = true;
+		message = "Driver aborted";
+	}
+	SetOutput(0);
+}
+
+static bool CompareHeaders(const Loop *a, const Loop *b)
+{
+	return a->GetHeader()->GetFirstInst()->GetLineNum() < b->GetHeader()->GetFirstInst()->GetLineNum();
+}
+
+void ProfileTask::Profile(const Kernel& kernel, const string& name)
+{
+	KernelSummary profile;
+	profile.name = name;
+	profile.counts = kernel.GetInstCounts();
+	profile.cycles = kernel.CountCycles(0);
+	profile.stall_cycles = kernel.GetCFG()->GetStallCycles();
+	const Liveness *liveness = kernel.GetLiveness();
+	profile.registers = liveness->GetMaxPressure();
+
+	const CFG *cfg = kernel.GetCFG();
+	if (cfg->HasLoops()) {
+		vector <const Loop *> outer(cfg->LoopsBegin(), cfg->LoopsEnd());
+		ProfileLoops(outer, "", liveness, profile);
+	}
+	kernels.push_back(profile);
+}
+
+// Profile the given siblings, and the loops nested in them, depth first
+void ProfileTask::ProfileLoops(const vector<const Loop *>& siblings, const string& prefix, const Liveness *liveness,
+															 KernelSummary& profile) const
+{
+	vector <const Loop *> sorted(siblings);
+	sort(sorted.begin(), sorted.end(), CompareHeaders);
+	for (unsigned i = 0; i < sorted.size(); ++i) {
+		const Loop *loop = sorted[i];
+		ostringstream position;
+		position << prefix << i;
+
+		LoopSummary lp;
+		lp.position = position.str();
+		lp.id = loop->Id();
+		lp.header = loop->GetHeader()->Id();
+		for (BBSetConstIter iter = loop->NatLoopBegin(); iter != loop->NatLoopEnd(); ++iter) {
+			const BasicBlock *bb = *iter;
+			for (const Instruction *inst = bb->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+				if (!inst->IsDeleted()) lp.counts.Add(inst);
+				if (inst == bb->GetLastInst()) break;
+			}
+		}
+		lp.iterations = loop->GetNumIters();
+		lp.registers = liveness->GetLoopPressure(loop);
+		lp.cycles = loop->GetCycles();
+		lp.stall_cycles = loop->GetStallCycles();
+		for (const Loop *l = loop->GetEnclosingLoop(); l != 0; l = l->GetEnclosingLoop()) {
+			lp.cycles *= l->GetNumIters();
+			lp.stall_cycles *= l->GetNumIters();
+		}
+		profile.loops.push_back(lp);
+
+		if (loop->HasInnerLoops()) {
+			vector <const Loop *> inner(loop->InnerLoopsBegin(), loop->InnerLoopsEnd());
+			ProfileLoops(inner, lp.position + ".", liveness, profile);
+		}
+	}
+}
+
+// "a -> b (+d)", with the change in percent if asked for
+static void Change(ostream& os, unsigned long long a, unsigned long long b, bool percent = false)
+{
+	os << a << " -> " << b;
+	if (a == b) return;
+	os << " (" << ((b > a) ? "+" : "-") << ((b > a) ? b - a : a - b);
+	if (percent && a != 0)
+		os << ", " << showpos << fixed << setprecision(1) << 100.0 * ((double) b - (double) a) / a << "%"
+			 << noshowpos;
+	os.unsetf(ios::floatfield);
+	os.precision(6);
+	os << ")";
+}
+
+static const char *mix_names[] = {"alu", "global", "shared", "local", "branch", "sync"};
+
+static void GetMix(const InstCounts& counts, unsigned long mix[6])
+{
+	mix[0] = counts.alu;
+	mix[1] = counts.global;
+	mix[2] = counts.shared;
+	mix[3] = counts.local;
+	mix[4] = counts.branch;
+	mix[5] = counts.sync;
+}
+
+// The changed parts of the instruction mix, as [alu +8, global +4]
+static void MixChange(ostream& os, const InstCounts& a, const InstCounts& b)
+{
+	unsigned long mix_a[6], mix_b[6];
+	GetMix(a, mix_a);
+	GetMix(b, mix_b);
+	bool first = true;
+	for (unsigned i = 0; i < 6; ++i) {
+		if (mix_a[i] == mix_b[i]) continue;
+		os << (first ? " [" : ", ") << mix_names[i] << " " << ((mix_b[i] > mix_a[i]) ? "+" : "-")
+			 << ((mix_b[i] > mix_a[i]) ? mix_b[i] - mix_a[i] : mix_a[i] - mix_b[i]);
+		first = false;
+	}
+	if (!first) os << "]";
+}
+
+static void FieldMix(Emitter& out, const InstCounts& counts)
+{
+	unsigned long mix[6];
+	GetMix(counts, mix);
+	out.Field("instructions", counts.GetTotal());
+	for (unsigned i = 0; i < 6; ++i)
+		out.Field(mix_names[i], mix[i]);
+}
+
+static void FieldDelta(Emitter& out, const string& key, unsigned long long a, unsigned long long b)
+{
+	out.Field(key, (double) b - (double) a);
+}
+
+static void DumpKernel(const KernelSummary& profile)
+{
+	Emitter& out = Out();
+	FieldMix(out, profile.counts);
+	out.Field("registers", profile.registers);
+	out.Field("cycles", profile.cycles);
+	out.Field("stall_cycles", profile.stall_cycles);
+}
+
+static void DumpLoop(const LoopSummary& profile)
+{
+	Emitter& out = Out();
+	out.Field("id", profile.id);
+	out.Field("header", profile.header);
+	FieldMix(out, profile.counts);
+	out.Field("iterations", profile.iterations);
+	out.Field("registers", profile.registers);
+	out.Field("cycles", profile.cycles);
+	out.Field("stall_cycles", profile.stall_cycles);
+}
+
+// The loops of a pair of matched kernels, those of the first kernel in
+// their order, then those only in the second
+static void DumpLoops(const KernelSummary& a, const KernelSummary& b, const string& file_a, const string& file_b)
+{
+	map <string, unsigned> in_b;
+	for (unsigned l = 0; l < b.loops.size(); ++l)
+		in_b[b.loops[l].position] = l;
+	vector < pair<const LoopSummary *, const LoopSummary *> > pairs;
+	for (unsigned l = 0; l < a.loops.size(); ++l) {
+		map<string, unsigned>::iterator iter = in_b.find(a.loops[l].position);
+		pairs.push_back(make_pair(&a.loops[l], (iter == in_b.end()) ? 0 : &b.loops[iter->second]));
+		if (iter != in_b.end()) in_b.erase(iter);
+	}
+	for (unsigned l = 0; l < b.loops.size(); ++l) {
+		if (in_b.count(b.loops[l].position)) pairs.push_back(make_pair((const LoopSummary *) 0, &b.loops[l]));
+	}
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginList("loops");
+		for (unsigned p = 0; p < pairs.size(); ++p) {
+			const LoopSummary *la = pairs[p].first, *lb = pairs[p].second;
+			out.BeginRecord();
+			out.Field("position", la ? la->position : lb->position);
+			out.Field("in", (la && lb) ? "both" : (la ? "old" : "new"));
+			if (la) {
+				out.BeginRecord("old");
+				DumpLoop(*la);
+				out.EndRecord();
+			}
+			if (lb) {
+				out.BeginRecord("new");
+				DumpLoop(*lb);
+				out.EndRecord();
+			}
+			if (la && lb) {
+				out.BeginRecord("delta");
+				FieldDelta(out, "instructions", la->counts.GetTotal(), lb->counts.GetTotal());
+				unsigned long mix_a[6], mix_b[6];
+				GetMix(la->counts, mix_a);
+				GetMix(lb->counts, mix_b);
+				for (unsigned i = 0; i < 6; ++i)
+					FieldDelta(out, mix_names[i], mix_a[i], mix_b[i]);
+				FieldDelta(out, "iterations", la->iterations, lb->iterations);
+				FieldDelta(out, "registers", la->registers, lb->registers);
+				FieldDelta(out, "cycles", la->cycles, lb->cycles);
+				FieldDelta(out, "stall_cycles", la->stall_cycles, lb->stall_cycles);
+				out.EndRecord();
+			}
+			out.EndRecord();
+		}
+		out.EndList();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	for (unsigned p = 0; p < pairs.size(); ++p) {
+		const LoopSummary *la = pairs[p].first, *lb = pairs[p].second;
+		const LoopSummary *either = la ? la : lb;
+		os << "\tLoop " << either->position;
+		if (!la || !lb) {
+			os << ": only in " << (la ? file_a : file_b) << " (loop " << either->id << ", bb " << either->header << ")\n";
+			continue;
+		}
+		os << " (loop " << la->id << ", bb " << la->header << " -> loop " << lb->id << ", bb " << lb->header << "): ";
+		os << "instructions ";
+		Change(os, la->counts.GetTotal(), lb->counts.GetTotal());
+		MixChange(os, la->counts, lb->counts);
+		os << ", iterations ";
+		Change(os, la->iterations, lb->iterations);
+		os << ", registers ";
+		Change(os, la->registers, lb->registers);
+		os << ", cycles ";
+		Change(os, la->cycles, lb->cycles, true);
+		os << ", stall cycles ";
+		Change(os, la->stall_cycles, lb->stall_cycles, true);
+		os << '\n';
+	}
+}
+
+// Report the kernels of the first build in their order, each next to the
+// kernel of the same name in the second build, then the kernels only found
+// in the second. Repeated names are matched in order
+void DumpDiff(const ProfileTask& a, const ProfileTask& b)
+{
+	const vector<KernelSummary>& ka = a.GetKernels();
+	const vector<KernelSummary>& kb = b.GetKernels();
+	vector <bool> matched(kb.size(), false);
+	vector < pair<const KernelSummary *, const KernelSummary *> > pairs;
+	for (unsigned k = 0; k < ka.size(); ++k) {
+		const KernelSummary *other = 0;
+		for (unsigned j = 0; j < kb.size() && other == 0; ++j) {
+			if (!matched[j] && kb[j].name == ka[k].name) {
+				matched[j] = true;
+				other = &kb[j];
+			}
+		}
+		pairs.push_back(make_pair(&ka[k], other));
+	}
+	for (unsigned j = 0; j < kb.size(); ++j) {
+		if (!matched[j]) pairs.push_back(make_pair((const KernelSummary *) 0, &kb[j]));
+	}
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("diff");
+		out.Field("old", a.GetFile());
+		out.Field("new", b.GetFile());
+		if (a.Failed()) out.Field("old_error", a.GetMessage());
+		if (b.Failed()) out.Field("new_error", b.GetMessage());
+		out.BeginList("kernels");
+		for (unsigned p = 0; p < pairs.size(); ++p) {
+			const KernelSummary *pa = pairs[p].first, *pb = pairs[p].second;
+			out.BeginRecord();
+			out.Field("kernel", pa ? pa->name : pb->name);
+			out.Field("in", (pa && pb) ? "both" : (pa ? "old" : "new"));
+			if (pa) {
+				out.BeginRecord("old");
+				DumpKernel(*pa);
+				out.EndRecord();
+			}
+			if (pb) {
+				out.BeginRecord("new");
+				DumpKernel(*pb);
+				out.EndRecord();
+			}
+			if (pa && pb) {
+				out.BeginRecord("delta");
+				FieldDelta(out, "instructions", pa->counts.GetTotal(), pb->counts.GetTotal());
+				FieldDelta(out, "registers", pa->registers, pb->registers);
+				FieldDelta(out, "cycles", pa->cycles, pb->cycles);
+				FieldDelta(out, "stall_cycles", pa->stall_cycles, pb->stall_cycles);
+				out.EndRecord();
+				DumpLoops(*pa, *pb, a.GetFile(), b.GetFile());
+			}
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << "Comparing " << a.GetFile() << " with " << b.GetFile() << '\n';
+	if (a.Failed()) os << "Analysis of " << a.GetFile() << " failed: " << a.GetMessage() << '\n';
+	if (b.Failed()) os << "Analysis of " << b.GetFile() << " failed: " << b.GetMessage() << '\n';
+	for (unsigned p = 0; p < pairs.size(); ++p) {
+		const KernelSummary *pa = pairs[p].first, *pb = pairs[p].second;
+		if (!pa || !pb) {
+			os << "Kernel " << (pa ? pa->name : pb->name) << ": only in " << (pa ? a.GetFile() : b.GetFile()) << '\n';
+			continue;
+		}
+		os << "Kernel " << pa->name << ": instructions ";
+		Change(os, pa->counts.GetTotal(), pb->counts.GetTotal());
+		MixChange(os, pa->counts, pb->counts);
+		os << ", registers ";
+		Change(os, pa->registers, pb->registers);
+		os << ", cycles ";
+		Change(os, pa->cycles, pb->cycles, true);
+		os << ", stall cycles ";
+		Change(os, pa->stall_cycles, pb->stall_cycles, true);
+		os << '\n';
+		DumpLoops(*pa, *pb, a.GetFile(), b.GetFile());
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef _DIFF_H_INCLUDED_
+#define _DIFF_H_INCLUDED_
+
+#include "Kernel.h"
+#include "ThreadPool.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+// Side by side comparison of two builds of the same kernels, such as the
+// rolled and the unrolled ptx. Each file is analyzed on a worker of its own
+// into a profile: the instruction mix, register pressure, cycles and stall
+// cycles of every kernel, and of every loop in it. The profiles are then
+// matched up and their differences reported.
+//
+// Kernels are matched by their .entry name. Loops are matched by their
+// position in the loop forest: the path of indices from the outer loop
+// down, siblings taken in the order of their headers in the ptx, so that
+// loop 1.0 is the first loop nested in the second outer loop of the kernel
+// in either file. Unrolling renumbers the blocks and loops but keeps the
+// nesting, so the loops at the same position are the same source loop.
+//
+// The cycles of a loop are what the cycle model charges for it over the
+// whole kernel, for every iteration of the loops around it. With -unrolled
+// the factors in ./.uconf divide the trip counts of the new build only;
+// the old one is taken to be the rolled build.
+
+class LoopSummary
+{
+	public:
+	LoopSummary() : id(0), header(0), iterations(0), registers(0), cycles(0), stall_cycles(0) {}
+	string position;
+	unsigned id, header;
+	InstCounts counts;
+	unsigned iterations;
+	unsigned registers;
+	unsigned long long cycles, stall_cycles;
+};
+
+class KernelSummary
+{
+	public:
+	KernelSummary() : registers(0), cycles(0), stall_cycles(0) {}
+	string name;
+	InstCounts counts;
+	unsigned registers;
+	unsigned long long cycles, stall_cycles;
+	// in the order of their positions
+	vector <LoopSummary> loops;
+};
+
+// Profile all the kernels of a file. Failures are kept in the task, like
+// those of the files in a batch
+class ProfileTask : public Task
+{
+	public:
+	ProfileTask(const string& f, unsigned short n, bool u) : file(f), nwarps(n), unrolled(u) {}
+	void Run();
+	inline const string& GetFile() const {return file;}
+	inline const vector<KernelSummary>& GetKernels() const {return kernels;}
+
+	private:
+	void Profile(const Kernel&, const string&);
+	void ProfileLoops(const vector<const Loop *>&, const string&, const Liveness *, KernelSummary&) const;
+
+	string file;
+	unsigned short nwarps;
+	bool unrolled;
+	vector <KernelSummary> kernels;
+};
+
+void DumpDiff(const ProfileTask&, const ProfileTask&);
+
+#endif
@@ -1,19 +1,220 @@
 #include "Driver.h"
+#include "Unroll.h"
+#include "ThreadPool.h"
+#include "Server.h"
+#include "Diff.h"
+#include "Watch.h"
 #include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <iomanip>
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
 
-// temporary flag to turn on experimental features
-bool exp_mode = false;
+extern __thread bool exp_mode;
 
 // The set of options that need to be supported by the analyzer
 // -counts : counts of various types of instructions in each kernel
+// -opcodes : histogram of the instructions in each kernel by opcode, type and state space
 // -ratios : ratio of low-latency ops to high-latency ops in each kernel
 // -loopinfo : information related to loops in each kernel
 // -loopcounts : instruction counts in various loop bodies
 // -loopratios : ratio of low-latency ops to high-latency ops in each kernel
+// -format=text|json|csv : how reports are written out
+// -dotcfg[=full|summary] : write the CFG of each kernel to <kernel>.dot
+// -dotfold : draw each loop nest in the .dot file as a single node
+// -stats : time spent and throughput of each analysis phase
+// -memstats : live and peak bytes and allocations by phase and category
+// -usearch : search for the best unroll factor of each loop and write the kernel's line of .uconf
+// -pressure : register pressure of each kernel and loop, and how unrolling grows it
+// -coalescing : address pattern and transactions per warp of each global access
+// -banks : bank conflicts of each shared access, and their replay cycles in each loop
+// -schedule : critical path and list-scheduled length of each block, and of unrolled loop bodies
+// -hoist : latency saved by hoisting each global load as early as its dependences allow
+// -diff : compare two builds of the same kernels, loop by loop, analyzing both at once
+// -timeout=<secs> : time budget for reading and analyzing each file
+// -threads=<n> : files analyzed at once, or threads parsing each kernel of a single file
+// -server : keep running and serve analysis requests on a Unix socket
+// -client : send the analysis to a running server, or run it in-process (see Driver::IsServable)
+// -socket=<path> : the socket used by -server and -client
+// -kernel=<name|regex> : only analyze the matching kernels, skipping the others unparsed
+// -kernelindex : keep the .entry offsets in <file>.kidx and seek to the selected kernels
+// -watch : report again every time the file changes, analyzing only the kernels that did
+// -dedup : analyze once the kernels that differ only in names, registers and labels
+
+static bool IsDirectory(const string& path)
+{
+	struct stat sb;
+	return (stat(path.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode));
+}
+
+static bool HasSuffix(const string& str, const string& suffix)
+{
+	return (str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+// Collect all the ptx files under a directory, recursively
+static void ExpandDirectory(const string& dir, vector<string>& files)
+{
+	DIR *dp = opendir(dir.c_str());
+	if (dp == 0) {
+		cerr << "Unable to open directory " << dir << ". Ignored..." << endl;
+		return;
+	}
+
+	vector<string> entries;
+	struct dirent *entry;
+	while ((entry = readdir(dp)) != 0) {
+		string name = entry->d_name;
+		if (name == "." || name == "..") continue;
+		entries.push_back(dir + "/" + name);
+	}
+	closedir(dp);
+
+	// keep the order of the report independent of the directory layout
+	sort(entries.begin(), entries.end());
+	for (unsigned i = 0; i < entries.size(); ++i) {
+		if (IsDirectory(entries[i]))
+			ExpandDirectory(entries[i], files);
+		else if (HasSuffix(entries[i], ".ptx"))
+			files.push_back(entries[i]);
+	}
+}
+
+// An input argument is either a ptx file, a directory of ptx files, a glob
+// pattern or @list, a file listing one input per line. Returns true if the
+// argument named anything other than a single file
+static bool ExpandInput(const string& arg, vector<string>& files)
+{
+	if (arg[0] == '@') {
+		ifstream list_file(arg.substr(1).c_str());
+		if (list_file.fail()) throw IOException();
+		string line;
+		while (getline(list_file, line)) {
+			if (line.empty() || line[0] == '#') continue;
+			ExpandInput(line, files);
+		}
+		return true;
+	}
+
+	if (IsDirectory(arg)) {
+		ExpandDirectory(arg, files);
+		return true;
+	}
+
+	if (arg.find_first_of("*?[") != arg.npos) {
+		glob_t matches;
+		if (glob(arg.c_str(), 0, 0, &matches) == 0) {
+			for (unsigned i = 0; i < matches.gl_pathc; ++i) {
+				string match = matches.gl_pathv[i];
+				if (IsDirectory(match)) ExpandDirectory(match, files);
+				else files.push_back(match);
+			}
+		}
+		else {
+			cerr << "No files match " << arg << ". Ignored..." << endl;
+		}
+		globfree(&matches);
+		return true;
+	}
+
+	files.push_back(arg);
+	return false;
+}
+
+// Apply a single analysis option (without the leading '-'). Returns
+// false for an option the analyzer does not know about
+bool Driver::ParseOption(const string& option)
+{
+	if (option == "counts") counts = 1;
+	else if (option == "ratios") ratios = 1;
+	else if (option == "opcodes") opcodes = 1;
+	else if (option == "loopinfo") loopinfo = 1;
+	else if (option == "loopcounts") loopcounts = 1;
+	else if (option == "loopratios") loopratios = 1;
+	else if (option == "dumpbb") dumpbb = 1;
+	else if (option == "dumpcfg") dumpcfg = 1;
+	else if (option == "dumpinst") dumpinst = 1;
+	else if (option == "dotcfg") dotcfg = 1;
+	else if (option.find("dotcfg=") == 0) {
+		const string& detail = option.substr(option.find_first_of("=") + 1);
+		dotcfg = 1;
+		if (detail == "summary") dotsummary = 1;
+		else if (detail == "full") dotsummary = 0;
+		else cerr << "Unknown CFG detail " << detail << ". Using full..." << endl;
+	}
+	else if (option == "dotfold") dotfold = 1;
+	else if (option == "cycles") cycles = 1;
+	else if (option == "loopcycles") loopcycles = 1;
+	else if (option == "unrolled") unrolled = 1;
+	else if (option == "exp") exp = 1;
+	else if (option == "usearch") usearch = 1;
+	else if (option == "pressure") pressure = 1;
+	else if (option == "coalescing") coalescing = 1;
+	else if (option == "banks") banks = 1;
+	else if (option == "schedule") schedule = 1;
+	else if (option == "hoist") hoist = 1;
+	else if (option == "dedup") dedup = 1;
+	else if (option == "diff") diff = 1;
+	else if (option == "kernelindex") kernelindex = 1;
+	else if (option.find("kernel=") == 0) {
+		kernel_pattern = option.substr(option.find_first_of("=") + 1);
+	}
+	else if (option == "stats" || option == "memstats") {
+#ifdef PTX_STATS
+		if (option == "stats") stats = 1;
+		else memstats = 1;
+#else
+		cerr << "Built without PTX_STATS, -" << option << " ignored..." << endl;
+#endif
+	}
+	else if (option.find("warps") == 0) {
+		unsigned idx = option.find_first_of("=");
+		Assert(idx != (unsigned) option.npos, "Invalid warp count option");
+		const string& wcount = option.substr(idx + 1, option.size() - idx);
+		nwarps = atoi(wcount.c_str());
+	}
+	else if (option.find("umax=") == 0) {
+		umax = atoi(option.substr(option.find_first_of("=") + 1).c_str());
+	}
+	else if (option.find("threads=") == 0) {
+		nthreads = atoi(option.substr(option.find_first_of("=") + 1).c_str());
+	}
+	else if (option.find("timeout=") == 0) {
+		time_budget = atof(option.substr(option.find_first_of("=") + 1).c_str());
+	}
+	else if (option.find("format=") == 0) {
+		const string& fmt = option.substr(option.find_first_of("=") + 1);
+		if (fmt == "json") format = FORMAT_JSON;
+		else if (fmt == "csv") format = FORMAT_CSV;
+		else if (fmt == "text") format = FORMAT_TEXT;
+		else cerr << "Unknown output format " << fmt << ". Using text..." << endl;
+	}
+	else return false;
+	return true;
+}
+
+// A driver for one request made to the analysis server: only the options
+// are set up, the server supplies the reader and collects the output.
+// Requests share the server process, so they are treated like batch
+// inputs - the unroll search stays on the worker
+Driver::Driver(const vector<string>& request_options)
+: reader(0), output(0), format(FORMAT_TEXT), batch(true), options(0), nwarps(32), nthreads(0),
+	umax(UnrollSearch::DEFAULT_MAX_FACTOR), time_budget(0)
+{
+	for (unsigned i = 0; i < request_options.size(); ++i) {
+		const string& option = request_options[i];
+		if (option.empty() || option[0] != '-' || !ParseOption(option.substr(1)))
+			cerr << "Unknown option " << option << " in request. Ignored..." << endl;
+	}
+}
 
 // Given the name of the ptx file, create the appropriate
 // reader, parser and kernel for analysis
-Driver::Driver(int argc, char **argv) throw (IOException) : options(0), nwarps(32), nthreads(0)
+Driver::Driver(int argc, char **argv) throw (IOException)
+: reader(0), output(0), format(FORMAT_TEXT), batch(false), options(0), nwarps(32), nthreads(0),
+	umax(UnrollSearch::DEFAULT_MAX_FACTOR), time_budget(0), socket_path(Server::DefaultSocketPath())
 {
 	if (argc < 2) {
 		PrintUsage();
@@ -22,117 +223,693 @@ Driver::Driver(int argc, char **argv) throw (IOException) : options(0), nwarps(3
 
 	// process command line options, ignorning argv[0]
 	// TODO: Replace this implementation with getopt
-	bool fname_processed = false;
-
 	for (int i = 1; i < argc; ++i) {
 		string option = argv[i];
-		if (option[0] == '-') {
+		// a lone - reads the ptx from stdin
+		if (option[0] == '-' && option != "-") {
 			option = argv[i] + 1;
-			if (option == "counts") counts = 1;
-			else if (option == "ratios") ratios = 1;
-			else if (option == "loopinfo") loopinfo = 1;
-			else if (option == "loopcounts") loopcounts = 1;
-			else if (option == "loopratios") loopratios = 1;
-			else if (option == "dumpbb") dumpbb = 1;
-			else if (option == "dumpcfg") dumpcfg = 1;
-			else if (option == "dumpinst") dumpinst = 1;
-			else if (option == "dotcfg") dotcfg = 1;
-			else if (option == "cycles") cycles = 1;
-			else if (option == "loopcycles") loopcycles = 1;
-			else if (option == "unrolled") unrolled = 1;
-			else if (option == "exp") exp_mode = true;
-			else if (option.find_first_of("warps") == 0) {
-				unsigned idx = option.find_first_of("=");
-				Assert(idx != (unsigned) option.npos, "Invalid warp count option");
-				const string& wcount = option.substr(idx + 1, option.size() - idx);
-				nwarps = atoi(wcount.c_str());
+			if (option == "server") server = 1;
+			else if (option == "client") client = 1;
+			else if (option == "watch") watch = 1;
+			else if (option.find("socket=") == 0) {
+				socket_path = option.substr(option.find_first_of("=") + 1);
 			}
 			else {
-				cout << "Unknown option " << option << ". Ignored..." << endl;
+				// everything else describes the analysis and is passed on to the server
+				forwarded.push_back(argv[i]);
+				if (!ParseOption(option))
+					cerr << "Unknown option " << option << ". Ignored..." << endl;
 			}
 		}
 		else {
-			Assert((fname_processed == false), "Multiple input files seen!");
-			fname_processed = true;
-			reader = new Reader(option);
-			parser = new Parser(reader);
+			if (ExpandInput(option, inputs)) batch = true;
 		}
 	}
-	if (!fname_processed) {
+	if (server) {
+		output = Emitter::Create(format);
+		SetOutput(output);
+		return;
+	}
+	if (inputs.empty()) {
 		PrintUsage();
 		exit(-1);
 	}
+	if (inputs.size() > 1) batch = true;
+
+	// A single input is opened right away so that a missing file is reported as before
+	if (!batch)
+		reader = new Reader(inputs[0]);
+
+	output = Emitter::Create(format);
+	SetOutput(output);
 }
 
 Driver::~Driver()
 {
 	delete reader;
-	delete parser;
+	SetOutput(0);
+	delete output;
 }
 
 // This is where all the action begins
-void Driver::Execute() throw()
+void Driver::Execute()
 {
-	while (parser->HasMoreKernels()) {
-		parser->Reinit();
-		// build the kernel
-		kernel = new Kernel(parser);
+	if (server) {
+		Server srv(socket_path, nthreads);
+		srv.Run();
+		return;
+	}
 
-		kernel->SetNumWarps(nwarps);
+	if (client && !batch && IsServable()) {
+		// stdin can only be read once, so it is kept for the work done here
+		// if the server cannot be reached or goes away mid-request
+		string ptx;
+		if (inputs[0] == "-") {
+			ostringstream contents;
+			contents << cin.rdbuf();
+			ptx = contents.str();
+		}
+		string reply;
+		if (Server::Request(socket_path, forwarded, inputs[0], ptx, reply)) {
+			cout.write(reply.data(), reply.size());
+			cout.flush();
+			Assert(cout.good(), "Unable to write the reply of the server");
+			return;
+		}
+		// no server around, do the work ourselves
+		if (inputs[0] == "-") {
+			delete reader;
+			reader = new Reader(inputs[0], new istringstream(ptx));
+		}
+	}
 
-		kernel->Construct();
-		kernel->BuildCFG(unrolled);
+	if (diff) {
+		ExecuteDiff();
+		return;
+	}
+
+	if (watch) {
+		if (batch || inputs[0] == "-") {
+			cerr << "-watch takes a single ptx file" << endl;
+			return;
+		}
+		Watcher watcher(this, inputs[0], format);
+		watcher.Run();
+		return;
+	}
+
+	if (batch) {
+		ExecuteBatch();
+		return;
+	}
 
-		if (counts)
-			kernel->DumpInstCounts();
+	FileSummary summary(inputs[0]);
+	if (time_budget > 0)
+		SetDeadline(WallTime() + time_budget);
+	Analyze(reader, output, &cout, summary);
+}
 
-		if (ratios)
-			kernel->DumpRatios();
+// The .dot file for a kernel is named after its .entry. Inputs analyzed
+// side by side often share kernel names, so in batch mode the name of the
+// input file is prepended; repeated names get a numeric suffix
+string Driver::DotFileName(const string& file, const string& kernel_name, map<string, unsigned>& seen) const
+{
+	string name;
+	if (batch) {
+		size_t slash = file.find_last_of('/');
+		name = (slash == file.npos) ? file : file.substr(slash + 1);
+		if (HasSuffix(name, ".ptx"))
+			name.erase(name.size() - 4);
+		name += ".";
+	}
+	name += kernel_name.empty() ? "kernel" : kernel_name;
+	for (unsigned i = 0; i < name.size(); ++i) {
+		char c = name[i];
+		if (!(isalnum(c) || c == '_' || c == '-' || c == '.'))
+			name[i] = '_';
+	}
+
+	unsigned count = seen[name]++;
+	if (count > 0) {
+		ostringstream suffix;
+		suffix << "." << count;
+		name += suffix.str();
+	}
+	return name + ".dot";
+}
 
-		if (loopratios)
-			kernel->DumpLoopRatios();
+// Analyze all the kernels supplied by the reader, writing the reports to the
+// given emitter. If a sink is given, the emitter is flushed to it once per
+// kernel; otherwise the output stays buffered for the caller
+void Driver::Analyze(Reader *rdr, Emitter *out, ostream *sink, FileSummary& summary) const
+{
+	Parser parser(rdr);
+	Kernel *kernel = 0;
+	unsigned long ninstrs = 0, nblocks = 0;
+	map<string, unsigned> dot_names;
+	PhaseStats kernel_stats;
+	MemStats mem_stats;
+	unsigned last_line = 0;
+	// the bodies seen in the module, by their fingerprint, for -dedup
+	multimap<unsigned long long, KernelBody> bodies;
 
-		if (loopinfo)
-			kernel->DumpLoopInfo();
+	// Selecting kernels needs no parsing of the others. The index is only
+	// kept for files on disk, not for ptx sent to the server
+	KernelSelector selector(kernel_pattern);
+	KernelIndex index;
+	bool indexed = false;
+	if (kernelindex && rdr->IsFile()) {
+		if (!index.Load(rdr->GetFileName())) {
+			index.Build(rdr->GetFileName());
+			if (!index.Save())
+				cerr << "Unable to write " << KernelIndex::IndexFileName(rdr->GetFileName()) << endl;
+		}
+		indexed = true;
+	}
+	parser.Select(&selector, indexed ? &index : 0);
 
-		if (loopcounts)
-			kernel->DumpLoopInstCounts();
+	bool streaming = IsStreaming();
 
-		if (dumpinst)
-			kernel->DumpInstructionStream();
+	exp_mode = exp;
+	SetOutput(out);
+	out->BeginModule(summary.file);
+	if (stats) SetStats(&kernel_stats);
+	if (memstats) SetMemStats(&mem_stats);
 
-		if (dumpcfg)
-			kernel->DumpCFG();
+	try {
+		while (parser.HasMoreKernels()) {
+			parser.Reinit();
+			if (!parser.NextKernel()) break;
 
-		if (dumpbb)
-			kernel->DumpBBs();
+			unsigned long long instrs_before = summary.instructions, blocks_before = summary.blocks;
+			if (streaming) {
+				CountKernel(parser, out, summary);
+			}
+			else if (dedup) {
+				kernel = BuildKernel(parser);
+				// a fingerprint match is only an alias if the bodies are the same,
+				// and under -unrolled if the kernels have the same .uconf line
+				string body = kernel->CanonicalBody();
+				if (unrolled) {
+					vector<unsigned> factors;
+					ostringstream uconf;
+					uconf << "uconf";
+					if (ReadUconf("./.uconf", parser.GetKernelName(), factors))
+						for (unsigned i = 0; i < factors.size(); ++i)
+							uconf << " " << factors[i];
+					body += uconf.str() + '\n';
+				}
+				unsigned long long key = Fingerprint(body);
+				typedef multimap<unsigned long long, KernelBody>::const_iterator BodyIter;
+				pair<BodyIter, BodyIter> same = bodies.equal_range(key);
+				BodyIter seen = same.first;
+				while (seen != same.second && seen->second.body != body) ++seen;
+				if (seen != same.second) {
+					ReportAlias(kernel, parser.GetKernelName(), seen->second, out, dot_names, summary);
+				}
+				else {
+					unsigned long long loops_before = summary.loops, cycles_before = summary.cycles;
+					Report(kernel, parser.GetKernelName(), out, dot_names, summary);
+					KernelBody& first = bodies.insert(pair<unsigned long long, KernelBody>(key, KernelBody()))->second;
+					first.kernel = parser.GetKernelName();
+					first.body = body;
+					first.instructions = summary.instructions - instrs_before;
+					first.blocks = summary.blocks - blocks_before;
+					first.loops = summary.loops - loops_before;
+					first.cycles = summary.cycles - cycles_before;
+				}
+			}
+			else {
+				kernel = BuildKernel(parser);
+				Report(kernel, parser.GetKernelName(), out, dot_names, summary);
+			}
+			ninstrs = summary.instructions - instrs_before;
+			nblocks = summary.blocks - blocks_before;
 
-		if (cycles)
-			kernel->DumpCycles(0);
+			if (stats) {
+				kernel_stats.Checkpoint();
+				kernel_stats.kernels = 1;
+				kernel_stats.lines = rdr->GetLineNum() - last_line;
+				kernel_stats.instructions = ninstrs;
+				kernel_stats.blocks = nblocks;
+				last_line = rdr->GetLineNum();
+				kernel_stats.Dump("stats", "Phase statistics");
+				summary.stats.Add(kernel_stats);
+				// the time spent reporting is not charged to the next kernel
+				kernel_stats.Clear();
+				kernel_stats.Start();
+			}
 
-		if (loopcycles)
-			kernel->DumpLoopCycles(0);
+			// taken before the kernel goes away, so that its footprint shows
+			if (memstats)
+				mem_stats.Dump("memstats", "Memory statistics", false, ninstrs, nblocks);
 
-		if (dotcfg)
-			DumpCFGToDot(kernel->GetCFG());
+			// one write per kernel instead of a flush per line
+			out->EndKernel();
+			if (sink) out->Flush(*sink);
 
+			delete kernel;
+			kernel = 0;
+			if (memstats) mem_stats.StartKernel();
+		}
+	} catch (...) {
+		SetStats(0);
+		SetMemStats(0);
 		delete kernel;
+		throw;
+	}
+
+	if (!selector.IsEmpty() && summary.kernels == 0)
+		cerr << "No kernel matches " << kernel_pattern << " in " << summary.file << endl;
+
+	out->EndKernels();
+	if (dedup && !streaming) {
+		if (out->IsStructured()) {
+			out->BeginRecord("dedup");
+			out->Field("kernels", (unsigned long long) summary.kernels);
+			out->Field("distinct", (unsigned long long) bodies.size());
+			out->EndRecord();
+		}
+		else {
+			out->Stream() << "Distinct kernel bodies: " << bodies.size() << " of " << summary.kernels << " kernels" << '\n';
+		}
+	}
+	if (stats) {
+		// whatever was read after the last kernel
+		kernel_stats.Checkpoint();
+		kernel_stats.lines = rdr->GetLineNum() - last_line;
+		summary.stats.Add(kernel_stats);
+		SetStats(0);
+		// a single kernel has had its statistics reported already
+		if (out->IsStructured() || summary.kernels != 1)
+			summary.stats.Dump("stats", "Phase statistics for " + summary.file);
 	}
+	if (memstats) {
+		SetMemStats(0);
+		if (out->IsStructured() || summary.kernels != 1)
+			mem_stats.Dump("memstats", "Memory statistics for " + summary.file, true, summary.instructions, summary.blocks);
+	}
+	out->EndModule();
+	if (sink) out->Flush(*sink);
+}
+
+// A kernel with the body of one reported before in the module is reported
+// as its alias, and adds to the summary what that kernel did. Its CFG is
+// still written for -dotcfg, under its own name
+void Driver::ReportAlias(const Kernel *kernel, const string& name, const KernelBody& body, Emitter *out,
+										map<string, unsigned>& dot_names, FileSummary& summary) const
+{
+	out->BeginKernel(name);
+	if (out->IsStructured())
+		out->Field("alias_of", body.kernel);
+	else
+		out->Stream() << "Same body as kernel " << body.kernel << ", not analyzed again" << '\n';
+
+	if (dotcfg)
+		WriteDot(kernel, name, out, dot_names, summary);
+
+	++summary.kernels;
+	summary.instructions += body.instructions;
+	summary.blocks += body.blocks;
+	summary.loops += body.loops;
+	summary.cycles += body.cycles;
+}
+
+// Counts, ratios and opcodes need neither a kernel nor a CFG. When nothing else
+// is asked for, the kernels are counted as they are read, in constant memory
+bool Driver::IsStreaming() const
+{
+	return !(cycles || loopinfo || loopcounts || loopratios || loopcycles || dumpbb
+					 || dumpcfg || dumpinst || dotcfg || usearch || pressure || coalescing
+					 || banks || schedule || hoist);
+}
+
+// Fold the lines of the kernel the parser is at into the counters as they
+// are read, and report them
+void Driver::CountKernel(Parser& parser, Emitter *out, FileSummary& summary) const
+{
+	InstCounts inst_counts;
+	OpcodeHistogram histogram;
+	parser.CountKernel(inst_counts, opcodes ? &histogram : 0);
+	out->BeginKernel(parser.GetKernelName());
+	if (counts)
+		DumpCounts(inst_counts, DUMP_COUNTS, "");
+	if (opcodes)
+		DumpOpcodes(histogram);
+	if (ratios)
+		DumpCounts(inst_counts, DUMP_RATIOS, "");
+	++summary.kernels;
+	summary.instructions += inst_counts.GetTotal();
+}
+
+// Build the kernel the parser is at
+Kernel * Driver::BuildKernel(Parser& parser) const
+{
+	Kernel *kernel = new Kernel(&parser);
+
+	kernel->SetNumWarps(nwarps);
+	kernel->SetUnrolled(unrolled);
+	// files analyzed side by side have the cpus already
+	kernel->SetParseThreads(batch ? 1 : nthreads);
+
+	try {
+		// the reports below compute only the analyses they need
+		kernel->Construct();
+	} catch (...) {
+		delete kernel;
+		throw;
+	}
+	return kernel;
+}
+
+// Write the CFG of a kernel to its .dot file for -dotcfg
+void Driver::WriteDot(const Kernel *kernel, const string& name, Emitter *out, map<string, unsigned>& dot_names,
+										const FileSummary& summary) const
+{
+	kernel->Require(ANALYSIS_LOOPS);
+	const string& dot_path = DotFileName(summary.file, name, dot_names);
+	DumpCFGToDot(kernel->GetCFG(), dot_path, dotsummary ? DOT_SUMMARY : DOT_FULL, dotfold);
+	if (out->IsStructured())
+		out->Field("dotcfg", dot_path);
+	else
+		out->Stream() << "CFG written to " << dot_path << '\n';
+}
+
+// Write the reports asked for on a kernel to the given emitter, which has
+// to be the current output, up to its EndKernel()
+void Driver::Report(const Kernel *kernel, const string& name, Emitter *out, map<string, unsigned>& dot_names,
+										FileSummary& summary) const
+{
+	out->BeginKernel(name);
+
+	if (counts)
+		kernel->DumpInstCounts();
+
+	if (opcodes)
+		kernel->DumpOpcodes();
+
+	if (ratios)
+		kernel->DumpRatios();
+
+	if (loopratios)
+		kernel->DumpLoopRatios();
+
+	if (loopinfo)
+		kernel->DumpLoopInfo();
+
+	if (loopcounts)
+		kernel->DumpLoopInstCounts();
+
+	if (dumpinst)
+		kernel->DumpInstructionStream();
+
+	if (dumpcfg)
+		kernel->DumpCFG();
+
+	if (dumpbb)
+		kernel->DumpBBs();
+
+	if (cycles)
+		summary.cycles += kernel->DumpCycles(0);
+
+	if (loopcycles)
+		kernel->DumpLoopCycles(0);
+
+	if (pressure)
+		kernel->DumpPressure(umax);
+
+	if (coalescing)
+		kernel->DumpCoalescing();
+
+	if (banks)
+		kernel->DumpBankConflicts();
+
+	if (schedule)
+		kernel->DumpSchedule(umax);
+
+	if (hoist)
+		kernel->DumpHoisting();
+
+	if (dotcfg)
+		WriteDot(kernel, name, out, dot_names, summary);
+
+	if (usearch) {
+		if (unrolled)
+			cerr << "Warning: -usearch expects a rolled kernel, .uconf factors already applied" << endl;
+		kernel->Require(ANALYSIS_LOOPS);
+		kernel->Require(ANALYSIS_COALESCING);
+		UnrollSearch search(kernel->GetCFG(), nwarps, umax, batch ? 1 : nthreads);
+		search.Run();
+		search.DumpRanking();
+		// files analyzed side by side would overwrite each other's .uconf
+		if (!batch && search.WriteUconf("./.uconf", name) && !out->IsStructured())
+			out->Stream() << "Best unroll configuration written to ./.uconf" << '\n';
+	}
+
+	++summary.kernels;
+	summary.instructions += kernel->GetNumInstrs();
+	summary.blocks += kernel->GetNumBlocks();
+	summary.loops += kernel->GetNumLoops();
+}
+
+// A unit of work for batch mode: analyze one file into a private emitter.
+// Any failure is confined to the file and recorded in its summary
+class BatchTask : public Task
+{
+	public:
+	BatchTask(const Driver *d, const string& f, OutputFormat fmt, double budget)
+	: driver(d), summary(f), output(Emitter::Create(fmt, true)), time_budget(budget) {}
+	~BatchTask() {delete output;}
+
+	void Run()
+	{
+		double start = WallTime();
+		try {
+			if (time_budget > 0)
+				SetDeadline(start + time_budget);
+			Reader rdr(summary.file);
+			driver->Analyze(&rdr, output, 0, summary);
+		} catch (IOException& ioe) {
+			summary.status = STATUS_FAILED;
+			summary.message = "Input file not found";
+		} catch (TimeoutException& te) {
+			summary.status = STATUS_TIMEOUT;
+			summary.message = te.what();
+		} catch (exception& e) {
+			summary.status = STATUS_FAILED;
+			summary.message = e.what();
+		} catch (...) {
+			summary.status = STATUS_FAILED;
+			summary.message = "Driver aborted";
+		}
+		SetOutput(0);
+		SetDeadline(0);
+		summary.msecs = (WallTime() - start) * 1000;
+	}
+
+	const Driver *driver;
+	FileSummary summary;
+	Emitter *output;
+	double time_budget;
+};
+
+// Analyze every input on a pool of workers, then write out the per-file
+// reports in input order followed by the aggregated summary
+void Driver::ExecuteBatch()
+{
+	double start = WallTime();
+	vector<BatchTask *> tasks;
+	{
+		ThreadPool pool(nthreads);
+		for (unsigned i = 0; i < inputs.size(); ++i) {
+			BatchTask *task = new BatchTask(this, inputs[i], format, time_budget);
+			tasks.push_back(task);
+			pool.Submit(task);
+		}
+		pool.Wait();
+	}
+	SetOutput(output);
+
+	vector<FileSummary> summaries;
+	output->BeginBatch();
+	output->BeginList("files");
+	for (unsigned i = 0; i < tasks.size(); ++i) {
+		BatchTask *task = tasks[i];
+		const FileSummary& summary = task->summary;
+
+		if (!output->IsStructured())
+			output->Stream() << "==> " << summary.file << " <==" << '\n';
+
+		// a failed file may have left unbalanced structured output behind
+		if (summary.status == STATUS_OK || !output->IsStructured())
+			output->Embed(task->output->GetBuffer());
+
+		if (summary.status != STATUS_OK) {
+			if (output->IsStructured()) {
+				output->BeginRecord();
+				output->Field("file", summary.file);
+				output->Field("status", (summary.status == STATUS_TIMEOUT) ? "timeout" : "failed");
+				output->Field("error", summary.message);
+				output->EndRecord();
+			}
+			else
+				output->Stream() << "Analysis failed: " << summary.message << '\n';
+		}
+		if (!output->IsStructured())
+			output->Stream() << '\n';
+
+		// hand over the reports of each file as soon as it is placed
+		output->Flush(cout);
+		summaries.push_back(summary);
+		delete task;
+	}
+	output->EndList();
+
+	DumpBatchSummary(summaries, WallTime() - start);
+	output->EndBatch();
+	output->Flush(cout);
+}
+
+// Profile the two builds side by side, then report how they differ
+void Driver::ExecuteDiff()
+{
+	if (inputs.size() != 2) {
+		cerr << "-diff takes exactly two ptx files" << endl;
+		return;
+	}
+	// the unroll factors in ./.uconf are keyed by kernel name, which both
+	// builds share, so -unrolled applies them to the new build only
+	ProfileTask old_build(inputs[0], nwarps, false), new_build(inputs[1], nwarps, unrolled);
+	{
+		ThreadPool pool(2);
+		pool.Submit(&old_build);
+		pool.Submit(&new_build);
+		pool.Wait();
+	}
+	SetOutput(output);
+
+	output->BeginBatch();
+	DumpDiff(old_build, new_build);
+	output->EndBatch();
+	output->Flush(cout);
+}
+
+static const char * StatusString(AnalysisStatus status)
+{
+	switch (status) {
+		case STATUS_OK: return "ok";
+		case STATUS_TIMEOUT: return "timeout";
+		case STATUS_FAILED:
+		default: return "failed";
+	}
+}
+
+// The aggregated report: one line per file and the totals over all files
+void Driver::DumpBatchSummary(const vector<FileSummary>& summaries, double secs) const
+{
+	FileSummary total("Total");
+	unsigned failed = 0, timed_out = 0;
+	PhaseStats total_stats;
+	for (unsigned i = 0; i < summaries.size(); ++i) {
+		const FileSummary& summary = summaries[i];
+		if (summary.status == STATUS_FAILED) ++failed;
+		if (summary.status == STATUS_TIMEOUT) ++timed_out;
+		total.kernels += summary.kernels;
+		total.instructions += summary.instructions;
+		total.blocks += summary.blocks;
+		total.loops += summary.loops;
+		total.cycles += summary.cycles;
+		total.msecs += summary.msecs;
+		total_stats.Add(summary.stats);
+	}
+
+	if (output->IsStructured()) {
+		output->BeginRecord("summary");
+		output->Field("files", (unsigned) summaries.size());
+		output->Field("ok", (unsigned) (summaries.size() - failed - timed_out));
+		output->Field("failed", failed);
+		output->Field("timed_out", timed_out);
+		output->Field("kernels", total.kernels);
+		output->Field("instructions", total.instructions);
+		output->Field("blocks", total.blocks);
+		output->Field("loops", total.loops);
+		if (cycles) output->Field("cycles", total.cycles);
+		output->Field("wall_seconds", secs);
+		output->BeginList("per_file");
+		for (unsigned i = 0; i < summaries.size(); ++i) {
+			const FileSummary& summary = summaries[i];
+			output->BeginRecord();
+			output->Field("file", summary.file);
+			output->Field("status", StatusString(summary.status));
+			output->Field("kernels", summary.kernels);
+			output->Field("instructions", summary.instructions);
+			output->Field("blocks", summary.blocks);
+			output->Field("loops", summary.loops);
+			if (cycles) output->Field("cycles", summary.cycles);
+			output->Field("msecs", summary.msecs);
+			output->EndRecord();
+		}
+		output->EndList();
+		if (stats) total_stats.Dump("stats", "Phase statistics for all files");
+		output->EndRecord();
+		return;
+	}
+
+	ostream& os = output->Stream();
+	os << "Batch summary: " << summaries.size() << " file(s), " << (summaries.size() - failed - timed_out)
+		 << " ok, " << failed << " failed, " << timed_out << " timed out" << '\n';
+	os << left << setw(40) << "File" << right << setw(9) << "Status" << setw(9) << "Kernels"
+		 << setw(14) << "Instructions" << setw(9) << "Blocks" << setw(7) << "Loops";
+	if (cycles) os << setw(16) << "Cycles";
+	os << setw(12) << "Time (ms)" << '\n';
+	for (unsigned i = 0; i <= summaries.size(); ++i) {
+		const FileSummary& summary = (i < summaries.size()) ? summaries[i] : total;
+		os << left << setw(40) << summary.file << right
+			 << setw(9) << ((i < summaries.size()) ? StatusString(summary.status) : "")
+			 << setw(9) << summary.kernels << setw(14) << summary.instructions
+			 << setw(9) << summary.blocks << setw(7) << summary.loops;
+		if (cycles) os << setw(16) << summary.cycles;
+		os << setw(12) << fixed << setprecision(1) << summary.msecs << '\n';
+		os.unsetf(ios::floatfield);
+	}
+	os << "Wall time: " << fixed << setprecision(3) << secs << " s" << '\n';
+	os.unsetf(ios::floatfield);
+	os.precision(6);
+	if (stats) total_stats.Dump("stats", "Phase statistics for all files");
 }
 
 void Driver::PrintUsage() const
 {
-	cout << "Usage: ptx-analyze [options] ptx-file" << endl;
+	cout << "Usage: ptx-analyze [options] ptx-file|directory|glob|@list|- ..." << endl;
+	cout << "ptx files may be gzip or zstd compressed, - reads from stdin" << endl;
 	cout << "where options is one or more of: " << endl;
 	cout << " -counts" << endl;
+	cout << " -opcodes" << endl;
 	cout << " -ratios" << endl;
 	cout << " -loopinfo" << endl;
 	cout << " -loopratios" << endl;
 	cout << " -loopcounts" << endl;
 	cout << " -dumpinst" << endl;
 	cout << " -dumpcfg" << endl;
-	cout << " -dotcfg" << endl;
+	cout << " -dotcfg[=full|summary] (with -dotfold to fold loop nests)" << endl;
 	cout << " -cycles" << endl;
+	cout << " -format=text|json|csv" << endl;
+	cout << " -usearch (with -umax=<max factor>, -threads=<n>)" << endl;
+	cout << " -pressure (with -umax=<max factor>)" << endl;
+	cout << " -coalescing" << endl;
+	cout << " -banks" << endl;
+	cout << " -schedule (with -umax=<max factor>)" << endl;
+	cout << " -hoist" << endl;
+	cout << " -diff old-ptx-file new-ptx-file (-unrolled applies to the new file)" << endl;
+	cout << " -timeout=<secs> (per file)" << endl;
+	cout << " -threads=<n> (files analyzed at once, or threads parsing each kernel of a single file)" << endl;
+	cout << " -stats" << endl;
+	cout << " -memstats" << endl;
+	cout << " -kernel=<name|regex> (with -kernelindex to keep an index of kernel offsets)" << endl;
+	cout << " -server (with -socket=<path>, -threads=<n>)" << endl;
+	cout << " -client (with -socket=<path>)" << endl;
+	cout << " -watch (a single ptx file)" << endl;
+	cout << " -dedup (with analyses that build the CFG)" << endl;
 }
 
 // The entry point for the analyzer program
@@ -145,6 +922,16 @@ int main(int argc, char **argv)
 		cout << "Input file not found" << endl;
 		exit(-1);
 	}
+	catch (AnalysisException& ae) {
+		cerr << ae.what() << endl;
+		cout << "Driver aborted" << endl;
+		exit(-1);
+	}
+	catch (TimeoutException& te) {
+		cerr << te.what() << endl;
+		cout << "Driver aborted" << endl;
+		exit(-1);
+	}
 	catch (...) {
 		cout << "Driver aborted" << endl;
 		exit(-1);
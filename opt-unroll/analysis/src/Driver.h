@@ -5,6 +5,45 @@
 #include "Kernel.h"
 #include "Reader.h"
 #include "Parser.h"
+#include "Emitter.h"
+#include "Stats.h"
+
+#include <string>
+#include <vector>
+#include <map>
+using namespace std;
+
+typedef enum {STATUS_OK, STATUS_FAILED, STATUS_TIMEOUT} AnalysisStatus;
+
+// What the analysis of one input file amounted to. In batch mode these
+// are collected for every file and summed up in the aggregated report
+class FileSummary
+{
+	public:
+	FileSummary(const string& f = "")
+	: file(f), status(STATUS_OK), kernels(0), instructions(0), blocks(0), loops(0), cycles(0), msecs(0) {}
+
+	string file;
+	AnalysisStatus status;
+	string message;
+	unsigned kernels;
+	unsigned long long instructions, blocks, loops, cycles;
+	double msecs;
+	PhaseStats stats;
+};
+
+// The first kernel of a module with a given body, and what it added to the
+// summary, for -dedup
+class KernelBody
+{
+	public:
+	KernelBody() : instructions(0), blocks(0), loops(0), cycles(0) {}
+
+	string kernel;
+	// the canonical body, to tell apart bodies whose fingerprints collide
+	string body;
+	unsigned long long instructions, blocks, loops, cycles;
+};
 
 // This is the driver program that is responsible for creating
 // the appropriate high-level structures and starting off the
@@ -14,14 +53,39 @@ class Driver
 {
 	public:
 	Driver(int, char **) throw (IOException);
+	Driver(const vector<string>&);
 	~Driver();
 	void PrintUsage() const;
-	void Execute() throw();
+	void Execute();
+	void Analyze(Reader *, Emitter *, ostream *, FileSummary&) const;
+	// The steps of Analyze() for a single kernel, for -watch
+	bool IsStreaming() const;
+	void CountKernel(Parser&, Emitter *, FileSummary&) const;
+	Kernel * BuildKernel(Parser&) const;
+	void Report(const Kernel *, const string&, Emitter *, map<string, unsigned>&, FileSummary&) const;
+	inline OutputFormat GetFormat() const {return format;}
+	inline double GetTimeBudget() const {return time_budget;}
+	inline const string& GetKernelPattern() const {return kernel_pattern;}
+	// -unrolled reads ./.uconf, -usearch writes it and -dotcfg writes a
+	// <kernel>.dot per kernel (see DotFileName), all in the current
+	// directory of the client, so a client runs those itself rather than
+	// sending them to the server
+	inline bool IsServable() const {return !(unrolled || usearch || dotcfg);}
 
 	private:
-	Kernel *kernel;
+	bool ParseOption(const string&);
+	string DotFileName(const string&, const string&, map<string, unsigned>&) const;
+	void ExecuteBatch();
+	void ExecuteDiff();
+	void DumpBatchSummary(const vector<FileSummary>&, double) const;
+	void WriteDot(const Kernel *, const string&, Emitter *, map<string, unsigned>&, const FileSummary&) const;
+	void ReportAlias(const Kernel *, const string&, const KernelBody&, Emitter *, map<string, unsigned>&, FileSummary&) const;
+
 	Reader *reader;
-	Parser *parser;
+	Emitter *output;
+	OutputFormat format;
+	vector <string> inputs;
+	bool batch;
 
 	// command line options
 	union {
@@ -38,12 +102,35 @@ class Driver
 			unsigned dumpinst:1;
 			unsigned dotcfg:1;
 			unsigned unrolled:1;
-			unsigned reserved:21;
+			unsigned usearch:1;
+			unsigned exp:1;
+			unsigned server:1;
+			unsigned client:1;
+			unsigned dotsummary:1;
+			unsigned dotfold:1;
+			unsigned stats:1;
+			unsigned memstats:1;
+			unsigned kernelindex:1;
+			unsigned pressure:1;
+			unsigned coalescing:1;
+			unsigned banks:1;
+			unsigned schedule:1;
+			unsigned hoist:1;
+			unsigned diff:1;
+			unsigned opcodes:1;
+			unsigned watch:1;
+			unsigned dedup:1;
+			unsigned reserved:2;
 		};
 		unsigned int options; /* Support for 32 options, enough for now */
 	};
 	unsigned short nwarps;
 	unsigned nthreads;
+	unsigned umax;
+	double time_budget;
+	string socket_path;
+	string kernel_pattern;
+	vector <string> forwarded;
 };
 
 #endif
@@ -0,0 +1,365 @@
+#include "Emitter.h"
+#include "Utils.h"
+#include <sstream>
+#include <cmath>
+using namespace std;
+
+OutputBuffer::int_type OutputBuffer::overflow(int_type c)
+{
+	if (c != traits_type::eof())
+		data.push_back(traits_type::to_char_type(c));
+	return c;
+}
+
+streamsize OutputBuffer::xsputn(const char *s, streamsize n)
+{
+	data.append(s, n);
+	return n;
+}
+
+Emitter::Emitter() : buffer(), stream(&buffer) {}
+
+// Text output keeps the traditional kernel banner
+void Emitter::BeginKernel(const string& name)
+{
+	if (name.empty()) return;
+	stream << "Processing kernel: " << name << '\n';
+	stream << "----------------------------------" << '\n';
+}
+
+// Hand everything collected so far to the given stream in one go
+void Emitter::Flush(ostream& os)
+{
+	const string& data = buffer.GetData();
+	if (!data.empty())
+		os.write(data.data(), data.size());
+	os.flush();
+	buffer.Clear();
+}
+
+// Splice in the output collected by another emitter of the same format
+void Emitter::Embed(const string& data)
+{
+	stream << data;
+}
+
+Emitter * Emitter::Create(OutputFormat format, bool embedded)
+{
+	switch (format) {
+		case FORMAT_JSON:
+			return new JsonEmitter();
+		case FORMAT_CSV:
+			return new CsvEmitter(embedded);
+		case FORMAT_TEXT:
+		default:
+			return new Emitter();
+	}
+}
+
+// Implementation of the JSON emitter
+void JsonEmitter::BeginModule(const string& source)
+{
+	BeginRecord();
+	if (!source.empty())
+		Field("file", source);
+	BeginList("kernels");
+	Stream() << '\n';
+	kernels_open = true;
+	++modules;
+}
+
+// Close the list of kernels; module-wide records may follow
+void JsonEmitter::EndKernels()
+{
+	if (!kernels_open) return;
+	Assert(first.size() == 2, "Unbalanced JSON output");
+	EndList();
+	kernels_open = false;
+}
+
+void JsonEmitter::EndModule()
+{
+	EndKernels();
+	Assert(first.size() == 1, "Unbalanced JSON output");
+	EndRecord();
+	Stream() << '\n';
+}
+
+// A batch report is a single object; the caller fills in the per-file
+// modules and the summary between BeginBatch and EndBatch
+void JsonEmitter::BeginBatch()
+{
+	BeginRecord();
+}
+
+void JsonEmitter::EndBatch()
+{
+	Assert(first.size() == 1, "Unbalanced JSON output");
+	EndRecord();
+	Stream() << '\n';
+}
+
+void JsonEmitter::Embed(const string& data)
+{
+	string doc = data;
+	while (!doc.empty() && doc[doc.size() - 1] == '\n')
+		doc.erase(doc.size() - 1);
+	Separate("");
+	Stream() << doc << '\n';
+}
+
+void JsonEmitter::BeginKernel(const string& name)
+{
+	BeginRecord();
+	Field("kernel", name);
+	++kernels;
+}
+
+void JsonEmitter::EndKernel()
+{
+	EndRecord();
+	Stream() << '\n';
+}
+
+// Emit the separator and key that precede every value in the current container
+void JsonEmitter::Separate(const string& key)
+{
+	if (first.empty()) return;
+	if (!first.back())
+		Stream() << ", ";
+	first.back() = false;
+	if (!in_list.back()) {
+		Quote(key);
+		Stream() << ": ";
+	}
+}
+
+void JsonEmitter::Quote(const string& str)
+{
+	ostream& os = Stream();
+	os << '"';
+	for (unsigned i = 0; i < str.size(); ++i) {
+		char c = str[i];
+		switch (c) {
+			case '"': os << "\\\""; break;
+			case '\\': os << "\\\\"; break;
+			case '\n': os << "\\n"; break;
+			case '\t': os << "\\t"; break;
+			case '\r': os << "\\r"; break;
+			default:
+				if ((unsigned char) c < 0x20) {
+					const char *hex = "0123456789abcdef";
+					os << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+				}
+				else os << c;
+		}
+	}
+	os << '"';
+}
+
+void JsonEmitter::BeginList(const string& key)
+{
+	Separate(key);
+	Stream() << '[';
+	first.push_back(true);
+	in_list.push_back(true);
+}
+
+void JsonEmitter::EndList()
+{
+	Stream() << ']';
+	first.pop_back();
+	in_list.pop_back();
+}
+
+void JsonEmitter::BeginRecord(const string& key)
+{
+	Separate(key);
+	Stream() << '{';
+	first.push_back(true);
+	in_list.push_back(false);
+}
+
+void JsonEmitter::EndRecord()
+{
+	Stream() << '}';
+	first.pop_back();
+	in_list.pop_back();
+}
+
+void JsonEmitter::Field(const string& key, unsigned long long value)
+{
+	Separate(key);
+	Stream() << value;
+}
+
+void JsonEmitter::Field(const string& key, double value)
+{
+	Separate(key);
+	// JSON has no representation for inf/nan
+	if (isinf(value) || isnan(value)) Stream() << "null";
+	else Stream() << value;
+}
+
+void JsonEmitter::Field(const string& key, const string& value)
+{
+	Separate(key);
+	Quote(value);
+}
+
+void JsonEmitter::Value(unsigned long long value)
+{
+	Separate("");
+	Stream() << value;
+}
+
+void JsonEmitter::Value(const string& value)
+{
+	Separate("");
+	Quote(value);
+}
+
+// Implementation of the CSV emitter
+void CsvEmitter::BeginModule(const string& name)
+{
+	source = name;
+	if (!embedded)
+		Stream() << "file,kernel,scope,key,value" << '\n';
+}
+
+void CsvEmitter::BeginBatch()
+{
+	source.clear();
+	kernel.clear();
+	Stream() << "file,kernel,scope,key,value" << '\n';
+}
+
+void CsvEmitter::BeginKernel(const string& name)
+{
+	kernel = name;
+	scope.clear();
+	list_index.clear();
+	in_list.clear();
+}
+
+// Module-wide rows have an empty kernel column
+void CsvEmitter::EndKernels()
+{
+	BeginKernel("");
+}
+
+// Records inside a list are named by their position in the list
+void CsvEmitter::BeginList(const string& key)
+{
+	if (!in_list.empty() && in_list.back()) {
+		ostringstream idx;
+		idx << list_index.back()++;
+		scope.push_back(idx.str());
+	}
+	else scope.push_back(key);
+	list_index.push_back(0);
+	in_list.push_back(true);
+}
+
+void CsvEmitter::EndList()
+{
+	scope.pop_back();
+	list_index.pop_back();
+	in_list.pop_back();
+}
+
+void CsvEmitter::BeginRecord(const string& key)
+{
+	if (!in_list.empty() && in_list.back()) {
+		ostringstream idx;
+		idx << list_index.back()++;
+		scope.push_back(idx.str());
+	}
+	else scope.push_back(key);
+	list_index.push_back(0);
+	in_list.push_back(false);
+}
+
+void CsvEmitter::EndRecord()
+{
+	scope.pop_back();
+	list_index.pop_back();
+	in_list.pop_back();
+}
+
+string CsvEmitter::Scope() const
+{
+	string str;
+	for (unsigned i = 0; i < scope.size(); ++i) {
+		if (i > 0) str += "/";
+		str += scope[i];
+	}
+	return str;
+}
+
+// Quote a field if it contains a separator, a quote or a line break
+string CsvEmitter::Escape(const string& str)
+{
+	if (str.find_first_of(",\"\n\r") == str.npos)
+		return str;
+	string quoted = "\"";
+	for (unsigned i = 0; i < str.size(); ++i) {
+		if (str[i] == '"') quoted += '"';
+		quoted += str[i];
+	}
+	quoted += '"';
+	return quoted;
+}
+
+// Start a row; the caller appends the value
+void CsvEmitter::Row(const string& key)
+{
+	Stream() << Escape(source) << ',' << Escape(kernel) << ',' << Escape(Scope()) << ',' << Escape(key) << ',';
+}
+
+void CsvEmitter::Field(const string& key, unsigned long long value)
+{
+	Row(key);
+	Stream() << value << '\n';
+}
+
+void CsvEmitter::Field(const string& key, double value)
+{
+	Row(key);
+	Stream() << value << '\n';
+}
+
+void CsvEmitter::Field(const string& key, const string& value)
+{
+	Row(key);
+	Stream() << Escape(value) << '\n';
+}
+
+void CsvEmitter::Value(unsigned long long value)
+{
+	ostringstream idx;
+	idx << list_index.back()++;
+	Field(idx.str(), value);
+}
+
+void CsvEmitter::Value(const string& value)
+{
+	ostringstream idx;
+	idx << list_index.back()++;
+	Field(idx.str(), value);
+}
+
+// Each thread writes its reports to its own emitter
+static __thread Emitter *current_output = 0;
+
+Emitter& Out()
+{
+	if (current_output == 0)
+		current_output = new Emitter();
+	return *current_output;
+}
+
+void SetOutput(Emitter *emitter)
+{
+	current_output = emitter;
+}
@@ -0,0 +1,157 @@
+#ifndef _EMITTER_H_INCLUDED_
+#define _EMITTER_H_INCLUDED_
+
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+using namespace std;
+
+typedef enum {FORMAT_TEXT, FORMAT_JSON, FORMAT_CSV} OutputFormat;
+
+// A growable in-memory stream buffer. All report output for a kernel is
+// collected here and handed to the real output stream in a single write,
+// instead of flushing the terminal on every line
+class OutputBuffer : public streambuf
+{
+	public:
+	OutputBuffer(size_t reserve = INITIAL_SIZE) {data.reserve(reserve);}
+	inline const string& GetData() const {return data;}
+	inline void Clear() {data.clear();}
+
+	static const size_t INITIAL_SIZE = 1 << 20;
+
+	protected:
+	int_type overflow(int_type c);
+	streamsize xsputn(const char *, streamsize);
+
+	private:
+	string data;
+};
+
+// The Emitter is the sink for every report. Reports check IsStructured():
+// the text emitter only exposes Stream() for the traditional prose, while
+// the JSON and CSV emitters turn the structural calls (lists, records and
+// fields) into machine-readable output. Records nest, so loop trees map
+// to nested lists
+class Emitter
+{
+	public:
+	Emitter();
+	virtual ~Emitter() {}
+
+	inline ostream& Stream() {return stream;}
+	inline const string& GetBuffer() const {return buffer.GetData();}
+	// drop the reports nobody is going to read
+	inline void Clear() {buffer.Clear();}
+	virtual bool IsStructured() const {return false;}
+	virtual void BeginModule(const string&) {}
+	virtual void EndModule() {}
+	virtual void BeginBatch() {}
+	virtual void EndBatch() {}
+	// The reports of a single kernel, to be embedded into the module they
+	// belong to later on
+	virtual void BeginFragment(const string&) {}
+	virtual void Embed(const string&);
+	virtual void BeginKernel(const string&);
+	virtual void EndKernel() {}
+	// reports between EndKernels() and EndModule() cover the whole module
+	virtual void EndKernels() {}
+	virtual void BeginList(const string&) {}
+	virtual void EndList() {}
+	virtual void BeginRecord(const string& = "") {}
+	virtual void EndRecord() {}
+	virtual void Field(const string&, unsigned long long) {}
+	virtual void Field(const string&, double) {}
+	virtual void Field(const string&, const string&) {}
+	virtual void Value(unsigned long long) {}
+	virtual void Value(const string&) {}
+	inline void Field(const string& key, unsigned value) {Field(key, (unsigned long long) value);}
+	inline void Field(const string& key, unsigned long value) {Field(key, (unsigned long long) value);}
+	inline void Field(const string& key, const char *value) {Field(key, string(value));}
+	void Flush(ostream&);
+
+	// Embedded emitters produce output that is later spliced into a batch report
+	static Emitter * Create(OutputFormat, bool embedded = false);
+
+	private:
+	Emitter(const Emitter&);
+	Emitter& operator=(const Emitter&);
+
+	OutputBuffer buffer;
+	ostream stream;
+};
+
+class JsonEmitter : public Emitter
+{
+	public:
+	JsonEmitter() : modules(0), kernels(0), kernels_open(false) {}
+	bool IsStructured() const {return true;}
+	void BeginModule(const string&);
+	void EndModule();
+	void BeginBatch();
+	void EndBatch();
+	void Embed(const string&);
+	void BeginKernel(const string&);
+	void EndKernel();
+	void EndKernels();
+	void BeginList(const string&);
+	void EndList();
+	void BeginRecord(const string& = "");
+	void EndRecord();
+	void Field(const string&, unsigned long long);
+	void Field(const string&, double);
+	void Field(const string&, const string&);
+	void Value(unsigned long long);
+	void Value(const string&);
+
+	private:
+	void Separate(const string&);
+	void Quote(const string&);
+
+	// one entry per open object/array: has anything been written into it yet
+	vector <bool> first;
+	vector <bool> in_list;
+	unsigned modules, kernels;
+	bool kernels_open;
+};
+
+// CSV output is in long form, one row per value: the input file, the kernel,
+// the path of lists/records leading to the value, the field name and the value
+class CsvEmitter : public Emitter
+{
+	public:
+	CsvEmitter(bool e = false) : embedded(e) {}
+	bool IsStructured() const {return true;}
+	void BeginModule(const string&);
+	void BeginBatch();
+	void BeginFragment(const string& name) {source = name;}
+	void BeginKernel(const string&);
+	void EndKernels();
+	void BeginList(const string&);
+	void EndList();
+	void BeginRecord(const string& = "");
+	void EndRecord();
+	void Field(const string&, unsigned long long);
+	void Field(const string&, double);
+	void Field(const string&, const string&);
+	void Value(unsigned long long);
+	void Value(const string&);
+
+	private:
+	void Row(const string&);
+	string Scope() const;
+	static string Escape(const string&);
+
+	bool embedded;
+	string source, kernel;
+	vector <string> scope;
+	vector <unsigned> list_index;
+	vector <bool> in_list;
+};
+
+// The emitter that reports are currently written to
+Emitter& Out();
+void SetOutput(Emitter *);
+
+#endif
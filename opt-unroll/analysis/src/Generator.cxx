@@ -0,0 +1,183 @@
+#include "Generator.h"
+#include <sstream>
+using namespace std;
+
+// A 64-bit LCG, so that the output does not depend on the platform's rand()
+unsigned Generator::Random(unsigned n)
+{
+	state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned) (state >> 33) % n;
+}
+
+double Generator::RandomFraction()
+{
+	return Random(1 << 24) / double(1 << 24);
+}
+
+string Generator::Label(unsigned n) const
+{
+	ostringstream label;
+	label << "label" << n;
+	return label.str();
+}
+
+void Generator::Write(ostream& os)
+{
+	for (unsigned k = 0; k < config.kernels; ++k)
+		WriteKernel(os, k);
+	os.flush();
+}
+
+// Write a single instruction of the configured mix, prefixed with the
+// given label if any
+void Generator::WriteInstruction(ostream& os, const string& label, bool alu_only)
+{
+	static const char *alu_ops[] = {"add.u32", "sub.u32", "mul24.lo.u32", "and.b32", "shl.u32", "max.s32"};
+	unsigned dst = Random(12), src0 = Random(12), src1 = Random(12);
+
+	if (!label.empty())
+		os << label << ": ";
+
+	double kind = alu_only ? 1.0 : RandomFraction();
+	if (kind < config.global_ops) {
+		if (Random(4) == 0) os << "mov.u32 g[$r" << src0 << "], $r" << src1;
+		else os << "mov.u32 $r" << dst << ", g[$r" << src0 << "]";
+	}
+	else if ((kind -= config.global_ops) < config.shared_ops) {
+		os << "mov.u32 $r" << dst << ", s[$r" << src0 << "+0x0010]";
+	}
+	else if ((kind -= config.shared_ops) < config.local_ops) {
+		os << "mov.u32 $r" << dst << ", l[$r" << src0 << "]";
+	}
+	else {
+		os << alu_ops[Random(sizeof(alu_ops) / sizeof(alu_ops[0]))] << " $r" << dst << ", $r" << src0 << ", $r" << src1;
+	}
+	os << '\n';
+}
+
+// A straight run of n instructions, the first of which carries the label
+void Generator::WriteBody(ostream& os, unsigned n, const string& label)
+{
+	for (unsigned i = 0; i < n; ++i)
+		WriteInstruction(os, (i == 0) ? label : "");
+}
+
+void Generator::WriteKernel(ostream& os, unsigned index)
+{
+	unsigned long long ninstrs = config.instructions;
+	unsigned depth = (config.depth > 0) ? config.depth : 1;
+	unsigned long long nblocks = config.blocks ? config.blocks : (ninstrs + 15) / 16;
+	if (nblocks * MIN_BLOCK_SIZE > ninstrs) nblocks = ninstrs / MIN_BLOCK_SIZE;
+	if (nblocks == 0) nblocks = 1;
+
+	// every loop nest takes 2 * depth - 1 blocks: a header block per level on
+	// the way in, the innermost body, and the block closing each outer level
+	unsigned nest_blocks = 2 * depth - 1;
+	unsigned long long nloops = config.loops;
+	if (nloops * nest_blocks >= nblocks) nloops = (nblocks - 1) / nest_blocks;
+	unsigned long long nplain = nblocks - nloops * nest_blocks;
+	unsigned block_size = ninstrs / nblocks;
+	unsigned long long extra = ninstrs - (unsigned long long) block_size * nblocks;
+
+	// the order of plain blocks (0) and loop nests (1), nests spread evenly
+	vector <char> layout;
+	for (unsigned long long p = 0, l = 0; p < nplain; ++p) {
+		layout.push_back(0);
+		while (l < nloops && (l + 1) * nplain <= (p + 1) * (nloops + 1)) {
+			layout.push_back(1);
+			++l;
+		}
+	}
+
+	next_label = 0;
+	functions.clear();
+	// Labels of the plain blocks are fixed up front so that forward
+	// branches can refer to them; the first block needs none
+	vector <unsigned> plain_label;
+	for (unsigned i = 0; i < layout.size(); ++i)
+		plain_label.push_back((i > 0 && layout[i] == 0) ? next_label++ : 0);
+
+	// call sites go to plain blocks spread over the kernel
+	vector <bool> has_call(layout.size(), false);
+	if (nplain > 1) {
+		for (unsigned c = 0; c < config.calls; ++c) {
+			unsigned long long p = (c * 2 + 1) * (nplain - 1) / (config.calls * 2), seen = 0;
+			for (unsigned i = 0; i < layout.size(); ++i) {
+				if (layout[i] != 0) continue;
+				if (seen++ == p) {has_call[i] = true; break;}
+			}
+		}
+	}
+
+	os << "// Disassembling kernel" << index << '\n';
+	os << ".entry kernel" << index << '\n';
+	os << "{" << '\n';
+	os << ".lmem 16" << '\n';
+	os << ".smem 64" << '\n';
+	os << ".reg 16" << '\n';
+
+	bool branched = false;
+	for (unsigned i = 0; i < layout.size(); ++i) {
+		bool last = (i + 1 == layout.size());
+		if (layout[i] == 0) {
+			unsigned size = block_size + (extra > 0 ? 1 : 0);
+			if (extra > 0) --extra;
+			const string& label = (i == 0) ? "" : Label(plain_label[i]);
+
+			// an if-then: skip the next block when it and the one after are
+			// straight-line. Two in a row would leave a block with two successors
+			// that both join, which the cycle model cannot follow
+			bool branch = (i + 2 < layout.size() && layout[i + 1] == 0 && layout[i + 2] == 0
+										 && !has_call[i] && !branched && RandomFraction() < config.branches);
+			branched = branch;
+			unsigned tail = (branch ? 2 : 0) + (has_call[i] ? 1 : 0) + (last ? 1 : 0);
+			WriteBody(os, (size > tail + 1) ? size - tail : 1, label);
+
+			if (branch) {
+				os << "set.eq.u32 $p1|$r15, $r14, c1[0x0004]" << '\n';
+				os << "@$p1.eq bra.label " << Label(plain_label[i + 2]) << '\n';
+			}
+			if (has_call[i]) {
+				unsigned fn = next_label++;
+				functions.push_back(fn);
+				os << "call.label " << Label(fn) << '\n';
+			}
+			// the body must not end in a memory op
+			if (last)
+				WriteInstruction(os, "", true);
+			continue;
+		}
+
+		branched = false;
+		// a loop nest: headers on the way in, closing branches on the way out
+		vector <unsigned> headers;
+		for (unsigned level = 0; level < depth; ++level) {
+			unsigned size = block_size + (extra > 0 ? 1 : 0);
+			if (extra > 0) --extra;
+			unsigned header = next_label++;
+			headers.push_back(header);
+			unsigned body = (level + 1 == depth) ? ((size > 3) ? size - 3 : 1) : size;
+			WriteBody(os, body, Label(header));
+		}
+		for (unsigned level = depth; level-- > 0; ) {
+			if (level + 1 < depth) {
+				unsigned size = block_size + (extra > 0 ? 1 : 0);
+				if (extra > 0) --extra;
+				WriteBody(os, (size > 3) ? size - 3 : 1, "");
+			}
+			os << "add.u32 $r" << (12 + level % 2) << ", $r" << (12 + level % 2) << ", 0x00000001" << '\n';
+			os << "set.ne.u32 $p0|$r14, $r" << (12 + level % 2) << ", c1[0x0000]" << '\n';
+			os << "@$p0.ne bra.label " << Label(headers[level]) << '\n';
+		}
+		if (last)
+			WriteInstruction(os, "", true);
+	}
+
+	// the functions called from the body, inlined at their call sites
+	for (unsigned f = 0; f < functions.size(); ++f) {
+		WriteBody(os, FUNCTION_SIZE - 1, Label(functions[f]));
+		// decuda writes a trailing space after return
+		os << "return " << '\n';
+	}
+	os << "}" << '\n';
+}
@@ -0,0 +1,59 @@
+#ifndef _GENERATOR_H_INCLUDED_
+#define _GENERATOR_H_INCLUDED_
+
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// The shape of the synthetic ptx to generate. Counts are per kernel
+class GeneratorConfig
+{
+	public:
+	GeneratorConfig()
+	: instructions(1000), blocks(0), kernels(1), loops(1), depth(1), branches(0.25), global_ops(0.1),
+		shared_ops(0.05), local_ops(0.01), calls(0), seed(1) {}
+
+	unsigned long long instructions;
+	unsigned blocks; // 0 picks one block per 16 instructions
+	unsigned kernels;
+	unsigned loops; // loop nests, each nested depth deep
+	unsigned depth;
+	double branches; // fraction of straight-line blocks ending in a forward branch
+	double global_ops, shared_ops, local_ops; // fraction of instructions
+	unsigned calls; // call sites, each to its own function
+	unsigned seed;
+};
+
+// Writes decuda-style ptx of a given shape. The straight-line blocks are
+// labelled, some of them end in if-then style forward branches, loop nests
+// are spread evenly between them, and functions called from straight-line
+// blocks follow the kernel body. Loops have no conditionals inside and the
+// kernel body ends in an alu op, so the output stays within what the cycle
+// model handles. Calls are inlined by Kernel::Construct, but the cycle
+// model does not get past an inlined function yet, so leave them out when
+// counting cycles. The same config and seed always give the same ptx
+class Generator
+{
+	public:
+	Generator(const GeneratorConfig& c) : config(c), state(c.seed) {}
+	void Write(ostream&);
+
+	static const unsigned FUNCTION_SIZE = 8;
+	static const unsigned MIN_BLOCK_SIZE = 4;
+
+	private:
+	void WriteKernel(ostream&, unsigned);
+	void WriteBody(ostream&, unsigned, const string&);
+	void WriteInstruction(ostream&, const string&, bool alu_only = false);
+	string Label(unsigned) const;
+	unsigned Random(unsigned);
+	double RandomFraction();
+
+	GeneratorConfig config;
+	unsigned long long state;
+	unsigned next_label;
+	vector <unsigned> functions;
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "Hoisting.h"
+#include "Liveness.h"
+#include "TripCount.h"
+#include "Emitter.h"
+#include "Stats.h"
+#include <algorithm>
+using namespace std;
+
+// How many ALU ops an address can be computed through
+#define PREDICT_DEPTH 4
+
+// The latency the other warps leave uncovered
+static unsigned long long Exposed(unsigned latency, unsigned long long distance, unsigned num_warps)
+{
+	unsigned long long hidden = distance * num_warps;
+	return (latency > hidden) ? latency - hidden : 0;
+}
+
+Hoisting::Hoisting(const CFG *c, const Schedule *s, unsigned n) : cfg(c), schedule(s), num_warps(n), unmodelled(0)
+{
+	TIME_PHASE(PHASE_HOISTING);
+	vector <const Loop *> all;
+	if (cfg->HasLoops()) {
+		for (LoopListConstIter iter = cfg->LoopsBegin(); iter != cfg->LoopsEnd(); ++iter)
+			CollectLoops(*iter, all);
+	}
+
+	for (BBListConstIter iter = cfg->BlocksBegin(); iter != cfg->BlocksEnd(); ++iter) {
+		const BasicBlock *bb = *iter;
+		if (bb->GetFirstInst() == 0) continue;
+		const Loop *inner = 0;
+		for (unsigned l = 0; l < all.size(); ++l) {
+			if (all[l]->InNatLoop(bb) && (inner == 0 || all[l]->GetNestingLevel() > inner->GetNestingLevel()))
+				inner = all[l];
+		}
+		Analyze(bb, inner);
+	}
+}
+
+void Hoisting::CollectLoops(const Loop *loop, vector<const Loop *>& all) const
+{
+	all.push_back(loop);
+	if (loop->HasInnerLoops()) {
+		for (LoopListConstIter iter = loop->InnerLoopsBegin(); iter != loop->InnerLoopsEnd(); ++iter)
+			CollectLoops(*iter, all);
+	}
+}
+
+// Each global load goes right after the last instruction it depends on; the
+// first use stays where it is
+void Hoisting::Analyze(const BasicBlock *bb, const Loop *loop)
+{
+	vector <const Instruction *> insts;
+	vector <SchedNode> nodes;
+	vector <SchedEdge> edges;
+	schedule->Dependences(bb, insts, nodes, edges);
+
+	vector <unsigned> earliest(insts.size(), 0);
+	for (unsigned e = 0; e < edges.size(); ++e)
+		earliest[edges[e].to] = max(earliest[edges[e].to], edges[e].from + 1);
+	vector <unsigned long long> start(insts.size() + 1, 0);
+	for (unsigned i = 0; i < insts.size(); ++i)
+		start[i + 1] = start[i] + nodes[i].issue;
+
+	for (unsigned i = 0; i < insts.size(); ++i) {
+		const Instruction *inst = insts[i];
+		if (!inst->IsGlobalOp() || !inst->IsMemLoad()) continue;
+
+		int dst = inst->GetRegDst();
+		unsigned use = insts.size();
+		for (unsigned j = i + 1; j < insts.size() && use == insts.size(); ++j) {
+			const InstRegs& regs = Liveness::GetRegs(insts[j]);
+			for (unsigned u = 0; u < regs.num_uses; ++u) {
+				if (regs.uses[u] == dst) use = j;
+			}
+			if (use == insts.size() && !insts[j]->IsMemStore() && insts[j]->GetRegDst() == dst) break;
+		}
+		if (use == insts.size()) {
+			++unmodelled;
+			continue;
+		}
+
+		HoistedLoad load;
+		load.inst = inst;
+		load.block = bb;
+		load.loop = loop;
+		for (const Loop *l = loop; l != 0; l = l->GetEnclosingLoop())
+			load.executions *= l->GetNumIters();
+		load.latency = nodes[i].latency;
+		load.distance = start[use] - start[i];
+		load.hoisted = start[use] - start[earliest[i]];
+		load.moved = i - earliest[i];
+		if (loop && CanPrefetch(inst, bb, loop)) {
+			load.ahead = true;
+			load.hoisted += IterationCycles(loop);
+		}
+		load.exposed = Exposed(load.latency, load.distance, num_warps);
+		load.hoisted_exposed = Exposed(load.latency, load.hoisted, num_warps);
+		loads.push_back(load);
+	}
+}
+
+// Whether the load can be issued for the next iteration, see Hoisting.h
+bool Hoisting::CanPrefetch(const Instruction *load, const BasicBlock *bb, const Loop *loop) const
+{
+	if (loop->HasInnerLoops() || (bb != loop->GetHeader() && bb != loop->GetFooter())) return false;
+
+	const InstRegs& regs = Liveness::GetRegs(load);
+	for (unsigned u = 0; u < regs.num_uses; ++u) {
+		if (!IsPredictable(loop, regs.uses[u], PREDICT_DEPTH)) return false;
+	}
+	for (BBSetConstIter iter = loop->NatLoopBegin(); iter != loop->NatLoopEnd(); ++iter) {
+		const BasicBlock *block = *iter;
+		for (const Instruction *inst = block->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+			if (!inst->IsDeleted() && inst->IsGlobalOp() && inst->IsMemStore()) return false;
+			if (inst == block->GetLastInst()) break;
+		}
+	}
+	return true;
+}
+
+// Whether the value of the register on the next iteration is known
+bool Hoisting::IsPredictable(const Loop *loop, int reg, unsigned depth) const
+{
+	long step;
+	if (TripCount::IsInvariant(loop, reg) || TripCount::FindStep(loop, reg, step)) return true;
+	bool every_iteration;
+	const Instruction *def = TripCount::FindDef(loop, reg, every_iteration);
+	if (depth == 0 || def == 0 || !every_iteration || def->GetOpcode() != OPR_ALU) return false;
+
+	const InstRegs& regs = Liveness::GetRegs(def);
+	for (unsigned u = 0; u < regs.num_uses; ++u) {
+		if (regs.uses[u] == reg || !IsPredictable(loop, regs.uses[u], depth - 1)) return false;
+	}
+	return true;
+}
+
+// The issue cycles of an iteration of the loop
+unsigned long long Hoisting::IterationCycles(const Loop *loop) const
+{
+	unsigned long long cycles = 0;
+	for (BBSetConstIter iter = loop->NatLoopBegin(); iter != loop->NatLoopEnd(); ++iter) {
+		const BasicBlock *block = *iter;
+		for (const Instruction *inst = block->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+			if (!inst->IsDeleted()) cycles += schedule->Issue(inst);
+			if (inst == block->GetLastInst()) break;
+		}
+	}
+	return cycles;
+}
+
+unsigned long long Hoisting::GetExposed() const
+{
+	unsigned long long exposed = 0;
+	for (unsigned i = 0; i < loads.size(); ++i)
+		exposed += loads[i].exposed * loads[i].executions;
+	return exposed;
+}
+
+unsigned long long Hoisting::GetSaved() const
+{
+	unsigned long long saved = 0;
+	for (unsigned i = 0; i < loads.size(); ++i)
+		saved += loads[i].GetSaved();
+	return saved;
+}
+
+static bool CompareLines(const HoistedLoad *a, const HoistedLoad *b)
+{
+	return a->inst->GetLineNum() < b->inst->GetLineNum();
+}
+
+// Report the loads in the order of the ptx, with what hoisting each of them
+// saves. The count of loads includes the unmodelled ones
+void Hoisting::Dump() const
+{
+	vector <const HoistedLoad *> sorted;
+	for (unsigned i = 0; i < loads.size(); ++i)
+		sorted.push_back(&loads[i]);
+	sort(sorted.begin(), sorted.end(), CompareLines);
+	unsigned long long exposed = GetExposed(), saved = GetSaved();
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("hoisting");
+		out.Field("loads", GetNumLoads() + GetNumUnmodelled());
+		out.Field("unmodelled", GetNumUnmodelled());
+		out.Field("exposed", exposed);
+		out.Field("hoisted_exposed", exposed - saved);
+		out.Field("saved", saved);
+		out.BeginList("accesses");
+		for (unsigned i = 0; i < sorted.size(); ++i) {
+			const HoistedLoad *load = sorted[i];
+			out.BeginRecord();
+			out.Field("line", load->inst->GetLineNum());
+			out.Field("block", load->block->Id());
+			if (load->loop) out.Field("loop", load->loop->Id());
+			out.Field("executions", load->executions);
+			out.Field("latency", load->latency);
+			out.Field("distance", load->distance);
+			out.Field("hoisted_distance", load->hoisted);
+			out.Field("moved", load->moved);
+			out.Field("ahead", (unsigned) load->ahead);
+			out.Field("exposed", load->exposed);
+			out.Field("hoisted_exposed", load->hoisted_exposed);
+			out.Field("saved", load->GetSaved());
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << "Global loads: " << GetNumLoads() + GetNumUnmodelled() << " (" << GetNumUnmodelled()
+		 << " of them used beyond their block, not modelled), exposed latency " << exposed << " cycles, hoisted "
+		 << exposed - saved << ", saves " << saved << '\n';
+	for (unsigned i = 0; i < sorted.size(); ++i) {
+		const HoistedLoad *load = sorted[i];
+		os << "Line " << load->inst->GetLineNum() << " (bb " << load->block->Id() << "): used after "
+			 << load->distance << " cycles, after " << load->hoisted << " moved above " << load->moved
+			 << (load->moved == 1 ? " instr" : " instrs");
+		if (load->ahead) os << " and an iteration ahead";
+		os << ", exposed " << load->exposed << " -> " << load->hoisted_exposed;
+		if (load->executions != 1) os << " x" << load->executions;
+		os << ", saves " << load->GetSaved() << '\n';
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef _HOISTING_H_INCLUDED_
+#define _HOISTING_H_INCLUDED_
+
+#include "CFG.h"
+#include "Schedule.h"
+#include <vector>
+using namespace std;
+
+// What-if hoisting of the global loads. The -exp cycle model stalls at the
+// first use of a global load for whatever part of its latency the other
+// warps do not cover: with w warps and d cycles issued between the load
+// and its use, latency - d * w cycles stay exposed. Each load is moved,
+// virtually, as early as its block's dependence DAG (see Schedule.h) lets
+// it - right after the last instruction it depends on - and the exposed
+// latency is recomputed from the longer distance.
+//
+// A load in an inner-most loop can also be issued an iteration ahead, into
+// a rotating register, when its address is known an iteration early: the
+// registers it reads are left alone by the loop, are induction variables
+// (see TripCount.h), or are computed from such registers by ALU ops, a few
+// levels deep. Its block must run on every iteration, and the loop must
+// store nothing to global memory that it might read. The distance then
+// grows by the issue cycles of an iteration.
+//
+// The savings are per execution of the load, times the iterations of the
+// loops around it. Loads whose first use is in another block are left out;
+// the cycle model does not follow them either. The savings are in terms of
+// the -exp model, and are not taken off the kernel's cycles: the default
+// model charges the whole latency at the load, wherever it is placed.
+
+class HoistedLoad
+{
+	public:
+	HoistedLoad() : inst(0), block(0), loop(0), executions(1), latency(0), distance(0), hoisted(0),
+		moved(0), ahead(false), exposed(0), hoisted_exposed(0) {}
+	inline unsigned long long GetSaved() const {return (exposed - hoisted_exposed) * executions;}
+	const Instruction *inst;
+	const BasicBlock *block;
+	// the inner-most loop around the load, if any
+	const Loop *loop;
+	unsigned long long executions;
+	unsigned latency;
+	// issue cycles from the load to its first use, where it is and hoisted
+	unsigned long long distance, hoisted;
+	// the instructions it moves above
+	unsigned moved;
+	bool ahead;
+	// per execution
+	unsigned long long exposed, hoisted_exposed;
+};
+
+class Hoisting
+{
+	public:
+	Hoisting(const CFG *, const Schedule *, unsigned);
+	inline unsigned GetNumLoads() const {return loads.size();}
+	inline unsigned GetNumUnmodelled() const {return unmodelled;}
+	unsigned long long GetExposed() const;
+	unsigned long long GetSaved() const;
+	void Dump() const;
+
+	private:
+	void Analyze(const BasicBlock *, const Loop *);
+	bool CanPrefetch(const Instruction *, const BasicBlock *, const Loop *) const;
+	bool IsPredictable(const Loop *, int, unsigned) const;
+	unsigned long long IterationCycles(const Loop *) const;
+	void CollectLoops(const Loop *, vector<const Loop *>&) const;
+
+	const CFG *cfg;
+	const Schedule *schedule;
+	unsigned num_warps;
+	vector <HoistedLoad> loads;
+	// the global loads used beyond their block
+	unsigned unmodelled;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include "InputBuffer.h"
+#include "Utils.h"
+#include <cstring>
+#ifdef PTX_ZLIB
+#include <zlib.h>
+#endif
+#ifdef PTX_ZSTD
+#include <zstd.h>
+#endif
+
+// The source, if owned, is deleted along with the buffer
+InputBuffer::InputBuffer(const string& n, streambuf *src, istream *own)
+: name(n), source(src), owned(own), codec(CODEC_NONE), started(false), finished(false), draining(false),
+	raw(0), out(0), raw_pos(0), raw_len(0), stream(0) {}
+
+InputBuffer::~InputBuffer()
+{
+#ifdef PTX_ZLIB
+	if (codec == CODEC_GZIP && stream) {
+		inflateEnd(static_cast<z_stream *>(stream));
+		delete static_cast<z_stream *>(stream);
+	}
+#endif
+#ifdef PTX_ZSTD
+	if (codec == CODEC_ZSTD && stream)
+		ZSTD_freeDStream(static_cast<ZSTD_DStream *>(stream));
+#endif
+	delete [] raw;
+	delete [] out;
+	delete owned;
+}
+
+// Tell the format from the magic number at the start of the input
+Codec InputBuffer::Detect(const char *bytes, size_t size)
+{
+	const unsigned char *b = reinterpret_cast<const unsigned char *>(bytes);
+	if (size >= 2 && b[0] == 0x1f && b[1] == 0x8b)
+		return CODEC_GZIP;
+	if (size >= 4 && b[0] == 0x28 && b[1] == 0xb5 && b[2] == 0x2f && b[3] == 0xfd)
+		return CODEC_ZSTD;
+	return CODEC_NONE;
+}
+
+bool InputBuffer::IsSupported(Codec c)
+{
+	switch (c) {
+		case CODEC_NONE:
+			return true;
+		case CODEC_GZIP:
+#ifdef PTX_ZLIB
+			return true;
+#else
+			return false;
+#endif
+		case CODEC_ZSTD:
+#ifdef PTX_ZSTD
+			return true;
+#else
+			return false;
+#endif
+	}
+	return false;
+}
+
+const char *InputBuffer::CodecName(Codec c)
+{
+	switch (c) {
+		case CODEC_GZIP: return "gzip";
+		case CODEC_ZSTD: return "zstd";
+		default: return "plain";
+	}
+}
+
+// Read the next block of the source. Returns false at its end
+bool InputBuffer::Refill()
+{
+	streamsize n = source->sgetn(raw, BLOCK_SIZE);
+	raw_pos = 0;
+	raw_len = (n > 0) ? n : 0;
+	return raw_len > 0;
+}
+
+// Look at the first block to find out what is being read
+void InputBuffer::Start()
+{
+	started = true;
+	raw = new char[BLOCK_SIZE];
+	Refill();
+	codec = Detect(raw, raw_len);
+	Assert(IsSupported(codec), name << " is " << CodecName(codec) << " compressed, which this build cannot read");
+	if (codec == CODEC_NONE) return;
+
+	out = new char[BLOCK_SIZE];
+#ifdef PTX_ZLIB
+	if (codec == CODEC_GZIP) {
+		z_stream *z = new z_stream;
+		memset(z, 0, sizeof(z_stream));
+		// 32 lets zlib take gzip as well as zlib headers
+		int ret = inflateInit2(z, 15 + 32);
+		if (ret != Z_OK) {
+			delete z;
+			Assert(false, "Unable to inflate " << name);
+		}
+		stream = z;
+	}
+#endif
+#ifdef PTX_ZSTD
+	if (codec == CODEC_ZSTD) {
+		ZSTD_DStream *ds = ZSTD_createDStream();
+		Assert(ds != 0, "Unable to decompress " << name);
+		stream = ds;
+		Assert(!ZSTD_isError(ZSTD_initDStream(ds)), "Unable to decompress " << name);
+	}
+#endif
+}
+
+// Inflate up to a block of output. Once a block comes out full, zlib may
+// hold more output for the input already taken, so unless the stream has
+// ended the source is only read again after draining it. A gzip file may
+// hold several members one after the other, as left by cat a.gz b.gz
+size_t InputBuffer::Inflate()
+{
+#ifdef PTX_ZLIB
+	z_stream *z = static_cast<z_stream *>(stream);
+	z->next_out = reinterpret_cast<Bytef *>(out);
+	z->avail_out = BLOCK_SIZE;
+	while (z->avail_out == BLOCK_SIZE) {
+		if (raw_pos == raw_len && (finished || !draining) && !Refill()) {
+			Assert(finished, "Truncated gzip input " << name);
+			break;
+		}
+		if (finished) {
+			inflateReset(z);
+			finished = false;
+		}
+		z->next_in = reinterpret_cast<Bytef *>(raw + raw_pos);
+		z->avail_in = raw_len - raw_pos;
+		int ret = inflate(z, Z_NO_FLUSH);
+		// Z_BUF_ERROR only says that no progress was possible this time
+		Assert(ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR, "Corrupt gzip input " << name
+			<< (z->msg ? ": " : "") << (z->msg ? z->msg : ""));
+		raw_pos = raw_len - z->avail_in;
+		draining = (z->avail_out == 0);
+		if (ret == Z_STREAM_END) finished = true;
+	}
+	return BLOCK_SIZE - z->avail_out;
+#else
+	return 0;
+#endif
+}
+
+// Decompress up to a block of output. Frames following each other are
+// taken in turn by the same stream
+size_t InputBuffer::DecompressZstd()
+{
+#ifdef PTX_ZSTD
+	ZSTD_DStream *ds = static_cast<ZSTD_DStream *>(stream);
+	ZSTD_outBuffer output = {out, BLOCK_SIZE, 0};
+	while (output.pos == 0) {
+		if (raw_pos == raw_len && (finished || !draining) && !Refill()) {
+			Assert(finished, "Truncated zstd input " << name);
+			break;
+		}
+		ZSTD_inBuffer input = {raw, raw_len, raw_pos};
+		size_t ret = ZSTD_decompressStream(ds, &output, &input);
+		Assert(!ZSTD_isError(ret), "Corrupt zstd input " << name << ": " << ZSTD_getErrorName(ret));
+		raw_pos = input.pos;
+		draining = (output.pos == output.size);
+		// zero once a frame is complete and flushed
+		finished = (ret == 0);
+	}
+	return output.pos;
+#else
+	return 0;
+#endif
+}
+
+int InputBuffer::underflow()
+{
+	if (gptr() < egptr())
+		return traits_type::to_int_type(*gptr());
+
+	if (!started) {
+		Start();
+		// plain input is handed out in the blocks it is read in
+		if (codec == CODEC_NONE) {
+			setg(raw, raw, raw + raw_len);
+			return raw_len ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+		}
+	}
+
+	size_t n = 0;
+	switch (codec) {
+		case CODEC_NONE:
+			Refill();
+			setg(raw, raw, raw + raw_len);
+			return raw_len ? traits_type::to_int_type(*gptr()) : traits_type::eof();
+		case CODEC_GZIP:
+			n = Inflate();
+			break;
+		case CODEC_ZSTD:
+			n = DecompressZstd();
+			break;
+	}
+	if (n == 0) return traits_type::eof();
+	setg(out, out, out + n);
+	return traits_type::to_int_type(*gptr());
+}
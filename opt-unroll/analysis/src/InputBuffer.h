@@ -0,0 +1,50 @@
+#ifndef _INPUT_BUFFER_H_INCLUDED_
+#define _INPUT_BUFFER_H_INCLUDED_
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+using namespace std;
+
+typedef enum {CODEC_NONE, CODEC_GZIP, CODEC_ZSTD} Codec;
+
+// A stream buffer over ptx that may be gzip or zstd compressed, such as
+// stdin or a .ptx.gz file. The source is read in large blocks and the
+// format is told from the first bytes; compressed input is inflated a
+// block at a time, so the whole file is never held in memory. gzip needs
+// a build with zlib and zstd one with libzstd (see the Makefile)
+class InputBuffer : public streambuf
+{
+	public:
+	InputBuffer(const string&, streambuf *, istream * = 0);
+	~InputBuffer();
+
+	static Codec Detect(const char *, size_t);
+	static bool IsSupported(Codec);
+	static const char *CodecName(Codec);
+
+	static const size_t BLOCK_SIZE = 1 << 20;
+
+	protected:
+	int underflow();
+
+	private:
+	InputBuffer(const InputBuffer&);
+	InputBuffer& operator=(const InputBuffer&);
+
+	void Start();
+	bool Refill();
+	size_t Inflate();
+	size_t DecompressZstd();
+
+	string name;
+	streambuf *source;
+	istream *owned;
+	Codec codec;
+	bool started, finished, draining;
+	char *raw, *out;
+	size_t raw_pos, raw_len;
+	void *stream;
+};
+
+#endif
@@ -1,13 +1,20 @@
 #include "Kernel.h"
 #include "Utils.h"
+#include "Emitter.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+#include "Unroll.h"
 
+#include <cctype>
 #include <map>
+#include <sstream>
 #include <stack>
 #include <set>
 using namespace std;
 
 // create the various streams and set the parser
-Kernel::Kernel(Parser *p) : parser(p), cfg(0), num_warps(32)
+Kernel::Kernel(Parser *p) : parser(p), num_warps(32), parse_threads(1), unrolled(false), computed(0), cfg(0), cycles(0),
+	liveness(0), coalescing(0), schedule(0), hoisting(0)
 {
 	inst_stream = new list<Instruction *>();
 	label_stream = new vector<Label *>();
@@ -17,7 +24,7 @@ Kernel::Kernel(Parser *p) : parser(p), cfg(0), num_warps(32)
 // clean up and release memory
 Kernel::~Kernel()
 {
-	if (cfg) delete cfg;
+	Invalidate();
 
 	for (InstIter iter = inst_stream->begin();
 				iter != inst_stream->end();
@@ -71,6 +78,24 @@ void Kernel::AddDirective(Directive *dir)
 	directive_stream->push_back(dir);
 }
 
+// Add a statement to its stream, noting the labels by number
+void Kernel::AddStatement(Statement *stmt, map<unsigned, Label *>& branch_targets)
+{
+	if (IsA<Instruction *> (stmt)) {
+		AddInstruction(dynamic_cast<Instruction *>(stmt));
+	}
+	else if (IsA<Label *> (stmt)) {
+		Label *label = dynamic_cast<Label *>(stmt);
+		branch_targets.insert(std::pair<unsigned, Label *>(label->GetNumber(), label));
+		AddLabel(dynamic_cast<Label *>(stmt));
+	}
+	else {
+		// has to be a directive - no use for directives yet
+		Assert(IsA<Directive *> (stmt), "Unknown Statement object seen");
+		AddDirective(dynamic_cast<Directive *>(stmt));
+	}
+}
+
 bool operator < (const InstIter& x, const InstIter& y) 
 {
 	return (*x)->GetLineNum() < (*y)->GetLineNum();
@@ -79,28 +104,24 @@ bool operator < (const InstIter& x, const InstIter& y)
 // This is where we build the kernel, parsing the ptx file line by line
 bool Kernel::Construct()
 {
+	TIME_PHASE(PHASE_CONSTRUCT);
 	map<unsigned, Label *> branch_targets;
 
-	Instruction::reset_fields = true;
-
-	while (!parser->Done()) {
-		Statement *stmt = parser->Parse();
-
-		// if the parser choked on a line, just continue
-		if (stmt == 0) continue;
+	// the allocations of the workers would escape -memstats
+	unsigned threads = parse_threads ? parse_threads : ThreadPool::DefaultNumThreads();
+	if (threads > 1 && CurrentMemStats() == 0) {
+		vector <Statement *> stmts;
+		parser->ParseChunks(stmts, threads);
+		for (unsigned i = 0; i < stmts.size(); ++i)
+			AddStatement(stmts[i], branch_targets);
+	}
+	else {
+		while (!parser->Done()) {
+			Statement *stmt = parser->Parse();
 
-		if (IsA<Instruction *> (stmt)) {
-			AddInstruction(dynamic_cast<Instruction *>(stmt));
-		}
-		else if (IsA<Label *> (stmt)) {
-			Label *label = dynamic_cast<Label *>(stmt);
-			branch_targets.insert(std::pair<unsigned, Label *>(label->GetNumber(), label));
-			AddLabel(dynamic_cast<Label *>(stmt));
-		}
-		else {
-			// has to be a directive - no use for directives yet
-			Assert(IsA<Directive *> (stmt), "Unknown Statement object seen");
-			AddDirective(dynamic_cast<Directive *>(stmt));
+			// if the parser choked on a line, just continue
+			if (stmt == 0) continue;
+			AddStatement(stmt, branch_targets);
 		}
 	}
 
@@ -173,50 +194,283 @@ bool Kernel::Construct()
 		inst_stream->splice(++cs, *inst_stream, entry, ++exit);
 	}
 
+	// the name is known once the .entry has been parsed
+	name = parser->GetKernelName();
 	return true;
 }
 
-void Kernel::BuildCFG(bool unrolled)
+// Build the CFG and find the loops right away, rather than on demand
+void Kernel::BuildCFG(bool unrolled_loops)
+{
+	SetUnrolled(unrolled_loops);
+	Require(ANALYSIS_LOOPS);
+}
+
+// Drop every analysis built on the CFG, so that the next report recomputes
+// them for new warps or unroll factors. The instruction counts stay
+void Kernel::Invalidate()
+{
+	delete liveness;
+	delete coalescing;
+	delete hoisting;
+	delete schedule;
+	delete cfg;
+	liveness = 0;
+	coalescing = 0;
+	hoisting = 0;
+	schedule = 0;
+	cfg = 0;
+	cycles = 0;
+	computed &= (1 << ANALYSIS_COUNTS);
+}
+
+// Renumber the lines of the kernel, for a kernel that moved within its
+// file. The reports take the line numbers from the statements, but the
+// analyses may have been reported already, so they go as well
+void Kernel::ShiftLines(int delta)
+{
+	Invalidate();
+	for (InstIter iter = InstBegin(); iter != InstEnd(); ++iter)
+		(*iter)->SetLineNum((*iter)->GetLineNum() + delta);
+	for (vector<Label *>::iterator iter = label_stream->begin(); iter != label_stream->end(); ++iter)
+		(*iter)->SetLineNum((*iter)->GetLineNum() + delta);
+	for (vector<Directive *>::iterator iter = directive_stream->begin(); iter != directive_stream->end(); ++iter)
+		(*iter)->SetLineNum((*iter)->GetLineNum() + delta);
+}
+
+// The instructions of the kernel, a line each, without its name and its
+// directives, and with the registers and the labels renumbered in the
+// order they first appear in, so that kernels that differ only in those
+// get the same text. Every analysis is blind to such a renaming, except
+// that $r0 holds the thread index on entry (see Coalescing.h), so $r0
+// keeps its name, and that -pressure counts registers up to the highest
+// one used
+string Kernel::CanonicalBody() const
+{
+	map<string, unsigned> regs, labels;
+	string canonical;
+
+	for (InstIter iter = InstBegin(); iter != InstEnd(); ++iter) {
+		const string& ascii = (*iter)->GetAscii();
+		for (unsigned i = 0; i < ascii.size(); ) {
+			unsigned start = i;
+			bool is_reg = (ascii[i] == '$');
+			bool is_label = !is_reg && ascii.compare(i, 5, "label") == 0 && (i == 0 || !isalnum(ascii[i - 1]));
+			if (!(is_reg || is_label)) {
+				canonical += ascii[i++];
+				continue;
+			}
+
+			// $<class><number> or label<number>
+			i += is_reg ? 1 : 5;
+			unsigned digits = i;
+			while (digits < ascii.size() && isalpha(ascii[digits])) ++digits;
+			unsigned end = digits;
+			while (end < ascii.size() && isdigit(ascii[end])) ++end;
+			if (end == digits || (is_label && digits != i)) {
+				canonical.append(ascii, start, i - start);
+				continue;
+			}
+
+			const string& name = ascii.substr(start, end - start);
+			if (name == "$r0") {
+				canonical += name;
+			}
+			else {
+				map<string, unsigned>& names = is_reg ? regs : labels;
+				const string& kind = ascii.substr(start, digits - start);
+				map<string, unsigned>::iterator found = names.find(name);
+				if (found == names.end())
+					found = names.insert(pair<string, unsigned>(name, names.size())).first;
+				ostringstream renamed;
+				renamed << kind << "#" << found->second;
+				canonical += renamed.str();
+			}
+			i = end;
+		}
+		canonical += '\n';
+	}
+	return canonical;
+}
+
+// The factors apply to the loops as the CFG numbers them, as in .uconf
+void Kernel::SetUnrollFactors(const vector<unsigned>& factors)
+{
+	Invalidate();
+	unroll_factors = factors;
+}
+
+// Run the given analysis, and the ones it depends on, unless done already
+void Kernel::Require(Analysis analysis) const
+{
+	if (HasAnalysis(analysis)) return;
+	CheckDeadline();
+
+	switch (analysis) {
+		case ANALYSIS_COUNTS:
+			for (InstIter iter = InstBegin(); iter != InstEnd(); ++iter)
+				counts.Add(*iter);
+			break;
+		case ANALYSIS_CFG:
+			cfg = new CFG(InstBegin(), InstEnd(), unrolled);
+			if (!unroll_factors.empty()) {
+				cfg->SetUnrollFactors(unroll_factors);
+			}
+			else if (unrolled) {
+				vector<unsigned> factors;
+				if (ReadUconf("./.uconf", name, factors))
+					cfg->SetUnrollFactors(factors);
+				else
+					cerr << "No unroll factors for " << name << " in ./.uconf. Using default loop iter count" << endl;
+			}
+			break;
+		case ANALYSIS_LOOPS:
+			Require(ANALYSIS_CFG);
+			cfg->DetectLoops();
+			break;
+		case ANALYSIS_CYCLES:
+			CountCycles(0);
+			break;
+		case ANALYSIS_LIVENESS:
+			Require(ANALYSIS_LOOPS);
+			liveness = new Liveness(cfg);
+			break;
+		case ANALYSIS_COALESCING:
+			Require(ANALYSIS_CFG);
+			coalescing = new Coalescing(cfg);
+			cfg->SetCoalescing(coalescing);
+			break;
+		case ANALYSIS_SCHEDULE:
+			Require(ANALYSIS_LOOPS);
+			Require(ANALYSIS_COALESCING);
+			schedule = new Schedule(cfg);
+			break;
+		case ANALYSIS_HOISTING:
+			Require(ANALYSIS_SCHEDULE);
+			hoisting = new Hoisting(cfg, schedule, GetNumWarps());
+			break;
+		default:
+			Assert(false, "Unknown analysis " << analysis);
+	}
+	computed |= (1 << analysis);
+}
+
+// The cycle model writes a record per loop to the output as it goes, so
+// the cycles are counted where they are reported. ANALYSIS_CYCLES stands
+// for the counts of the default model, without a device: the counts for a
+// device replace them in the loops too, so they are made again every time
+unsigned long long Kernel::CountCycles(const Device *device) const
 {
-	cfg = new CFG(InstBegin(), InstEnd(), unrolled);
-	cfg->DetectLoops();
+	if (device == 0 && HasAnalysis(ANALYSIS_CYCLES)) return cycles;
+	Require(ANALYSIS_LOOPS);
+	Require(ANALYSIS_COALESCING);
+	cycles = cfg->CountCycles(device, GetNumWarps());
+	if (device == 0)
+		computed |= (1 << ANALYSIS_CYCLES);
+	else
+		computed &= ~(1 << ANALYSIS_CYCLES);
+	return cycles;
 }
 
 void Kernel::DumpCFG() const
 {
 	// for now, dump the list of all basic-blocks
+	Require(ANALYSIS_LOOPS);
 	cfg->DumpCFG();
 }
 
 void Kernel::DumpBBs() const
 {
+	Require(ANALYSIS_CFG);
 	cfg->DumpBasicBlocks();
 }
 
 void Kernel::DumpLoopInfo() const
 {
+	Require(ANALYSIS_LOOPS);
 	cfg->DumpLoopInfo();
 }
 
 void Kernel::DumpInstCounts() const
 {
-	cfg->DumpInstCounts();
+	Require(ANALYSIS_COUNTS);
+	DumpCounts(counts, DUMP_COUNTS, "");
+}
+
+// The codes were decoded as the instructions were parsed
+void Kernel::DumpOpcodes() const
+{
+	OpcodeHistogram opcodes;
+	for (InstIter iter = InstBegin(); iter != InstEnd(); ++iter)
+		opcodes.Add((*iter)->GetCode());
+	::DumpOpcodes(opcodes);
 }
 
 void Kernel::DumpLoopInstCounts() const
 {
+	Require(ANALYSIS_LOOPS);
 	cfg->DumpLoopInstCounts();
 }
 
+void Kernel::DumpPressure(unsigned max_factor) const
+{
+	Require(ANALYSIS_LIVENESS);
+	liveness->Dump(max_factor);
+}
+
+void Kernel::DumpCoalescing() const
+{
+	Require(ANALYSIS_COALESCING);
+	coalescing->Dump();
+}
+
+// The per-loop costs need the loops as well
+void Kernel::DumpBankConflicts() const
+{
+	Require(ANALYSIS_LOOPS);
+	Require(ANALYSIS_COALESCING);
+	coalescing->DumpBanks();
+}
+
+void Kernel::DumpSchedule(unsigned max_factor) const
+{
+	Require(ANALYSIS_SCHEDULE);
+	schedule->Dump(max_factor);
+}
+
+void Kernel::DumpHoisting() const
+{
+	Require(ANALYSIS_HOISTING);
+	hoisting->Dump();
+}
+
 void Kernel::DumpLoopRatios() const
 {
+	Require(ANALYSIS_LOOPS);
 	cfg->DumpLoopRatios();
 }
 
-void Kernel::DumpCycles(const Device *device) const
+unsigned long long Kernel::DumpCycles(const Device *device) const
 {
-	unsigned long long cycles = cfg->CountCycles(device, GetNumWarps());
-	cout << "Total number of cycles = " << cycles << endl;
+	Require(ANALYSIS_LOOPS);
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("cycles");
+		out.BeginList("loops");
+	}
+
+	CountCycles(device);
+
+	if (out.IsStructured()) {
+		out.EndList();
+		out.Field("stall_cycles", cfg->GetStallCycles());
+		out.Field("total", cycles);
+		out.EndRecord();
+		return cycles;
+	}
+	out.Stream() << "Total stall cycles = " << cfg->GetStallCycles() << '\n';
+	out.Stream() << "Total number of cycles = " << cycles << '\n';
+	return cycles;
 }
 
 void Kernel::DumpLoopCycles(const Device *device) const
@@ -4,16 +4,37 @@
 #include "Statement.h"
 #include "Parser.h"
 #include "CFG.h"
+#include "Liveness.h"
+#include "Coalescing.h"
+#include "Schedule.h"
+#include "Hoisting.h"
 #include "Device.h"
 
 #include <list>
 #include <vector>
+#include <map>
 using namespace std;
 
 // The Kernel class is an abstraction of a GPGPU kernel. It contains
 // a stream of instructions and labels, among other stuff. The driver
 // creates a parser for the given ptx file and initiates the construction
 // of the kernel.
+//
+// Everything beyond the instruction stream is computed on demand: each
+// report requires the analyses it depends on, and an analysis is run the
+// first time it is required and kept until the kernel goes away. The
+// instruction counts take a single pass over the stream, so -counts and
+// -ratios never build a CFG.
+
+// The analyses reports can depend on. The loop forest needs the CFG, and
+// the cycle model and register liveness need the loops; the cycle model
+// also charges global accesses by the transactions the coalescing analysis
+// finds, and shared accesses by their bank conflicts. The block schedules
+// take their latencies from the same model, and the what-if hoisting of the
+// global loads moves them within the blocks' dependence DAGs. Require()
+// pulls those in as well
+typedef enum {ANALYSIS_COUNTS, ANALYSIS_CFG, ANALYSIS_LOOPS, ANALYSIS_CYCLES, ANALYSIS_LIVENESS,
+	ANALYSIS_COALESCING, ANALYSIS_SCHEDULE, ANALYSIS_HOISTING, NUM_ANALYSES} Analysis;
 
 class Kernel
 {
@@ -27,7 +48,10 @@ class Kernel
 	InstIter InstBegin() const {return inst_stream->begin();}
 	InstIter InstEnd() const {return inst_stream->end();}
 	inline const unsigned GetNumWarps() const {return num_warps;}
+	inline unsigned GetNumInstrs() const {return inst_stream->size();}
 	inline void SetNumWarps(unsigned short nwarps) {num_warps = nwarps;}
+	// more than one thread parses the kernel in chunks, 0 picks one per cpu
+	inline void SetParseThreads(unsigned n) {parse_threads = n;}
 	void AddInstruction(Instruction *inst);
 	void AddLabel(Label *label);
 	void AddDirective(Directive *dir);
@@ -35,22 +59,64 @@ class Kernel
 	void DumpInstructionStream() const;
 	void DumpRatios() const;
 	void DumpInstCounts() const;
+	void DumpOpcodes() const;
 	void DumpLoopInfo() const;
 	void DumpLoopRatios() const;
 	void DumpLoopInstCounts() const;
-	void DumpCycles(const Device *) const;
+	unsigned long long DumpCycles(const Device *) const;
 	void DumpLoopCycles(const Device *) const;
+	void DumpPressure(unsigned) const;
+	void DumpCoalescing() const;
+	void DumpBankConflicts() const;
+	void DumpSchedule(unsigned) const;
+	void DumpHoisting() const;
 	void DumpBBs() const;
 	CFG * GetCFG() const {return cfg;}
+	inline const Liveness * GetLiveness() const {Require(ANALYSIS_LIVENESS); return liveness;}
+	inline const Coalescing * GetCoalescing() const {Require(ANALYSIS_COALESCING); return coalescing;}
+	inline const Schedule * GetSchedule() const {Require(ANALYSIS_SCHEDULE); return schedule;}
+	inline const Hoisting * GetHoisting() const {Require(ANALYSIS_HOISTING); return hoisting;}
 	void BuildCFG(bool unrolled = false);
 	void DumpCFG() const;
 
+	void Require(Analysis) const;
+	inline bool HasAnalysis(Analysis a) const {return (computed & (1 << a)) != 0;}
+	// -unrolled: the CFG is built with the unroll factors of the kernel's
+	// line in ./.uconf, unless factors are set
+	inline void SetUnrolled(bool u) {unrolled = u;}
+	void SetUnrollFactors(const vector<unsigned>&);
+	void Invalidate();
+	void ShiftLines(int);
+	string CanonicalBody() const;
+	// the .entry name, once constructed
+	inline const string& GetName() const {return name;}
+	inline const InstCounts& GetInstCounts() const {Require(ANALYSIS_COUNTS); return counts;}
+	unsigned long long CountCycles(const Device *) const;
+	// zero unless the reports asked for blocks and loops
+	inline unsigned GetNumBlocks() const {return HasAnalysis(ANALYSIS_CFG) ? cfg->GetNumBlocks() : 0;}
+	inline unsigned GetNumLoops() const {return HasAnalysis(ANALYSIS_LOOPS) ? cfg->GetNumLoops() : 0;}
+
 	private:
+	void AddStatement(Statement *, map<unsigned, Label *>&);
+
 	list <Instruction *> *inst_stream;
 	vector <Label *> *label_stream;
 	vector <Directive *> *directive_stream;
 	Parser *parser;
-	CFG *cfg;
+	string name;
 	unsigned num_warps;
+	unsigned parse_threads;
+	bool unrolled;
+	vector <unsigned> unroll_factors;
+
+	// the analyses computed so far
+	mutable unsigned computed;
+	mutable CFG *cfg;
+	mutable InstCounts counts;
+	mutable unsigned long long cycles;
+	mutable Liveness *liveness;
+	mutable Coalescing *coalescing;
+	mutable Schedule *schedule;
+	mutable Hoisting *hoisting;
 };
 #endif
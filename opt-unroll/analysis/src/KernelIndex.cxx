@@ -0,0 +1,123 @@
+#include "KernelIndex.h"
+#include "Parser.h"
+#include "Utils.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+KernelSelector::KernelSelector(const string& p)
+: pattern(p), compiled(false)
+{
+	if (pattern.empty()) return;
+	int err = regcomp(&regex, ("^(" + pattern + ")$").c_str(), REG_EXTENDED | REG_NOSUB);
+	Assert(err == 0, "Invalid kernel pattern " << pattern);
+	compiled = true;
+}
+
+KernelSelector::~KernelSelector()
+{
+	if (compiled) regfree(&regex);
+}
+
+bool KernelSelector::Matches(const string& name) const
+{
+	if (pattern.empty() || name == pattern) return true;
+	return (compiled && regexec(&regex, name.c_str(), 0, 0, 0) == 0);
+}
+
+string KernelIndex::IndexFileName(const string& ptx_file)
+{
+	return ptx_file + ".kidx";
+}
+
+bool KernelIndex::Stat(const string& path, unsigned long long& bytes, long long& modified)
+{
+	struct stat sb;
+	if (stat(path.c_str(), &sb) != 0) return false;
+	bytes = sb.st_size;
+	modified = sb.st_mtim.tv_sec * 1000000000LL + sb.st_mtim.tv_nsec;
+	return true;
+}
+
+// Check that each entry still starts the .entry it names
+bool KernelIndex::Verify() const
+{
+	ifstream is(file.c_str(), ios::in | ios::binary);
+	string line;
+	for (unsigned i = 0; i < entries.size(); ++i) {
+		if (!is.seekg(entries[i].offset) || !getline(is, line)) return false;
+		if (!Parser::IsEntry(line) || Parser::GetEntryName(line) != entries[i].name) return false;
+	}
+	return true;
+}
+
+// Read the index of the given ptx file. Returns false if there is none,
+// or if it no longer describes the file, in which case it is built again
+bool KernelIndex::Load(const string& ptx_file)
+{
+	file = ptx_file;
+	entries.clear();
+	if (!Stat(file, size, mtime)) return false;
+
+	ifstream is(IndexFileName(file).c_str());
+	string line, tag;
+	unsigned long long indexed_size;
+	long long indexed_mtime;
+	if (!getline(is, line) || line.find("# ptx-analyze kernel index") != 0) return false;
+	if (!(is >> tag >> indexed_size >> indexed_mtime) || tag != "ptx") return false;
+	if (indexed_size != size || indexed_mtime != mtime) return false;
+
+	KernelOffset entry;
+	while (is >> entry.offset >> entry.line) {
+		getline(is >> ws, entry.name);
+		entries.push_back(entry);
+	}
+	return is.eof() && Verify();
+}
+
+// Scan the ptx file for .entry directives. Only whole lines are looked at,
+// nothing is parsed
+void KernelIndex::Build(const string& ptx_file)
+{
+	file = ptx_file;
+	entries.clear();
+	Stat(file, size, mtime);
+
+	ifstream is(file.c_str(), ios::in | ios::binary);
+	if (is.fail()) throw IOException();
+	string line;
+	KernelOffset entry;
+	unsigned long long offset = 0;
+	for (unsigned linenum = 1; getline(is, line); ++linenum) {
+		if (Parser::IsEntry(line)) {
+			entry.offset = offset;
+			entry.line = linenum;
+			entry.name = Parser::GetEntryName(line);
+			entries.push_back(entry);
+		}
+		offset += line.size() + 1;
+	}
+}
+
+// Write the index next to the ptx file. The index goes to a temporary
+// file first, so that concurrent runs never read half an index
+bool KernelIndex::Save() const
+{
+	ostringstream tmp_name;
+	tmp_name << IndexFileName(file) << ".tmp." << getpid();
+
+	ofstream os(tmp_name.str().c_str());
+	if (os.fail()) return false;
+	os << "# ptx-analyze kernel index: <offset> <line> <kernel>" << '\n';
+	os << "ptx " << size << " " << mtime << '\n';
+	for (unsigned i = 0; i < entries.size(); ++i)
+		os << entries[i].offset << " " << entries[i].line << " " << entries[i].name << '\n';
+	os.close();
+	if (os.fail() || rename(tmp_name.str().c_str(), IndexFileName(file).c_str()) != 0) {
+		unlink(tmp_name.str().c_str());
+		return false;
+	}
+	return true;
+}
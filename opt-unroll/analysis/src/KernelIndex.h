@@ -0,0 +1,70 @@
+#ifndef _KERNEL_INDEX_H_INCLUDED_
+#define _KERNEL_INDEX_H_INCLUDED_
+
+#include <regex.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Picks the kernels to analyze for -kernel=. The pattern is taken as a
+// plain kernel name first, and otherwise as an extended regular
+// expression that has to match the whole name. An empty pattern selects
+// every kernel
+class KernelSelector
+{
+	public:
+	KernelSelector(const string&);
+	~KernelSelector();
+	bool Matches(const string&) const;
+	inline bool IsEmpty() const {return pattern.empty();}
+	inline const string& GetPattern() const {return pattern;}
+
+	private:
+	KernelSelector(const KernelSelector&);
+	KernelSelector& operator=(const KernelSelector&);
+
+	string pattern;
+	regex_t regex;
+	bool compiled;
+};
+
+// Where a kernel starts: the byte offset and the line number of its
+// .entry directive
+class KernelOffset
+{
+	public:
+	unsigned long long offset;
+	unsigned line;
+	string name;
+};
+
+// The .entry offsets of a ptx file, kept next to it in <file>.kidx so
+// that later runs selecting a kernel can seek straight to it instead of
+// scanning the kernels in front. The index notes the size and the
+// modification time, in nanoseconds, of the file it was built from, and
+// is not used once either changes. Timestamps can be coarser than that,
+// so every entry is also checked against the line it points at before
+// the index is used
+class KernelIndex
+{
+	public:
+	KernelIndex() : size(0), mtime(0) {}
+	bool Load(const string&);
+	void Build(const string&);
+	bool Save() const;
+	inline unsigned GetNumEntries() const {return entries.size();}
+	inline const KernelOffset& GetEntry(unsigned i) const {return entries[i];}
+
+	static string IndexFileName(const string&);
+
+	private:
+	static bool Stat(const string&, unsigned long long&, long long&);
+	bool Verify() const;
+
+	string file;
+	unsigned long long size;
+	long long mtime;
+	vector <KernelOffset> entries;
+};
+
+#endif
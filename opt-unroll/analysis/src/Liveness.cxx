@@ -0,0 +1,253 @@
+#include "Liveness.h"
+#include "Parser.h"
+#include "Emitter.h"
+#include "Stats.h"
+#include <algorithm>
+#include <set>
+using namespace std;
+
+// Add the given set. Returns true if anything was added
+bool BitVector::Union(const BitVector& other)
+{
+	bool changed = false;
+	for (unsigned i = 0; i < words.size(); ++i) {
+		unsigned long merged = words[i] | other.words[i];
+		if (merged != words[i]) {
+			words[i] = merged;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+void BitVector::Subtract(const BitVector& other)
+{
+	for (unsigned i = 0; i < words.size(); ++i)
+		words[i] &= ~other.words[i];
+}
+
+unsigned BitVector::Count() const
+{
+	unsigned count = 0;
+	for (unsigned i = 0; i < words.size(); ++i)
+		count += __builtin_popcountl(words[i]);
+	return count;
+}
+
+Liveness::Liveness(const CFG *c)
+: cfg(c), num_regs(0), max_pressure(0), max_block(0), num_visits(0)
+{
+	TIME_PHASE(PHASE_LIVENESS);
+	ComputeOrder();
+
+	// the operands are decoded once, and the bitvectors are as wide as the
+	// highest register in the kernel
+	vector <unsigned> first(order.size() + 1, 0);
+	for (unsigned i = 0; i < order.size(); ++i) {
+		const BasicBlock *bb = order[i];
+		first[i] = regs.size();
+		for (Instruction *inst = bb->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+			if (!inst->IsDeleted()) {
+				const InstRegs& inst_regs = GetRegs(inst);
+				regs.push_back(inst_regs);
+				for (unsigned u = 0; u < inst_regs.num_uses; ++u)
+					num_regs = max(num_regs, (unsigned) inst_regs.uses[u] + 1);
+				if (inst_regs.def >= 0) num_regs = max(num_regs, (unsigned) inst_regs.def + 1);
+			}
+			if (inst == bb->GetLastInst()) break;
+		}
+	}
+	first[order.size()] = regs.size();
+
+	blocks.assign(order.size(), BlockLiveness(num_regs));
+	for (unsigned i = 0; i < order.size(); ++i) {
+		blocks[i].first = first[i];
+		blocks[i].last = first[i + 1];
+		ComputeLocal(blocks[i]);
+	}
+	Solve();
+	for (unsigned i = 0; i < order.size(); ++i) {
+		ComputePressure(blocks[i]);
+		if (blocks[i].pressure > max_pressure) {
+			max_pressure = blocks[i].pressure;
+			max_block = order[i];
+		}
+	}
+}
+
+// A store names its address register first, which is read as well
+InstRegs Liveness::GetRegs(const Instruction *inst)
+{
+	const int operands[] = {inst->GetRegDst(), inst->GetRegSrc0(), inst->GetRegSrc1(), inst->GetRegSrc2()};
+	const string& buf = inst->GetAscii();
+	unsigned start = Parser::IsLabel(buf) ? Parser::GetInstPos(buf) : 0;
+	bool guarded = start < buf.size() && buf[start] == AT_CHAR;
+
+	InstRegs regs;
+	for (unsigned i = 0; i < sizeof(operands) / sizeof(operands[0]); ++i) {
+		if (operands[i] < 0) continue;
+		if (i == 0 && !guarded && !inst->IsMemStore()) regs.def = operands[i];
+		else regs.uses[regs.num_uses++] = operands[i];
+	}
+	return regs;
+}
+
+// Post-order from the entry block, unreachable blocks last
+void Liveness::ComputeOrder()
+{
+	cfg->GetPostOrder(order);
+	for (unsigned i = 0; i < order.size(); ++i)
+		index.insert(make_pair(order[i], i));
+}
+
+void Liveness::ComputeLocal(BlockLiveness& live) const
+{
+	for (unsigned i = live.first; i < live.last; ++i) {
+		const InstRegs& inst_regs = regs[i];
+		for (unsigned u = 0; u < inst_regs.num_uses; ++u) {
+			if (!live.kill.Test(inst_regs.uses[u])) live.use.Set(inst_regs.uses[u]);
+		}
+		if (inst_regs.def >= 0) live.kill.Set(inst_regs.def);
+	}
+}
+
+// live_out(b) = union of live_in(s) over the successors s
+// live_in(b) = use(b) + (live_out(b) - kill(b))
+// The worklist always hands out the earliest block in post-order
+void Liveness::Solve()
+{
+	set <unsigned> worklist;
+	for (unsigned i = 0; i < order.size(); ++i)
+		worklist.insert(i);
+
+	BitVector in(num_regs);
+	while (!worklist.empty()) {
+		unsigned pos = *worklist.begin();
+		worklist.erase(worklist.begin());
+		const BasicBlock *bb = order[pos];
+		BlockLiveness& live = blocks[pos];
+		++num_visits;
+
+		for (BBListConstIter iter = bb->SuccBegin(); iter != bb->SuccEnd(); ++iter)
+			live.live_out.Union(GetBlock(*iter).live_in);
+		in = live.live_out;
+		in.Subtract(live.kill);
+		in.Union(live.use);
+		if (in == live.live_in) continue;
+
+		live.live_in = in;
+		for (BBListConstIter iter = bb->PredBegin(); iter != bb->PredEnd(); ++iter)
+			worklist.insert(index.find(*iter)->second);
+	}
+}
+
+// Walk the block backwards from its live-out set, noting the largest
+// number of registers live at once
+void Liveness::ComputePressure(BlockLiveness& live) const
+{
+	BitVector current = live.live_out;
+	unsigned pressure = current.Count();
+	for (unsigned i = live.last; i-- > live.first; ) {
+		const InstRegs& inst_regs = regs[i];
+		if (inst_regs.def >= 0) {
+			current.Set(inst_regs.def);
+			pressure = max(pressure, current.Count());
+			current.Reset(inst_regs.def);
+		}
+		for (unsigned u = 0; u < inst_regs.num_uses; ++u)
+			current.Set(inst_regs.uses[u]);
+		pressure = max(pressure, current.Count());
+	}
+	live.pressure = pressure;
+}
+
+unsigned Liveness::GetLiveIn(const BasicBlock *bb) const
+{
+	return GetBlock(bb).live_in.Count();
+}
+
+// The peak over the blocks of the loop, inner loops included
+unsigned Liveness::GetLoopPressure(const Loop *loop) const
+{
+	unsigned pressure = 0;
+	for (BBSetConstIter iter = loop->NatLoopBegin(); iter != loop->NatLoopEnd(); ++iter)
+		pressure = max(pressure, GetBlock(*iter).pressure);
+	return pressure;
+}
+
+unsigned Liveness::EstimatePressure(const Loop *loop, unsigned factor) const
+{
+	unsigned peak = GetLoopPressure(loop), shared = GetLiveIn(loop->GetHeader());
+	unsigned per_iteration = (peak > shared) ? peak - shared : 0;
+	return peak + (factor - 1) * per_iteration;
+}
+
+void Liveness::CollectLoops(const Loop *loop, vector<const Loop *>& all) const
+{
+	all.push_back(loop);
+	if (loop->HasInnerLoops()) {
+		for (LoopListConstIter iter = loop->InnerLoopsBegin(); iter != loop->InnerLoopsEnd(); ++iter)
+			CollectLoops(*iter, all);
+	}
+}
+
+static bool CompareLoopIds(const Loop *a, const Loop *b)
+{
+	return a->Id() < b->Id();
+}
+
+// Report the pressure of the kernel and of every loop, with the estimates
+// for unrolling by powers of two up to the given factor
+void Liveness::Dump(unsigned max_factor) const
+{
+	vector <const Loop *> loops;
+	if (cfg->HasLoops()) {
+		for (LoopListConstIter iter = cfg->LoopsBegin(); iter != cfg->LoopsEnd(); ++iter)
+			CollectLoops(*iter, loops);
+	}
+	sort(loops.begin(), loops.end(), CompareLoopIds);
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("pressure");
+		out.Field("registers", num_regs);
+		out.Field("max_pressure", max_pressure);
+		if (max_block) out.Field("max_block", max_block->Id());
+		out.BeginList("loops");
+		for (unsigned i = 0; i < loops.size(); ++i) {
+			const Loop *loop = loops[i];
+			out.BeginRecord();
+			out.Field("id", loop->Id());
+			out.Field("header", loop->GetHeader()->Id());
+			out.Field("nesting_level", (unsigned) loop->GetNestingLevel());
+			out.Field("pressure", GetLoopPressure(loop));
+			out.Field("live_in", GetLiveIn(loop->GetHeader()));
+			out.BeginList("unrolled");
+			for (unsigned u = 2; u <= max_factor; u *= 2) {
+				out.BeginRecord();
+				out.Field("factor", u);
+				out.Field("pressure", EstimatePressure(loop, u));
+				out.EndRecord();
+			}
+			out.EndList();
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << "Max register pressure: " << max_pressure;
+	if (max_block) os << " (bb " << max_block->Id() << ")";
+	os << ", registers used: " << num_regs << '\n';
+	for (unsigned i = 0; i < loops.size(); ++i) {
+		const Loop *loop = loops[i];
+		os << "Loop " << loop->Id() << " (Header bb: " << loop->GetHeader()->Id()
+			 << ", Nesting level: " << loop->GetNestingLevel() << "): pressure " << GetLoopPressure(loop)
+			 << ", live-in " << GetLiveIn(loop->GetHeader());
+		for (unsigned u = 2; u <= max_factor; u *= 2)
+			os << ", x" << u << ": " << EstimatePressure(loop, u);
+		os << '\n';
+	}
+}
@@ -0,0 +1,108 @@
+#ifndef _LIVENESS_H_INCLUDED_
+#define _LIVENESS_H_INCLUDED_
+
+#include "CFG.h"
+#include <map>
+#include <vector>
+using namespace std;
+
+// Register liveness and pressure. Liveness is the usual backward dataflow
+// over the CFG, with one dense bitvector per block for each of the use,
+// kill, live-in and live-out sets. The worklist is ordered by the post-order
+// of the blocks (the reverse post-order of the reversed CFG), so that a
+// block is mostly visited after its successors, and a loop body settles in
+// a couple of passes.
+//
+// The pressure at an instruction is the number of registers live across
+// it, counting its destination even if the value is never used. A
+// predicated instruction may leave its destination alone, so all of its
+// registers are taken as uses.
+//
+// Unrolling a loop by a factor u shares the registers live into the
+// header - the loop invariants and the values carried from one iteration
+// to the next - among the copies, while the registers live only within an
+// iteration get a copy per unrolled iteration. Since the unroll model
+// issues the copies' memory ops together (see Unroll.h), those copies are
+// taken to be live at once:
+//
+//   pressure(u) = peak + (u - 1) * (peak - live-in at the header)
+
+// A fixed-size set of small integers, such as register numbers
+class BitVector
+{
+	public:
+	BitVector(unsigned n = 0) : words((n + WORD_BITS - 1) / WORD_BITS, 0) {}
+	inline void Set(unsigned i) {words[i / WORD_BITS] |= 1UL << (i % WORD_BITS);}
+	inline void Reset(unsigned i) {words[i / WORD_BITS] &= ~(1UL << (i % WORD_BITS));}
+	inline bool Test(unsigned i) const {return (words[i / WORD_BITS] >> (i % WORD_BITS)) & 1;}
+	bool Union(const BitVector&);
+	void Subtract(const BitVector&);
+	unsigned Count() const;
+	inline bool operator==(const BitVector& other) const {return words == other.words;}
+
+	static const unsigned WORD_BITS = sizeof(unsigned long) * 8;
+
+	private:
+	vector <unsigned long> words;
+};
+
+// The registers an instruction reads, and the one it writes for sure (-1
+// if none)
+class InstRegs
+{
+	public:
+	InstRegs() : def(-1), num_uses(0) {}
+	int def;
+	unsigned num_uses;
+	int uses[4];
+};
+
+class BlockLiveness
+{
+	public:
+	BlockLiveness(unsigned nregs) : use(nregs), kill(nregs), live_in(nregs), live_out(nregs), pressure(0),
+		first(0), last(0) {}
+	// the upward-exposed uses and the registers written for sure
+	BitVector use, kill;
+	BitVector live_in, live_out;
+	unsigned pressure;
+	// the block's instructions in Liveness::regs
+	unsigned first, last;
+};
+
+class Liveness
+{
+	public:
+	Liveness(const CFG *);
+	inline unsigned GetNumRegs() const {return num_regs;}
+	inline unsigned GetMaxPressure() const {return max_pressure;}
+	inline unsigned GetNumVisits() const {return num_visits;}
+	unsigned GetLiveIn(const BasicBlock *) const;
+	unsigned GetLoopPressure(const Loop *) const;
+	unsigned EstimatePressure(const Loop *, unsigned) const;
+	void Dump(unsigned) const;
+
+	static InstRegs GetRegs(const Instruction *);
+
+	private:
+	void ComputeOrder();
+	void ComputeLocal(BlockLiveness&) const;
+	void Solve();
+	void ComputePressure(BlockLiveness&) const;
+	void CollectLoops(const Loop *, vector<const Loop *>&) const;
+	inline const BlockLiveness& GetBlock(const BasicBlock *bb) const {return blocks[index.find(bb)->second];}
+
+	const CFG *cfg;
+	// the blocks in post-order, unreachable ones last
+	vector <const BasicBlock *> order;
+	map <const BasicBlock *, unsigned> index;
+	vector <BlockLiveness> blocks;
+	// the registers of every instruction, block after block in post-order
+	vector <InstRegs> regs;
+	unsigned num_regs;
+	unsigned max_pressure;
+	const BasicBlock *max_block;
+	unsigned num_visits;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "Opcodes.h"
+#include <cstring>
+using namespace std;
+
+class MnemonicInfo
+{
+	public:
+	const char *name;
+	Opcode opc;
+	LatencyClass latency;
+};
+
+// Indexed by Mnemonic. mov, ld, st, cvt and tex are memory ops only with a
+// memory operand, see CodeClass()
+static const MnemonicInfo mnemonics[NUM_MNEMONICS] = {
+	{"", OPR_INVALID, LAT_ALU},
+	{"add", OPR_ALU, LAT_ALU}, {"sub", OPR_ALU, LAT_ALU}, {"addc", OPR_ALU, LAT_ALU},
+	{"subc", OPR_ALU, LAT_ALU}, {"mul", OPR_ALU, LAT_ALU}, {"mad", OPR_ALU, LAT_ALU},
+	{"mul24", OPR_ALU, LAT_ALU}, {"mad24", OPR_ALU, LAT_ALU}, {"sad", OPR_ALU, LAT_ALU},
+	{"div", OPR_ALU, LAT_DIV}, {"rem", OPR_ALU, LAT_DIV}, {"subr", OPR_ALU, LAT_ALU},
+	{"abs", OPR_ALU, LAT_ALU}, {"neg", OPR_ALU, LAT_ALU}, {"min", OPR_ALU, LAT_ALU},
+	{"max", OPR_ALU, LAT_ALU}, {"pre", OPR_ALU, LAT_ALU},
+	{"set", OPR_ALU, LAT_ALU}, {"setp", OPR_ALU, LAT_ALU}, {"selp", OPR_ALU, LAT_ALU},
+	{"slct", OPR_ALU, LAT_ALU},
+	{"and", OPR_ALU, LAT_ALU}, {"or", OPR_ALU, LAT_ALU}, {"xor", OPR_ALU, LAT_ALU},
+	{"not", OPR_ALU, LAT_ALU}, {"cnot", OPR_ALU, LAT_ALU}, {"shl", OPR_ALU, LAT_ALU},
+	{"shr", OPR_ALU, LAT_ALU},
+	{"rcp", OPR_ALU, LAT_SFU}, {"sqrt", OPR_ALU, LAT_DIV}, {"rsqrt", OPR_ALU, LAT_SFU},
+	{"sin", OPR_ALU, LAT_SFU}, {"cos", OPR_ALU, LAT_SFU}, {"lg2", OPR_ALU, LAT_SFU},
+	{"ex2", OPR_ALU, LAT_SFU},
+	{"trap", OPR_ALU, LAT_CONTROL}, {"brkpt", OPR_ALU, LAT_CONTROL}, {"nop", OPR_ALU, LAT_CONTROL},
+	{"join", OPR_ALU, LAT_CONTROL},
+	{"bra", OPR_BRANCH, LAT_CONTROL}, {"call", OPR_BRANCH, LAT_CONTROL}, {"ret", OPR_BRANCH, LAT_CONTROL},
+	{"exit", OPR_BRANCH, LAT_CONTROL}, {"return", OPR_BRANCH, LAT_CONTROL},
+	{"mov", OPR_MEM, LAT_ALU}, {"ld", OPR_MEM, LAT_ALU}, {"st", OPR_MEM, LAT_ALU},
+	{"cvt", OPR_MEM, LAT_ALU}, {"tex", OPR_MEM, LAT_ALU}, {"movsh", OPR_MEM, LAT_ALU},
+	{"bar", OPR_SYNC, LAT_CONTROL}, {"atom", OPR_SYNC, LAT_CONTROL}, {"red", OPR_SYNC, LAT_CONTROL},
+	{"vote", OPR_SYNC, LAT_CONTROL}
+};
+
+static const char *types[NUM_TYPES] = {
+	"", "b8", "b16", "b32", "b64", "u8", "u16", "u32", "u64", "s8", "s16", "s32", "s64", "f16", "f32", "f64"
+};
+
+static const char *spaces[NUM_STATE_SPACES] = {"", "global", "shared", "local", "const", "param"};
+
+// Per warp: the SFUs take a quarter-warp a cycle where the SPs take a full
+// one, and the double precision unit a thread a cycle. The latency is from
+// issue until the result can be read
+static const unsigned issue_cycles[NUM_LATENCY_CLASSES] = {ISSUE_CYCLES, 16, 36, 32, ISSUE_CYCLES, ISSUE_CYCLES};
+static const unsigned latency_cycles[NUM_LATENCY_CLASSES] = {ALU_LATENCY, 36, 96, 52, GLOBAL_MEM_LATENCY, ISSUE_CYCLES};
+
+static const char *latency_names[NUM_LATENCY_CLASSES] = {"alu", "sfu", "div", "double", "memory", "control"};
+
+static bool Matches(const char *name, const char *str, unsigned len)
+{
+	return strncmp(name, str, len) == 0 && name[len] == '\0';
+}
+
+Mnemonic LookupMnemonic(const char *str, unsigned len)
+{
+	for (unsigned i = 1; i < NUM_MNEMONICS; ++i) {
+		if (Matches(mnemonics[i].name, str, len)) return (Mnemonic) i;
+	}
+	return MN_INVALID;
+}
+
+OperandType LookupType(const char *str, unsigned len)
+{
+	for (unsigned i = 1; i < NUM_TYPES; ++i) {
+		if (Matches(types[i], str, len)) return (OperandType) i;
+	}
+	return TYPE_NONE;
+}
+
+StateSpace LookupSpace(const char *str, unsigned len)
+{
+	for (unsigned i = 1; i < NUM_STATE_SPACES; ++i) {
+		if (Matches(spaces[i], str, len)) return (StateSpace) i;
+	}
+	return STATE_NONE;
+}
+
+// The class the rest of the analyzer works with. A mov or cvt from
+// registers or constants is an ALU op
+Opcode CodeClass(InstCode c)
+{
+	Opcode opc = mnemonics[CodeMnemonic(c)].opc;
+	if (opc == OPR_BRANCH && CodePredicated(c)) return OPR_COND_BRANCH;
+	if (opc == OPR_MEM && !IsMemorySpace(CodeSpace(c))) return OPR_ALU;
+	return opc;
+}
+
+LatencyClass CodeLatencyClass(InstCode c)
+{
+	if (CodeClass(c) == OPR_MEM && CodeSpace(c) != STATE_SHARED) return LAT_MEMORY;
+	LatencyClass latency = mnemonics[CodeMnemonic(c)].latency;
+	if (latency == LAT_ALU && CodeType(c) == TYPE_F64) return LAT_DOUBLE;
+	return latency;
+}
+
+unsigned OpcodeIssue(InstCode c)
+{
+	return issue_cycles[CodeLatencyClass(c)];
+}
+
+unsigned OpcodeLatency(InstCode c)
+{
+	return latency_cycles[CodeLatencyClass(c)];
+}
+
+// As in ptx, with the predicate in front: @bra, ld.global.v4.f32
+string CodeName(InstCode c)
+{
+	string name = CodePredicated(c) ? "@" : "";
+	name += mnemonics[CodeMnemonic(c)].name;
+	if (CodeSpace(c) != STATE_NONE) {
+		name += '.';
+		name += spaces[CodeSpace(c)];
+	}
+	if (CodeVector(c) == VEC_V2) name += ".v2";
+	else if (CodeVector(c) == VEC_V4) name += ".v4";
+	if (CodeType(c) != TYPE_NONE) {
+		name += '.';
+		name += types[CodeType(c)];
+	}
+	return name;
+}
+
+const char * LatencyClassName(LatencyClass l)
+{
+	return latency_names[l];
+}
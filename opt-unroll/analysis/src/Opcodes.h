@@ -0,0 +1,137 @@
+#ifndef _OPCODES_H_INCLUDED_
+#define _OPCODES_H_INCLUDED_
+
+#include <string>
+#include <map>
+using namespace std;
+
+// The opcode taxonomy. Each instruction is decoded once, as it is parsed,
+// into a 16-bit code that packs its mnemonic with the modifiers that matter
+// to the cycle model and the reports:
+//
+//   bits  0-5  the mnemonic (mad24, div, ld, ...)
+//   bits  6-9  the type of the result (u32, f32, f64, ...), the first one
+//              given, as in cvt.f32.s32
+//   bits 10-12 the state space accessed, from the .global/.shared/...
+//              modifier or, in decuda output, from a g[], s[], l[] or c[]
+//              operand
+//   bits 13-14 the vector width, .v2 or .v4
+//   bit  15    whether the instruction is predicated
+//
+// Everything else is derived from the code: the class of the instruction
+// (a mov or cvt that touches no memory is an ALU op), the functional unit
+// it runs on, and from that its issue cycles and latency. The issue and
+// latency cycles are per warp, for 8 SPs, 2 SFUs and one double precision
+// unit per multiprocessor.
+
+// A convenient type to track different types of interesting opcodes
+typedef enum opcode_t
+{
+	OPR_INVALID = -1,
+	OPR_ALU,
+	OPR_BRANCH,
+	OPR_COND_BRANCH,
+	OPR_MEM,
+	OPR_SYNC
+} Opcode;
+
+typedef enum mnemonic_t
+{
+	MN_INVALID,
+	/* Integer arithmetic instructions */
+	MN_ADD, MN_SUB, MN_ADDC, MN_SUBC, MN_MUL, MN_MAD, MN_MUL24, MN_MAD24, MN_SAD, MN_DIV, MN_REM,
+	MN_SUBR, MN_ABS, MN_NEG, MN_MIN, MN_MAX, MN_PRE,
+	/* Compare and set instructions */
+	MN_SET, MN_SETP, MN_SELP, MN_SLCT,
+	/* Logical and shift instructions */
+	MN_AND, MN_OR, MN_XOR, MN_NOT, MN_CNOT, MN_SHL, MN_SHR,
+	/* FP instructions */
+	MN_RCP, MN_SQRT, MN_RSQRT, MN_SIN, MN_COS, MN_LG2, MN_EX2,
+	/* Misc instructions */
+	MN_TRAP, MN_BRKPT, MN_NOP, MN_JOIN,
+	/* CF instructions */
+	MN_BRA, MN_CALL, MN_RET, MN_EXIT, MN_RETURN,
+	/* Mem instructions */
+	MN_MOV, MN_LD, MN_ST, MN_CVT, MN_TEX, MN_MOVSH,
+	/* Synchronization operations */
+	MN_BAR, MN_ATOM, MN_RED, MN_VOTE,
+	NUM_MNEMONICS
+} Mnemonic;
+
+typedef enum
+{
+	TYPE_NONE,
+	TYPE_B8, TYPE_B16, TYPE_B32, TYPE_B64,
+	TYPE_U8, TYPE_U16, TYPE_U32, TYPE_U64,
+	TYPE_S8, TYPE_S16, TYPE_S32, TYPE_S64,
+	TYPE_F16, TYPE_F32, TYPE_F64,
+	NUM_TYPES
+} OperandType;
+
+typedef enum
+{
+	STATE_NONE, STATE_GLOBAL, STATE_SHARED, STATE_LOCAL, STATE_CONST, STATE_PARAM, NUM_STATE_SPACES
+} StateSpace;
+
+typedef enum {VEC_NONE, VEC_V2, VEC_V4} VectorWidth;
+
+// The functional units. Double precision arithmetic runs on a unit of its
+// own, whatever the mnemonic; div, rem and sqrt are expanded into a
+// reciprocal and a few dependent fix-up ops. Global and local accesses go
+// to device memory, shared ones are as fast as registers
+typedef enum {LAT_ALU, LAT_SFU, LAT_DIV, LAT_DOUBLE, LAT_MEMORY, LAT_CONTROL, NUM_LATENCY_CLASSES} LatencyClass;
+
+typedef unsigned short InstCode;
+
+#define ISSUE_CYCLES 4
+#define ALU_LATENCY 24
+// a global or local load, before the extra transactions of the warp
+#define GLOBAL_MEM_LATENCY 500
+
+#define CODE_TYPE_SHIFT 6
+#define CODE_SPACE_SHIFT 10
+#define CODE_VECTOR_SHIFT 13
+#define CODE_PREDICATED 0x8000
+
+inline InstCode MakeCode(Mnemonic m, OperandType t, StateSpace s, VectorWidth v, bool p)
+{
+	return (InstCode) (m | (t << CODE_TYPE_SHIFT) | (s << CODE_SPACE_SHIFT) | (v << CODE_VECTOR_SHIFT)
+										 | (p ? CODE_PREDICATED : 0));
+}
+inline Mnemonic CodeMnemonic(InstCode c) {return (Mnemonic) (c & 0x3f);}
+inline OperandType CodeType(InstCode c) {return (OperandType) ((c >> CODE_TYPE_SHIFT) & 0xf);}
+inline StateSpace CodeSpace(InstCode c) {return (StateSpace) ((c >> CODE_SPACE_SHIFT) & 0x7);}
+inline VectorWidth CodeVector(InstCode c) {return (VectorWidth) ((c >> CODE_VECTOR_SHIFT) & 0x3);}
+inline bool CodePredicated(InstCode c) {return (c & CODE_PREDICATED) != 0;}
+// global, shared and local accesses go through the memory pipeline; const
+// and param operands are read like registers
+inline bool IsMemorySpace(StateSpace s) {return s == STATE_GLOBAL || s == STATE_SHARED || s == STATE_LOCAL;}
+
+// Decoding the pieces of an opcode, given as a range of characters. The
+// lookups return MN_INVALID, TYPE_NONE and so on for what they do not know
+Mnemonic LookupMnemonic(const char *, unsigned);
+OperandType LookupType(const char *, unsigned);
+StateSpace LookupSpace(const char *, unsigned);
+
+Opcode CodeClass(InstCode);
+LatencyClass CodeLatencyClass(InstCode);
+unsigned OpcodeIssue(InstCode);
+unsigned OpcodeLatency(InstCode);
+string CodeName(InstCode);
+const char * LatencyClassName(LatencyClass);
+
+// Instructions by their code, over a kernel
+class OpcodeHistogram
+{
+	public:
+	OpcodeHistogram() : total(0) {}
+	inline void Add(InstCode c) {++counts[c]; ++total;}
+	inline unsigned long GetTotal() const {return total;}
+	inline const map<InstCode, unsigned long>& GetCounts() const {return counts;}
+
+	private:
+	map <InstCode, unsigned long> counts;
+	unsigned long total;
+};
+
+#endif
@@ -1,5 +1,101 @@
 #include "CFG.h"
 #include "Kernel.h"
+#include "Emitter.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+// Write out instruction counts and/or ratios, prefixing each line of
+// text with the given message
+void DumpCounts(const InstCounts& counts, DumpType type, const string& msg)
+{
+	unsigned long total_insts = counts.GetTotal(), ainsts = counts.alu, ginsts = counts.global;
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		if (type & DUMP_COUNTS) {
+			out.BeginRecord("counts");
+			out.Field("total", total_insts);
+			out.Field("alu", ainsts);
+			out.Field("global", ginsts);
+			out.Field("shared", counts.shared);
+			out.Field("local", counts.local);
+			out.Field("branch", counts.branch);
+			out.EndRecord();
+		}
+		if (type & DUMP_RATIOS) {
+			out.BeginRecord("ratios");
+			out.Field("alu", ainsts);
+			out.Field("global", ginsts);
+			if (ginsts > 0)
+				out.Field("alu_per_global", (double(ainsts))/ginsts);
+			out.EndRecord();
+		}
+		return;
+	}
+
+	ostream& os = out.Stream();
+	if (type & DUMP_COUNTS) {
+		os << msg << "Instruction count summary: " << '\n';
+		os << msg << "Total instructions = " << total_insts << '\n';
+		os << msg << "  ALU instructions = " << ainsts << '\n';
+		os << msg << "  Global mem instructions = " << ginsts << '\n';
+		os << msg << "  Shared mem instructions = " << counts.shared << '\n';
+		os << msg << "  Local mem instructions = " << counts.local << '\n';
+		os << msg << "  Branch instructions = " << counts.branch << '\n';
+	}
+	if (type & DUMP_RATIOS) {
+		os << msg << "#ALU instructions = " << ainsts << '\n';
+		os << msg << "#Global instructions = " << ginsts << '\n';
+		if (ginsts > 0) 
+			os << msg << "Ratio of ALU ops to global ops = " << (double(ainsts))/ginsts << '\n';
+	}
+}
+
+static bool CompareOpcodeCounts(const pair<InstCode, unsigned long>& a, const pair<InstCode, unsigned long>& b)
+{
+	if (a.second != b.second) return a.second > b.second;
+	return a.first < b.first;
+}
+
+// Write out the instructions by opcode, the most frequent first, with the
+// unit each runs on and what the cycle model charges for it
+void DumpOpcodes(const OpcodeHistogram& opcodes)
+{
+	vector < pair<InstCode, unsigned long> > sorted(opcodes.GetCounts().begin(), opcodes.GetCounts().end());
+	sort(sorted.begin(), sorted.end(), CompareOpcodeCounts);
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("opcodes");
+		out.Field("total", opcodes.GetTotal());
+		out.Field("distinct", (unsigned) sorted.size());
+		out.BeginList("histogram");
+		for (unsigned i = 0; i < sorted.size(); ++i) {
+			InstCode code = sorted[i].first;
+			out.BeginRecord();
+			out.Field("opcode", CodeName(code));
+			out.Field("count", sorted[i].second);
+			out.Field("unit", LatencyClassName(CodeLatencyClass(code)));
+			out.Field("issue", OpcodeIssue(code));
+			out.Field("latency", OpcodeLatency(code));
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << "Opcode histogram: " << sorted.size() << " distinct in " << opcodes.GetTotal() << " instructions" << '\n';
+	for (unsigned i = 0; i < sorted.size(); ++i) {
+		InstCode code = sorted[i].first;
+		os << "  " << setw(20) << left << CodeName(code) << right << setw(10) << sorted[i].second
+			 << "  " << LatencyClassName(CodeLatencyClass(code)) << ", issue " << OpcodeIssue(code)
+			 << ", latency " << OpcodeLatency(code) << '\n';
+	}
+}
 
 template <typename T>
 static void DumpInfoFromBBs(T start, T end, DumpType type, string& msg) 
@@ -8,32 +104,17 @@ static void DumpInfoFromBBs(T start, T end, DumpType type, string& msg)
 	// the type parameter and take appropriate action. Currently, only
 	// counts and ratios are implemented, so we just check for the two
 	
-	unsigned long total_insts, ainsts, ginsts, sinsts, binsts, linsts;
-	total_insts = ainsts = ginsts = sinsts = binsts = linsts = 0;
+	InstCounts counts;
 	for (T iter = start; iter != end; ++iter) {
 		BasicBlock *bb = *iter;
-		total_insts += bb->GetTotalOpCount();
-		ainsts += bb->GetAluOpCount();
-		ginsts += bb->GetGlobalOpCount();
-		sinsts += bb->GetSharedOpCount();
-		linsts += bb->GetLocalOpCount();
-		binsts += bb->GetBranchOpCount();
-	}
-	if (type & DUMP_COUNTS) {
-		cout << msg << "Instruction count summary: " << endl;
-		cout << msg << "Total instructions = " << total_insts << endl;
-		cout << msg << "  ALU instructions = " << ainsts << endl;
-		cout << msg << "  Global mem instructions = " << ginsts << endl;
-		cout << msg << "  Shared mem instructions = " << sinsts << endl;
-		cout << msg << "  Local mem instructions = " << linsts << endl;
-		cout << msg << "  Branch instructions = " << binsts << endl;
-	}
-	if (type & DUMP_RATIOS) {
-		cout << msg << "#ALU instructions = " << ainsts << endl;
-		cout << msg << "#Global instructions = " << ginsts << endl;
-		if (ginsts > 0) 
-			cout << msg << "Ratio of ALU ops to global ops = " << (double(ainsts))/ginsts << endl;
+		counts.alu += bb->GetAluOpCount();
+		counts.global += bb->GetGlobalOpCount();
+		counts.shared += bb->GetSharedOpCount();
+		counts.local += bb->GetLocalOpCount();
+		counts.branch += bb->GetBranchOpCount();
+		counts.sync += bb->GetSyncOpCount();
 	}
+	DumpCounts(counts, type, msg);
 }
 
 // Dump loop information recursively
@@ -46,25 +127,56 @@ void Loop::DumpInfo(DumpType type) const
 		tabs += "\t";
 	}
 
-	cout << tabs << "Loop index: " << Id() << ", Nesting level: " << GetNestingLevel() << endl;
-	cout << tabs << "Instruction count: " << GetNumInstrs() << endl;
-	cout << tabs << "Enclosing loop: ";
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		// the loop tree maps to nested records, one per loop
+		out.BeginRecord();
+		out.Field("id", Id());
+		out.Field("nesting_level", (unsigned) GetNestingLevel());
+		out.Field("header", GetHeader()->Id());
+		out.Field("instructions", GetNumInstrs());
+		out.Field("iterations", GetNumIters());
+		out.Field("trip_count", GetTripKind() == TRIP_CONSTANT ? "constant"
+							: (GetTripKind() == TRIP_SYMBOLIC ? "symbolic" : "default"));
+		if (GetTripKind() == TRIP_SYMBOLIC) out.Field("trip_expr", GetTripExpr());
+		if (GetEnclosingLoop() != 0)
+			out.Field("enclosing_loop", GetEnclosingLoop()->Id());
+		DumpInfoFromBBs<set<BasicBlock*>::const_iterator>(nat_loop.begin(), nat_loop.end(), type, tabs);
+		if (HasInnerLoops()) {
+			out.BeginList("inner_loops");
+			for (LoopListConstRevIter iter = InnerLoopsRBegin(), rend = InnerLoopsREnd(); iter != rend; ++iter) {
+				(*iter)->DumpInfo(type);
+			}
+			out.EndList();
+		}
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << tabs << "Loop index: " << Id() << ", Nesting level: " << GetNestingLevel() << '\n';
+	os << tabs << "Instruction count: " << GetNumInstrs() << '\n';
+	os << tabs << "Trip count: ";
+	if (GetTripKind() == TRIP_CONSTANT) os << GetNumIters() << '\n';
+	else if (GetTripKind() == TRIP_SYMBOLIC) os << GetTripExpr() << " (" << GetNumIters() << " assumed)" << '\n';
+	else os << "unknown (" << GetNumIters() << " assumed)" << '\n';
+	os << tabs << "Enclosing loop: ";
 	if (GetEnclosingLoop() == 0) 
-		cout << "None" << endl;
+		os << "None" << '\n';
 	else 
-		cout << GetEnclosingLoop()->Id() << endl;
+		os << GetEnclosingLoop()->Id() << '\n';
 
 	// Dump instruction counts from the blocks in the nat-loop
 	DumpInfoFromBBs<set<BasicBlock*>::const_iterator>(nat_loop.begin(), nat_loop.end(), type, tabs);
 
-	cout << endl;
+	os << '\n';
 
 	if (HasInnerLoops()) {
 		for (LoopListConstRevIter iter = InnerLoopsRBegin(), rend = InnerLoopsREnd(); iter != rend; ++iter) {
 			Loop *inner = *iter;
-			cout << tabs << "Inner loop details: " << endl;
+			os << tabs << "Inner loop details: " << '\n';
 			inner->DumpInfo(type);
-			cout << endl;
+			os << '\n';
 		}
 	}
 }
@@ -72,11 +184,22 @@ void Loop::DumpInfo(DumpType type) const
 // Walk through the list of outer loops and dump information
 void CFG::DumpLoopInfo() const
 {
-	cout << "Detected " << loops->size() << " outer loop(s)" << endl;
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("loopinfo");
+		out.Field("outer_loops", (unsigned) loops->size());
+		out.BeginList("loops");
+	}
+	else
+		out.Stream() << "Detected " << loops->size() << " outer loop(s)" << '\n';
 	for (LoopListConstIter iter = loops->begin(), end = loops->end(); iter != end; ++iter) {
 		Loop *loop = *iter;
 		loop->DumpInfo(DUMP_INFO);
 	}
+	if (out.IsStructured()) {
+		out.EndList();
+		out.EndRecord();
+	}
 }
 
 // Walk through all the basic-blocks in the current cfg and dump inst counts
@@ -98,80 +221,152 @@ void CFG::DumpRatios() const
 // loop as well as all its inner loops
 void CFG::DumpLoopInstCounts() const
 {
+	Emitter& out = Out();
+	if (out.IsStructured()) out.BeginList("loopcounts");
 	// Walk through the outer loops and recursively dump instr counts
 	for (LoopListConstIter iter = loops->begin(), end = loops->end(); iter != end; ++iter) {
 		Loop *loop = *iter;
 		loop->DumpInfo(static_cast<DumpType>(DUMP_INFO | DUMP_COUNTS));
 	}
+	if (out.IsStructured()) out.EndList();
 }
 
 void CFG::DumpLoopRatios() const
 {
+	Emitter& out = Out();
+	if (out.IsStructured()) out.BeginList("loopratios");
 	// Walk through the outer loops and recursively dump instr counts
 	for (LoopListConstIter iter = loops->begin(), end = loops->end(); iter != end; ++iter) {
 		Loop *loop = *iter;
 		loop->DumpInfo(static_cast<DumpType>(DUMP_INFO | DUMP_RATIOS));
 	}
+	if (out.IsStructured()) out.EndList();
 }
 
 void CFG::DumpBasicBlocks() const
 {
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginList("dumpbb");
+		for (BBListConstIter iter = BlocksBegin(); iter != BlocksEnd(); ++iter) {
+			BasicBlock *bb = *iter;
+			out.BeginRecord();
+			out.Field("id", bb->Id());
+			out.BeginList("instructions");
+			for (Instruction *inst = bb->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+				out.Value(inst->GetAscii());
+				if (inst == bb->GetLastInst()) break;
+			}
+			out.EndList();
+			out.EndRecord();
+		}
+		out.EndList();
+		return;
+	}
+
+	ostream& os = out.Stream();
 	for (BBListConstIter iter = BlocksBegin(); iter != BlocksEnd(); ++iter) {
 		BasicBlock *bb = *iter;
-		cout << "Basic Block # " << bb->Id() << " : " << endl;
+		os << "Basic Block # " << bb->Id() << " : " << '\n';
 		Instruction *inst = bb->GetFirstInst(), *end = bb->GetLastInst();
 		while (inst != end) {
-			cout << inst->GetAscii() << endl;
+			os << inst->GetAscii() << '\n';
 			inst = dynamic_cast<Instruction *>(inst->GetNext());
 		}
-		if (inst) cout << inst->GetAscii() << endl;
-		cout << endl;
+		if (inst) os << inst->GetAscii() << '\n';
+		os << '\n';
 	}
 }
 
 void CFG::DumpCFG() const
 {	
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginList("dumpcfg");
+		for (BBListConstIter iter = BlocksBegin(); iter != BlocksEnd(); ++iter) {
+			BasicBlock *bb = *iter;
+			out.BeginRecord();
+			out.Field("id", bb->Id());
+			out.Field("loop_header", (unsigned) bb->IsLoopHeader());
+			out.Field("loop_footer", (unsigned) bb->IsLoopFooter());
+			out.BeginList("successors");
+			for (BBListConstIter iter = bb->SuccBegin(); iter != bb->SuccEnd(); ++iter) {
+				out.Value((unsigned long long) (*iter)->Id());
+			}
+			out.EndList();
+			out.BeginList("predecessors");
+			for (BBListConstIter iter = bb->PredBegin(); iter != bb->PredEnd(); ++iter) {
+				out.Value((unsigned long long) (*iter)->Id());
+			}
+			out.EndList();
+			out.EndRecord();
+		}
+		out.EndList();
+		return;
+	}
+
+	ostream& os = out.Stream();
 	for (BBListConstIter iter = BlocksBegin(); iter != BlocksEnd(); ++iter) {
 		BasicBlock *bb = *iter;
-		cout << "Basic Block # " << bb->Id() << " : " << endl;
-		if (bb->IsLoopHeader()) cout << "LH " << endl;
-		if (bb->IsLoopFooter()) cout << "LF " << endl;
-		cout << "Successors: ";
+		os << "Basic Block # " << bb->Id() << " : " << '\n';
+		if (bb->IsLoopHeader()) os << "LH " << '\n';
+		if (bb->IsLoopFooter()) os << "LF " << '\n';
+		os << "Successors: ";
 		for (BBListConstIter iter = bb->SuccBegin(); iter != bb->SuccEnd(); ++iter) {
-			cout << (*iter)->Id() << " ";
+			os << (*iter)->Id() << " ";
 		}
-		cout << endl;
-		cout << "Predecessors: ";
+		os << '\n';
+		os << "Predecessors: ";
 		for (BBListConstIter iter = bb->PredBegin(); iter != bb->PredEnd(); ++iter) {
-			cout << (*iter)->Id() << " ";
+			os << (*iter)->Id() << " ";
 		}
-		cout << endl << endl;
+		os << '\n' << '\n';
 	}
 }
 
 // Debug routine for dumping the current instruction stream
 void Kernel::DumpInstructionStream() const
 {
+	Emitter& out = Out();
 	Instruction *instr = GetFirstInst();
+
+	if (out.IsStructured()) {
+		out.BeginList("dumpinst");
+		while (instr != 0) {
+			out.BeginRecord();
+			out.Field("line", instr->GetLineNum());
+			out.Field("ascii", instr->GetAscii());
+			if (instr->IsGlobalOp()) out.Field("space", "global");
+			else if (instr->IsSharedOp()) out.Field("space", "shared");
+			else if (instr->IsLocalOp()) out.Field("space", "local");
+			out.EndRecord();
+			instr = dynamic_cast<Instruction *>(instr->GetNext());
+		}
+		out.EndList();
+		return;
+	}
+
+	ostream& os = out.Stream();
 	while (instr != 0) {
-		cout << instr->GetAscii();
+		os << instr->GetAscii();
 		if (instr->IsGlobalOp()) {
-			cout << " : GLOBAL OP";
+			os << " : GLOBAL OP";
 		}
 		else if (instr->IsSharedOp()) {
-			cout << " : SHARED OP";
+			os << " : SHARED OP";
 		}
 		else if (instr->IsLocalOp()) {
-			cout << " : LOCAL OP";
+			os << " : LOCAL OP";
 		}
-		cout << endl;
+		os << '\n';
 		instr = dynamic_cast<Instruction *>(instr->GetNext());
 	}
 }
 
 void Kernel::DumpRatios() const
 {
-	cfg->DumpRatios();
+	Require(ANALYSIS_COUNTS);
+	DumpCounts(counts, DUMP_RATIOS, "");
 	#if 0
 	unsigned long global_count = 0, alu_count = 0;
 	Instruction *instr = GetFirstInst();
@@ -185,72 +380,166 @@ void Kernel::DumpRatios() const
 	#endif
 }
 
-void DumpCFGToDot(CFG *cfg)
+// Quote the characters that are special inside a record label
+static string DotEscape(const string& str)
 {
-	ofstream dot_file("cfg.dot");
-	dot_file << "digraph structs {" << endl;
-	dot_file << "size = \"7.5, 10\";" << endl;
-	dot_file << "node [shape=record];" << endl;
+	string escaped;
+	escaped.reserve(str.size());
+	for (unsigned i = 0; i < str.size(); ++i) {
+		char c = str[i];
+		if (c == '|' || c == '{' || c == '}' || c == '<' || c == '>' || c == '"' || c == '\\')
+			escaped += '\\';
+		escaped += c;
+	}
+	return escaped;
+}
 
-	for (BBListConstIter iter = cfg->BlocksBegin(); iter != cfg->BlocksEnd(); ++iter) {
-		BasicBlock *bb = *iter;
-		dot_file << "\t struct" << bb->Id() << "[shape=record, label=\"";
+// The label of a block with every instruction in it
+static void DotBlockLabel(ostream& dot_file, const BasicBlock *bb, const CFG *cfg)
+{
+	dot_file << "BB " << bb->Id() << "\\n";
+	dot_file << "(Instruction count: " << bb->GetTotalOpCount() << ")\\n";
+	if (bb->IsLoopHeader()) {
+		Loop *l = cfg->GetLoopFromHeader(const_cast<BasicBlock *>(bb));
+		dot_file << "Loop Header ";
+		dot_file << "(Nesting depth " << l->GetNestingLevel() << ")\\n";
+	}
+	if (bb->IsLoopFooter())
+		dot_file << "Loop Footer" << "\\n";
+	Instruction *inst = bb->GetFirstInst();
+	while (inst != bb->GetLastInst()->GetNext()) {
+		dot_file << DotEscape(inst->GetAscii());
+		if (inst->IsAluOp()) dot_file << " (A)\\n";
+		else if (inst->IsBranchOp()) dot_file << " (B)\\n";
+		else if (inst->IsLocalOp()) dot_file << " (L)\\n";
+		else if (inst->IsSharedOp()) dot_file << " (S)\\n";
+		else if (inst->IsGlobalOp()) dot_file << " (G)\\n";
+		else if (inst->IsSyncOp()) dot_file << " (N)\\n";
+		else dot_file << "\\n";
+		dot_file << inst->cycles << "\\n";
+		inst = dynamic_cast<Instruction *> (inst->GetNext());
+	}
+}
 
-		if (bb->Id() == 65535) {
-			dot_file << "Entry block \\n";
-			dot_file << "\"];" << endl;
-			continue;
+// The label of a block collapsed to its counts and cycles. The cycle
+// count is the running total at the end of the block, available when
+// the cycles have been counted
+static void DotBlockSummary(ostream& dot_file, const BasicBlock *bb, const CFG *cfg)
+{
+	dot_file << "BB " << bb->Id();
+	if (bb->IsLoopHeader())
+		dot_file << " (header L" << cfg->GetLoopFromHeader(const_cast<BasicBlock *>(bb))->Id() << ")";
+	if (bb->IsLoopFooter())
+		dot_file << " (footer)";
+	dot_file << "|" << bb->GetTotalOpCount() << " instrs: A " << bb->GetAluOpCount() << ", G " << bb->GetGlobalOpCount()
+					 << ", S " << bb->GetSharedOpCount() << ", L " << bb->GetLocalOpCount() << ", B " << bb->GetBranchOpCount();
+	if (bb->GetLastInst()->cycles > 0)
+		dot_file << "|" << bb->GetLastInst()->cycles << " cycles";
+}
+
+// Accumulated counts of a loop nest folded into a single node
+static void DotLoopSummary(ostream& dot_file, const Loop *loop)
+{
+	unsigned blocks = 0, instrs = 0, globals = 0, inner = 0;
+	for (BBSetConstIter iter = loop->NatLoopBegin(); iter != loop->NatLoopEnd(); ++iter) {
+		++blocks;
+		instrs += (*iter)->GetTotalOpCount();
+		globals += (*iter)->GetGlobalOpCount();
+	}
+	vector<const Loop *> work(1, loop);
+	while (!work.empty()) {
+		const Loop *l = work.back();
+		work.pop_back();
+		if (!l->HasInnerLoops()) continue;
+		for (LoopListConstIter iter = l->InnerLoopsBegin(); iter != l->InnerLoopsEnd(); ++iter) {
+			++inner;
+			work.push_back(*iter);
 		}
+	}
+	dot_file << "Loop L" << loop->Id() << " (header BB " << loop->GetHeader()->Id() << ")"
+					 << "|" << blocks << " blocks, " << inner << " inner loops"
+					 << "|" << instrs << " instrs, " << globals << " global"
+					 << "|" << loop->GetNumIters() << " iterations";
+}
 
-		if (bb->Id() == 65536) {
-			dot_file << "Exit block \\n";
-			dot_file << "\"];" << endl;
+// Write the CFG of a kernel in Graphviz format. DOT_FULL lists every
+// instruction of every block, DOT_SUMMARY reduces blocks to their counts.
+// With fold_loops, each outermost loop nest becomes a single node, which
+// keeps the graph of large unrolled kernels small enough to lay out
+void DumpCFGToDot(const CFG *cfg, const string& path, DotDetail detail, bool fold_loops)
+{
+	ofstream dot_file(path.c_str());
+	Assert(dot_file.good(), "Unable to write " << path);
+
+	// the node each block is drawn as: itself, or its outermost loop
+	map<const BasicBlock *, string> node;
+	if (fold_loops && cfg->HasLoops()) {
+		for (LoopListConstIter iter = cfg->LoopsBegin(); iter != cfg->LoopsEnd(); ++iter) {
+			const Loop *loop = *iter;
+			if (loop->GetEnclosingLoop() != 0) continue;
+			ostringstream name;
+			name << "loop" << loop->Id();
+			for (BBSetConstIter bb_iter = loop->NatLoopBegin(); bb_iter != loop->NatLoopEnd(); ++bb_iter)
+				node[*bb_iter] = name.str();
+		}
+	}
+
+	dot_file << "digraph structs {" << '\n';
+	dot_file << "size = \"7.5, 10\";" << '\n';
+	dot_file << "node [shape=record];" << '\n';
+
+	for (BBListConstIter iter = cfg->BlocksBegin(); iter != cfg->BlocksEnd(); ++iter) {
+		const BasicBlock *bb = *iter;
+		map<const BasicBlock *, string>::const_iterator folded = node.find(bb);
+		if (folded != node.end()) {
+			const Loop *loop = cfg->GetLoopFromHeader(const_cast<BasicBlock *>(bb));
+			if (loop == 0 || loop->GetEnclosingLoop() != 0) continue;
+			dot_file << "\t " << folded->second << "[shape=record, style=filled, fillcolor=lightgrey, label=\"{";
+			DotLoopSummary(dot_file, loop);
+			dot_file << "}\"];" << '\n';
 			continue;
 		}
 
-		dot_file << "BB " << bb->Id() << "\\n";
-		dot_file << "(Instruction count: " << bb->GetTotalOpCount() << ")\\n";
-		if (bb->IsLoopHeader()) {
-			Loop *l = cfg->loop_header_map->find(bb)->second;
-			dot_file << "Loop Header "; 
-			dot_file << "(Nesting depth " << l->GetNestingLevel() << ")\\n";
+		dot_file << "\t struct" << bb->Id() << "[shape=record, label=\"";
+		if (bb->Id() == 65535)
+			dot_file << "Entry block \\n";
+		else if (bb->Id() == 65536)
+			dot_file << "Exit block \\n";
+		else if (detail == DOT_SUMMARY) {
+			dot_file << "{";
+			DotBlockSummary(dot_file, bb, cfg);
+			dot_file << "}";
 		}
-		if (bb->IsLoopFooter())
-			dot_file << "Loop Footer" << "\\n";
-		Instruction *inst = bb->GetFirstInst();
-		while (inst != bb->GetLastInst()->GetNext()) {
-			string str = inst->GetAscii();
-			const string replace = "\\|";
-			if (str.find_first_of("|") != str.npos) {
-				str.replace(str.find_first_of("|"), 1, replace);
-			}
-			dot_file << str /* inst->GetAscii() */;
-			if (inst->IsAluOp()) dot_file << " (A)\\n";
-			else if (inst->IsBranchOp()) dot_file << " (B)\\n";
-			else if (inst->IsLocalOp()) dot_file << " (L)\\n";
-			else if (inst->IsSharedOp()) dot_file << " (S)\\n";
-			else if (inst->IsGlobalOp()) dot_file << " (G)\\n";
-			else if (inst->IsSyncOp()) dot_file << " (N)\\n";
-			else dot_file << "\\n";
-			dot_file << inst->cycles << "\\n";
-			inst = dynamic_cast<Instruction *> (inst->GetNext());
-		} 
-		//dot_file << inst->GetAscii() << "\\n"; 
-		dot_file << "\"];" << endl;
+		else
+			DotBlockLabel(dot_file, bb, cfg);
+		dot_file << "\"];" << '\n';
 	}
 
+	set< pair<string, string> > folded_edges;
 	for (BBListConstIter iter = cfg->BlocksBegin(); iter != cfg->BlocksEnd(); ++iter) {
-		BasicBlock *bb = *iter;
+		const BasicBlock *bb = *iter;
 		for (BBListConstIter succ_iter = bb->SuccBegin(); succ_iter != bb->SuccEnd(); ++succ_iter) {
-			BasicBlock *succ = *succ_iter;
-			dot_file << "\t struct" << bb->Id() << " -> struct" << succ->Id();
-			if (bb->IsLoopFooter() && succ->IsLoopHeader()) {
-				if (bb->Id() == succ->Id())
-					dot_file << " [dir=back]";
-			} 
-			dot_file << ";" << endl;
+			const BasicBlock *succ = *succ_iter;
+			map<const BasicBlock *, string>::const_iterator from = node.find(bb), to = node.find(succ);
+			if (from == node.end() && to == node.end()) {
+				dot_file << "\t struct" << bb->Id() << " -> struct" << succ->Id();
+				if (bb->IsLoopFooter() && succ->IsLoopHeader()) {
+					if (bb->Id() == succ->Id())
+						dot_file << " [dir=back]";
+				}
+				dot_file << ";" << '\n';
+				continue;
+			}
+
+			// edges into, out of and around a folded loop nest are drawn once
+			ostringstream src, dst;
+			if (from != node.end()) src << from->second; else src << "struct" << bb->Id();
+			if (to != node.end()) dst << to->second; else dst << "struct" << succ->Id();
+			if (src.str() == dst.str() || !folded_edges.insert(make_pair(src.str(), dst.str())).second)
+				continue;
+			dot_file << "\t " << src.str() << " -> " << dst.str() << ";" << '\n';
 		}
 	}
-	dot_file << "}" << endl;
+	dot_file << "}" << '\n';
 	dot_file.close();
 }
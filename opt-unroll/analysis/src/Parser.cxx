@@ -1,48 +1,28 @@
 #include "Parser.h"
 #include "Utils.h"
+#include "Stats.h"
+#include "ThreadPool.h"
 
 #include <cstdlib>
 #include <iostream>
 using namespace std;
 
 // Define the constant helper objects
-const string& Parser::_SENTINEL_ = "_SENTINEL_";
 const string& Parser::GLOBAL_OP_STR = "g[";
 const string& Parser::SHARED_OP_STR = "s[";
 const string& Parser::LOCAL_OP_STR = "l[";
-
-// todo: right now, all arithmetic instructions are classified as ALU ops,
-// and assigned equal number of cycles, but some ops like div take longer
-// than others - so we need to classify those ops separately to get better results
-string Parser::alu_opcs[] = {
-	"add", "sub", "addc", "subc", "mul", "mad", "mul24", "mad24", "sad", "div", "rem", "subr", \
-	"abs", "neg", "min", "max", "pre", "ex2", /* Integer arithmetic instructions */ \
-	"set", "setp", "selp", "slct", /* Compare and set instructions */ \
-	"and", "or", "xor", "not", "cnot", "shl", "shr", /* Logical and shift instructions */ \
-	"rcp", "sqrt", "rsqrt", "sin", "cos", "lg2", "ex2" /* FP instructions */ \
-	"trap", "brkpt", "nop", "join", /* Misc instructions */
-	_SENTINEL_ /* Sentinel */
-};
-
-string Parser::branch_opcs[] = {
-	"bra", "call", "ret", "exit", "return", _SENTINEL_ /* CF instructions */
-};
-
-string Parser::mem_opcs[] = {
-	"mov", "ld", "st", "cvt", "tex", "movsh", _SENTINEL_ /* Mem instructions */
-};
-
-string Parser::sync_opcs[] = {
-	"bar", "atom", "red", "vote", /*"join",*/ _SENTINEL_ /* Synchronization operations */
-};
+const string& Parser::CONST_OP_STR = "c[";
 
 // Initialize the fields
 Parser::Parser(Reader *r)
-: reader(r), done(false), end(false) {}
+: reader(r), done(false), end(false), label_active(false), current_label(0), linenum(0),
+	selector(0), index(0), next_entry(0), entry_pending(false) {}
 
 // Copy ctor
 Parser::Parser(const Parser& p)
-: reader(p.reader), done(p.done), end(p.end) {}
+: reader(p.reader), done(p.done), end(p.end), label_active(p.label_active), current_label(p.current_label),
+	linenum(p.linenum), selector(p.selector), index(p.index), next_entry(p.next_entry),
+	entry_pending(p.entry_pending) {}
 
 Parser::~Parser()
 {
@@ -55,30 +35,19 @@ Parser::~Parser()
 // kernel, thereby transforming the ptx text into an in-memory representation
 Statement * Parser::Parse()
 {
-	// We need to handle labels specially, since a label definition and
-	// the succeeding instruction both appear on the same line (in decuda o/p)
-	static bool label_active = false;
-	static Label *current_label = 0;
-
-	static unsigned linenum = 0;
-
+	TIME_PHASE(PHASE_PARSE);
 	Assert(!done, "No more lines to parse");
 
 	// Special handling of labels
 	if (label_active) {
 		label_active = false;
 		// check if we have an instruction in the same buffer
-		if (Parser::IsInstruction(buffer)) {
-			Instruction *tmp = Instruction::CreateInstruction(buffer, linenum);	
-			tmp->SetIsBranchTarget();
-			current_label->SetNextInst(tmp);
-			current_label = 0;
-			return tmp;
-		}
+		Instruction *tmp = Parser::ParseLabelTarget(buffer, linenum, current_label);
+		current_label = 0;
+		if (tmp) return tmp;
 	}
 
-	end = !(reader->NextLine(buffer));
-	linenum = reader->GetLineNum();
+	NextBuffer();
 
 #ifdef DEBUG
 	cout << buffer << endl;
@@ -91,112 +60,341 @@ Statement * Parser::Parse()
 	}
 #endif
 
-	if (Parser::IsComment(buffer)) {
-		if (buffer.find_first_of("{") != buffer.npos) {
-			paren_stack.push(1);
-		}
-		else if (buffer.find_first_of("}") != buffer.npos) {
-			paren_stack.pop();
-			if (paren_stack.empty()) {
-				// we've reached the end of the kernel
-				done = true;
-			}
-		}
+	if (Parser::IsComment(buffer))
+		TrackBraces();
+
+	Statement *stmt = Parser::ParseBuffer(buffer, linenum, kernel_name);
+	if (IsA<Label *>(stmt)) {
+		// cache the label so that we can set the target instruction
+		// when we parse it
+		label_active = true;
+		current_label = dynamic_cast<Label *>(stmt);
+	}
+	return stmt;
+}
+
+// Create the statement for a line of the kernel, stripping any inline
+// comment off the buffer. The name of the kernel is noted when the line is
+// its .entry directive. The rest of a label line is left to
+// ParseLabelTarget()
+Statement * Parser::ParseBuffer(string& buf, unsigned line, string& entry_name)
+{
+	if (Parser::IsComment(buf)) {
 		// We should be returning Comment objects here
-		return Directive::CreateDirective(buffer, linenum);
+		return Directive::CreateDirective(buf, line);
 	}
 
-	if (Parser::HasInlineComment(buffer)) {
-		Parser::StripInlineComment(buffer);
+	if (Parser::HasInlineComment(buf)) {
+		Parser::StripInlineComment(buf);
 	}
 
-	if (Parser::IsLabel(buffer)) {
-		label_active = true;
-		Label *tmp = Label::CreateLabel(GetLabelBuffer(buffer), linenum);
-		// cache the label so that we can set the target instruction
-		// when we parse it
-		current_label = tmp;
-		return tmp;
+	if (Parser::IsLabel(buf)) {
+		return Label::CreateLabel(GetLabelBuffer(buf), line);
 	}
-	else if (Parser::IsDirective(buffer)) {
-		// if this is an entry directive, display the kernel name
-		if (buffer.find("entry") == 1) {
-			cout << "Processing kernel: " << buffer.substr(buffer.find_first_of(" ") + 1) << endl;
-			cout << "----------------------------------" << endl;
+	else if (Parser::IsDirective(buf)) {
+		// if this is an entry directive, note the kernel name
+		if (Parser::IsEntry(buf)) {
+			entry_name = Parser::GetEntryName(buf);
 		}
-		return Directive::CreateDirective(buffer, linenum);
+		return Directive::CreateDirective(buf, line);
 	}
 	// if it's not a label or a directive, it has to be an instr
-	else {
-		Assert(Parser::IsInstruction(buffer), "Unknown Statement object seen");
-		return Instruction::CreateInstruction(buffer, linenum);
-	}
-	return 0;
+	Assert(Parser::IsInstruction(buf), "Unknown Statement object seen");
+	return Instruction::CreateInstruction(buf, line);
 }
 
-bool Parser::HasInlineComment(const string& str)
+// The instruction that follows a label definition on the same line, if
+// any, bound to the label as its target
+Instruction * Parser::ParseLabelTarget(const string& buf, unsigned line, Label *label)
 {
-	return (str.find("//") != str.npos);
+	if (!Parser::IsInstruction(buf)) return 0;
+	Instruction *tmp = Instruction::CreateInstruction(buf, line);
+	tmp->SetIsBranchTarget();
+	label->SetNextInst(tmp);
+	return tmp;
 }
 
-void Parser::StripInlineComment(string& str)
+// A run of whole lines of a kernel, parsed on a worker into the statements
+// Parse() would return for them, in the same order
+class ParseChunk : public Task
 {
-	Assert(Parser::HasInlineComment(str), "Expecting inline comment, but found none");
-	str = str.substr(0, str.find_first_of("//"));
+	public:
+	ParseChunk() : at_end(false) {}
+	inline void Add(const string& line, unsigned n) {lines.push_back(line); linenums.push_back(n);}
+	inline unsigned Size() const {return lines.size();}
+	void Run();
+	void Discard();
+
+	vector <string> lines;
+	vector <unsigned> linenums;
+	// the input ends with the last line, and Construct() stops there: a
+	// label on it goes without its instruction
+	bool at_end;
+
+	vector <Statement *> stmts;
+	string entry_name;
+};
+
+// A line that does not parse fails the chunk, see Task::Execute()
+void ParseChunk::Run()
+{
+	for (unsigned i = 0; i < lines.size(); ++i) {
+		Statement *stmt = Parser::ParseBuffer(lines[i], linenums[i], entry_name);
+		stmts.push_back(stmt);
+		Label *label = dynamic_cast<Label *>(stmt);
+		if (label && !(at_end && i + 1 == lines.size())) {
+			Instruction *target = Parser::ParseLabelTarget(lines[i], linenums[i], label);
+			if (target) stmts.push_back(target);
+		}
+	}
+	// the statements have their own copies of the text
+	vector<string>().swap(lines);
 }
 
-// Given an instruction string, count the number of operands
-const unsigned Parser::ParseOpCount(const string& str)
+void ParseChunk::Discard()
 {
-	unsigned spaces = 0, index = 0;
-	while ((index = str.find_first_of(SPACE_CHAR, index + 1)) != (unsigned) str.npos) {
-		++spaces;
+	for (unsigned i = 0; i < stmts.size(); ++i)
+		delete stmts[i];
+	stmts.clear();
+}
+
+// Parse the rest of the kernel on several threads. This thread reads the
+// lines and tracks the braces, as Parse() does, to find the end of the
+// kernel; every PARSE_CHUNK_LINES lines are handed to a worker, and the
+// last chunk is parsed here. A label and its instruction are always on the
+// same line, so the chunks are independent of each other. Stitching them
+// together is just taking their statements in order; Construct() links the
+// instructions and binds the branches to their labels, as it does for
+// Parse(). At most a few chunks per thread are in flight, to bound the
+// lines held in memory. The first error in the kernel is the one thrown
+void Parser::ParseChunks(vector<Statement *>& stmts, unsigned nthreads)
+{
+	TIME_PHASE(PHASE_PARSE);
+	Assert(!done && !label_active, "No more lines to parse");
+
+	vector <ParseChunk *> chunks;
+	ThreadPool *pool = 0;
+	try {
+		ParseChunk *chunk = new ParseChunk();
+		chunks.push_back(chunk);
+		unsigned in_flight = 0;
+		while (!Done()) {
+			NextBuffer();
+			chunk->Add(buffer, linenum);
+			if (Parser::IsComment(buffer))
+				TrackBraces();
+			if (chunk->Size() == PARSE_CHUNK_LINES && !Done()) {
+				if (pool == 0) pool = new ThreadPool(nthreads);
+				if (in_flight == PARSE_CHUNKS_PER_THREAD * nthreads) {
+					pool->Wait();
+					in_flight = 0;
+				}
+				pool->Submit(chunk);
+				++in_flight;
+				chunk = new ParseChunk();
+				chunks.push_back(chunk);
+			}
+		}
+		chunk->at_end = end;
+		chunk->Execute();
+		if (pool) pool->Wait();
+	} catch (...) {
+		// let the workers finish with the chunks before they go away
+		delete pool;
+		for (unsigned c = 0; c < chunks.size(); ++c) {
+			chunks[c]->Discard();
+			delete chunks[c];
+		}
+		throw;
 	}
-	return spaces;
+	delete pool;
+
+	string message;
+	for (unsigned c = 0; c < chunks.size() && message.empty(); ++c) {
+		if (chunks[c]->Failed()) message = chunks[c]->GetMessage();
+	}
+	for (unsigned c = 0; c < chunks.size(); ++c) {
+		ParseChunk *chunk = chunks[c];
+		if (message.empty()) {
+			stmts.insert(stmts.end(), chunk->stmts.begin(), chunk->stmts.end());
+			if (!chunk->entry_name.empty()) kernel_name = chunk->entry_name;
+		}
+		else {
+			chunk->Discard();
+		}
+		delete chunk;
+	}
+	Assert(message.empty(), message);
 }
 
-// Given an instruction string, check if it is a global operation
-bool Parser::IsGlobalOp(const string& buf)
+// Fill the buffer with the next line, unless NextKernel() has read the
+// .entry line already
+void Parser::NextBuffer()
 {
-	return FindOpInBuffer(Parser::GLOBAL_OP_STR, buf);
+	if (entry_pending) {
+		entry_pending = false;
+		return;
+	}
+	end = !(reader->NextLine(buffer));
+	linenum = reader->GetLineNum();
 }
 
-// Given an instruction string, check if it is a shared operation
-bool Parser::IsSharedOp(const string& buf)
+// Match the braces on a comment line; the kernel is done when the
+// outermost one closes
+void Parser::TrackBraces()
 {
-	return (FindOpInBuffer(Parser::SHARED_OP_STR, buf) ||
-				 FindOpInBuffer("movsh", buf));
+	if (buffer.find_first_of("{") != buffer.npos) {
+		paren_stack.push(1);
+	}
+	else if (buffer.find_first_of("}") != buffer.npos) {
+		paren_stack.pop();
+		if (paren_stack.empty()) {
+			// we've reached the end of the kernel
+			done = true;
+		}
+	}
 }
 
-// Given an instruction string, check if it is a local operation
-bool Parser::IsLocalOp(const string& buf)
+// The streaming counterpart of Parse(): read the rest of the kernel and
+// fold each instruction into the counts as it goes by. No statements are
+// created and nothing is kept, so memory use does not grow with the input
+void Parser::CountKernel(InstCounts& counts, OpcodeHistogram *opcodes)
 {
-	return FindOpInBuffer(Parser::LOCAL_OP_STR, buf);
+	TIME_PHASE(PHASE_PARSE);
+
+	while (!Done()) {
+		NextBuffer();
+
+		if (Parser::IsComment(buffer)) {
+			TrackBraces();
+			continue;
+		}
+		if (Parser::HasInlineComment(buffer)) {
+			Parser::StripInlineComment(buffer);
+		}
+
+		if (Parser::IsLabel(buffer)) {
+			if (Parser::IsInstruction(buffer))
+				Parser::CountInstruction(buffer, counts, opcodes);
+		}
+		else if (Parser::IsDirective(buffer)) {
+			if (Parser::IsEntry(buffer))
+				kernel_name = Parser::GetEntryName(buffer);
+		}
+		else {
+			Assert(Parser::IsInstruction(buffer), "Unknown Statement object seen");
+			Parser::CountInstruction(buffer, counts, opcodes);
+		}
+	}
 }
 
-// Todo: Clean this up later
-bool Parser::IsRet(const string& buf)
+// Classify an instruction the way Instruction::Classify() does, as far
+// as the counts go
+void Parser::CountInstruction(const string& instbuf, InstCounts& counts, OpcodeHistogram *opcodes)
 {
-	return (buf.find("ret") != buf.npos);
+	const InstCode code = Parser::ParseCode(instbuf);
+	if (opcodes) opcodes->Add(code);
+	switch (CodeClass(code)) {
+		case OPR_ALU:
+			++counts.alu;
+			break;
+		case OPR_COND_BRANCH:
+		case OPR_BRANCH:
+			++counts.branch;
+			break;
+		case OPR_MEM:
+			if (CodeSpace(code) == STATE_GLOBAL) ++counts.global;
+			else if (CodeSpace(code) == STATE_SHARED) ++counts.shared;
+			else ++counts.local;
+			break;
+		case OPR_SYNC:
+			++counts.sync;
+			break;
+		default:
+			Assert(false, "Invalid opcode");
+	}
 }
 
-bool Parser::IsCall(const string& buf)
+// Only analyze the kernels the selector picks. With an index, the reader
+// seeks straight to them; otherwise the kernels in between are skipped
+// by matching braces
+void Parser::Select(const KernelSelector *sel, const KernelIndex *idx)
 {
-	return (buf.find("call") != buf.npos);
+	selector = (sel && !sel->IsEmpty()) ? sel : 0;
+	index = idx;
+	next_entry = 0;
 }
 
-// Search for a given key in the given string
-bool Parser::FindOpInBuffer(const string& key, const string& buf)
+// Move on to the next kernel to analyze. Returns false if none is left
+bool Parser::NextKernel()
 {
-	unsigned op_count = ParseOpCount(buf);
-	for (unsigned i = 0; i < op_count; ++i) {
-		string operand = Parser::GetOperandAt(buf, i);
-		if (operand.find(key) != operand.npos) 
+	if (!selector) return !end;
+
+	if (index) {
+		for (; next_entry < index->GetNumEntries(); ++next_entry) {
+			const KernelOffset& entry = index->GetEntry(next_entry);
+			if (!selector->Matches(entry.name)) continue;
+			reader->Seek(entry.offset, entry.line - 1);
+			end = !(reader->NextLine(buffer));
+			linenum = reader->GetLineNum();
+			Assert(Parser::IsEntry(buffer), "Stale kernel index, no .entry at line " << entry.line);
+			++next_entry;
+			entry_pending = true;
 			return true;
+		}
+		end = true;
+		return false;
+	}
+
+	while (!end) {
+		end = !(reader->NextLine(buffer));
+		linenum = reader->GetLineNum();
+		if (!Parser::IsEntry(buffer)) continue;
+		if (selector->Matches(Parser::GetEntryName(buffer))) {
+			entry_pending = true;
+			return true;
+		}
+		if (!end) end = !(reader->SkipBlock());
 	}
 	return false;
 }
 
+bool Parser::IsEntry(const string& str)
+{
+	return (str.compare(0, 6, ".entry") == 0);
+}
+
+// The name of the kernel an .entry line starts. Lines read raw, when
+// skipping kernels or building an index, may still have a comment
+string Parser::GetEntryName(const string& str)
+{
+	string entry = str;
+	if (Parser::HasInlineComment(entry))
+		Parser::StripInlineComment(entry);
+	return entry.substr(entry.find_first_of(" ") + 1);
+}
+
+bool Parser::HasInlineComment(const string& str)
+{
+	return (str.find("//") != str.npos);
+}
+
+void Parser::StripInlineComment(string& str)
+{
+	Assert(Parser::HasInlineComment(str), "Expecting inline comment, but found none");
+	str = str.substr(0, str.find_first_of("//"));
+}
+
+// Given an instruction string, count the number of operands
+const unsigned Parser::ParseOpCount(const string& str)
+{
+	unsigned spaces = 0, index = 0;
+	while ((index = str.find_first_of(SPACE_CHAR, index + 1)) != (unsigned) str.npos) {
+		++spaces;
+	}
+	return spaces;
+}
+
 // Given an instruction string and an index, return the operand
 // at the index. For example if buf == "add $r1, $r2, $r3", and
 // index == 0, then GetOperandAt, returns "$r1"
@@ -216,48 +414,55 @@ string Parser::GetOperandAt(const string& buf, unsigned index)
 	return buf.substr(op_start, (op_end - op_start));
 }
 
-// Given an instruction string, figure out what the opcode is
-Opcode Parser::ParseOpCode(const string& buf)
+// Given an instruction string, decode its opcode: the mnemonic, the
+// modifiers and, when no modifier gives it, the state space of its memory
+// operand. See Opcodes.h
+InstCode Parser::ParseCode(const string& buf)
 {
+	const char *str = buf.c_str();
+	unsigned pos = (Parser::IsLabel(buf)) ? Parser::GetInstPos(buf) : 0;
 	bool predicated = false;
-	string opcode = (Parser::IsLabel(buf)) ? Parser::GetInstructionBufferFromLabel(buf) : buf;
 
-	if (opcode[0] == AT_CHAR) {
+	if (str[pos] == AT_CHAR) {
 		// this is a predicated instruction, find the actual opcode
-		opcode = opcode.substr(opcode.find_first_of(SPACE_CHAR) + 1, opcode.size());
+		pos = buf.find_first_of(SPACE_CHAR, pos) + 1;
 		predicated = true;
 	}
-	opcode = opcode.substr(0, opcode.find_first_of(SPACE_CHAR));
-	opcode = opcode.substr(0, opcode.find_first_of(DOT_CHAR));
+	unsigned end = buf.find_first_of(SPACE_CHAR, pos);
+	if (end == (unsigned) buf.npos) end = buf.size();
 
 	// handle buggy decuda output
-	if (opcode.find('?') != opcode.npos)
-		opcode = opcode.substr(0, opcode.find_first_of('?'));
-
-	//if (opcode[0] == AT_CHAR) {
-		// we're seeing a predicate based branch instr
-		//return OPR_COND_BRANCH;
-	//}
-
-	if (Parser::SearchOpcode(opcode, alu_opcs))
-		return OPR_ALU;
-
-	if (Parser::SearchOpcode(opcode, branch_opcs)) {
-		if (predicated) 
-			return OPR_COND_BRANCH;
-		return OPR_BRANCH;
+	unsigned len = pos;
+	while (len < end && str[len] != DOT_CHAR && str[len] != '?') ++len;
+	Mnemonic mnemonic = LookupMnemonic(str + pos, len - pos);
+	if (mnemonic == MN_INVALID) {
+		string msg("Invalid opcode: ");
+		msg += buf.substr(pos, len - pos);
+		Assert(false, msg);
 	}
 
-	if (Parser::SearchOpcode(opcode, mem_opcs))
-		return OPR_MEM;
-
-	if (Parser::SearchOpcode(opcode, sync_opcs))
-		return OPR_SYNC;
+	OperandType type = TYPE_NONE;
+	StateSpace space = STATE_NONE;
+	VectorWidth vector = VEC_NONE;
+	for (unsigned mod = len; mod < end && str[mod] == DOT_CHAR; ) {
+		unsigned next = mod + 1;
+		while (next < end && str[next] != DOT_CHAR) ++next;
+		const char *modifier = str + mod + 1;
+		unsigned size = next - mod - 1;
+		if (type == TYPE_NONE) type = LookupType(modifier, size);
+		if (space == STATE_NONE) space = LookupSpace(modifier, size);
+		if (size == 2 && modifier[0] == 'v' && modifier[1] == '2') vector = VEC_V2;
+		if (size == 2 && modifier[0] == 'v' && modifier[1] == '4') vector = VEC_V4;
+		mod = next;
+	}
 
-	string msg("Invalid opcode: ");
-	msg += opcode;
-	Assert(false, msg);
-	return OPR_INVALID;
+	if (space == STATE_NONE) {
+		if (buf.find(GLOBAL_OP_STR, end) != buf.npos) space = STATE_GLOBAL;
+		else if (buf.find(SHARED_OP_STR, end) != buf.npos) space = STATE_SHARED;
+		else if (buf.find(LOCAL_OP_STR, end) != buf.npos) space = STATE_LOCAL;
+		else if (buf.find(CONST_OP_STR, end) != buf.npos) space = STATE_CONST;
+	}
+	return MakeCode(mnemonic, type, space, vector, predicated);
 }
 
 // Given a branch instruction or a label, figure out what the label
@@ -275,18 +480,6 @@ unsigned Parser::ParseLabelNumber(const string& buf)
 	return atoi(tmp.c_str());
 }
 
-// Given a key opcode and an array of possible opcodes, check if
-// the key opcode belongs to the array.
-bool Parser::SearchOpcode(const string& opc, string opc_list[])
-{
-	unsigned i = 0;
-	while (opc_list[i] != _SENTINEL_) {
-		if (opc == opc_list[i++])
-			return true;
-	}
-	return false;
-}
-
 // Again, special handling of labels. A single ptx string could contain
 // the label definition, followed by the target instruction. Return the
 // instruction that sits beyond the label definition
@@ -364,19 +557,26 @@ bool Parser::IsDirective(const string& str)
 	return false;
 }
 
-void Parser::ParseMemOp(const string& str, MemOp& optype)
+// Whether a memory op loads or stores: the memory operand comes first in a
+// store. Failing that, ld loads and st stores
+void Parser::ParseMemOp(const string& str, InstCode code, MemOp& optype)
 {
 	unsigned count = ParseOpCount(str);
 	string op_str;
 
-	if (IsGlobalOp(str)) 
-		op_str = GLOBAL_OP_STR;
-	else if (IsSharedOp(str))
-		op_str = SHARED_OP_STR;
-	else if (IsLocalOp(str)){
-		op_str = LOCAL_OP_STR;
+	switch (CodeSpace(code)) {
+		case STATE_GLOBAL:
+			op_str = GLOBAL_OP_STR;
+			break;
+		case STATE_SHARED:
+			op_str = SHARED_OP_STR;
+			break;
+		case STATE_LOCAL:
+			op_str = LOCAL_OP_STR;
+			break;
+		default:
+			return;
 	}
-	else return;
 
 	for (unsigned i = 0; i < count; ++i) {
 		string tmp = GetOperandAt(str, i);
@@ -391,6 +591,8 @@ void Parser::ParseMemOp(const string& str, MemOp& optype)
 			return;
 		}
 	}
+	if (CodeMnemonic(code) == MN_LD) optype = MEM_LOAD;
+	else if (CodeMnemonic(code) == MN_ST) optype = MEM_STORE;
 }
 
 void Parser::ParseRegs(const string& buf, int& dst, int& src0, int& src1, int& src2)
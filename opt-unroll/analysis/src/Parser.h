@@ -3,8 +3,10 @@
 
 #include "Statement.h"
 #include "Reader.h"
+#include "KernelIndex.h"
 #include <string>
 #include <stack>
+#include <vector>
 using namespace std;
 
 // This parser is very simple. It just needs to parse
@@ -21,6 +23,11 @@ using namespace std;
 // malfunction on) ptx generated by nvcc - this will be fixed
 // in the future
 
+// Very large kernels can also be parsed on several threads, a chunk
+// of lines at a time (see ParseChunks()), into the same statements
+#define PARSE_CHUNK_LINES 16384
+#define PARSE_CHUNKS_PER_THREAD 4
+
 class Parser
 {
 	public:
@@ -30,18 +37,20 @@ class Parser
 	Statement * Parse();
 	inline bool HasMoreKernels() const {return !end;}
 	inline bool Done() const {return (done || end);}
-	inline void Reinit() {done = false;}
+	inline void Reinit() {done = false; kernel_name.clear();}
+	inline const string& GetKernelName() const {return kernel_name;}
+	void Select(const KernelSelector *, const KernelIndex * = 0);
+	bool NextKernel();
+	void CountKernel(InstCounts&, OpcodeHistogram * = 0);
+	void ParseChunks(vector<Statement *>&, unsigned);
 
 	// A bunch of static convenience routines to help the other
 	// classes parse strings of information. These could possibly
 	// be made global, but logically, they belong here
 	static const unsigned ParseOpCount(const string&);
-	static Opcode ParseOpCode(const string&);
-	static bool SearchOpcode(const string&, string[]);
-	static bool IsGlobalOp(const string&);
-	static bool IsSharedOp(const string&);
-	static bool IsLocalOp(const string&);
-	static bool FindOpInBuffer(const string&, const string&);
+	static InstCode ParseCode(const string&);
+	static Statement * ParseBuffer(string&, unsigned, string&);
+	static Instruction * ParseLabelTarget(const string&, unsigned, Label *);
 	static string GetOperandAt(const string&, unsigned);
 	static const unsigned GetInstPos(const string&);
 	static string GetInstructionBufferFromLabel(const string&);
@@ -50,31 +59,43 @@ class Parser
 	static bool IsInstruction(const string&);
 	static bool IsLabel(const string&);
 	static bool IsDirective(const string&);
-	static bool IsRet(const string&);
-	static bool IsCall(const string&);
+	static bool IsEntry(const string&);
+	static void CountInstruction(const string&, InstCounts&, OpcodeHistogram * = 0);
+	static string GetEntryName(const string&);
 	static unsigned ParseLabelNumber(const string&);
 	static bool HasInlineComment(const string&);
 	static void StripInlineComment(string&);
-	static void ParseMemOp(const string&, MemOp&);
+	static void ParseMemOp(const string&, InstCode, MemOp&);
 	static void ParseRegs(const string&, int&, int&, int&, int&);
 
-	// Arrays of ptx opcodes, essential for classifying instructions
-	static string alu_opcs[];
-	static string branch_opcs[];
-	static string mem_opcs[];
-	static string sync_opcs[];
-
 	// A few constant helper objects
-	static const string& _SENTINEL_;
 	static const string& GLOBAL_OP_STR;
 	static const string& SHARED_OP_STR;
 	static const string& LOCAL_OP_STR;
+	static const string& CONST_OP_STR;
 
 	private:
+	void TrackBraces();
+	void NextBuffer();
+
 	Reader *reader;
 	bool done, end;
 	string buffer;
+	string kernel_name;
 	stack <int> paren_stack;
+
+	// We need to handle labels specially, since a label definition and
+	// the succeeding instruction both appear on the same line (in decuda o/p)
+	bool label_active;
+	Label *current_label;
+	unsigned linenum;
+
+	// With a selector, kernels it does not pick are skipped unparsed. The
+	// .entry line of the next kernel picked is already in the buffer
+	const KernelSelector *selector;
+	const KernelIndex *index;
+	unsigned next_entry;
+	bool entry_pending;
 };
 
 #endif
@@ -0,0 +1,346 @@
+#include "PtxAnalyze.h"
+#include "Kernel.h"
+#include "Parser.h"
+#include "Reader.h"
+#include "Emitter.h"
+#include "Utils.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// A kernel of a loaded module. The loops are looked up by id once the CFG
+// is built, and again after the warps or the unroll factors change
+class ModuleKernel
+{
+	public:
+	ModuleKernel(Kernel *k) : kernel(k), loops_valid(false) {}
+	~ModuleKernel() {delete kernel;}
+
+	Kernel *kernel;
+	string name;
+	vector <unsigned> factors;
+	vector <const Loop *> loops;
+	bool loops_valid;
+};
+
+struct ptxa_module
+{
+	~ptxa_module()
+	{
+		for (unsigned i = 0; i < kernels.size(); ++i)
+			delete kernels[i];
+	}
+
+	vector <ModuleKernel *> kernels;
+	// the cycle model reports the loops as it goes; nobody reads that here
+	Emitter scratch;
+};
+
+static __thread char last_error[256];
+
+static ptxa_status Fail(ptxa_status status, const string& message)
+{
+	strncpy(last_error, message.c_str(), sizeof(last_error) - 1);
+	last_error[sizeof(last_error) - 1] = '\0';
+	return status;
+}
+
+// Every entry point turns the exceptions of the analysis into a status
+#define PTXA_TRY try {
+#define PTXA_CATCH																											\
+	} catch (IOException& ioe) {																					\
+		return Fail(PTXA_ERR_IO, "Input file not found");										\
+	} catch (exception& e) {																							\
+		return Fail(PTXA_ERR_ANALYSIS, e.what());														\
+	} catch (...) {																												\
+		return Fail(PTXA_ERR_ANALYSIS, "Driver aborted");										\
+	}
+
+// Reports written while a query computes its analyses go to the module's
+// scratch emitter, and are dropped when the query is done
+class ScratchOutput
+{
+	public:
+	ScratchOutput(ptxa_module *m) : module(m) {SetOutput(&module->scratch);}
+	~ScratchOutput() {module->scratch.Clear(); SetOutput(0);}
+
+	private:
+	ptxa_module *module;
+};
+
+static ptxa_status Load(Reader *rdr, ptxa_module **module)
+{
+	ptxa_module *mod = new ptxa_module();
+	try {
+		ScratchOutput scope(mod);
+		// the kernels keep their statements; the parser is only needed
+		// while they are constructed
+		Parser parser(rdr);
+		while (parser.HasMoreKernels()) {
+			parser.Reinit();
+			if (!parser.NextKernel()) break;
+			ModuleKernel *mk = new ModuleKernel(new Kernel(&parser));
+			mod->kernels.push_back(mk);
+			mk->kernel->Construct();
+			// the name is known once the .entry has been parsed
+			mk->name = parser.GetKernelName();
+		}
+	} catch (...) {
+		delete mod;
+		throw;
+	}
+	*module = mod;
+	return PTXA_OK;
+}
+
+static ptxa_status Lookup(const ptxa_module *module, unsigned kernel, ModuleKernel *& mk)
+{
+	if (module == 0 || kernel >= module->kernels.size())
+		return Fail(PTXA_ERR_ARGUMENT, "No such kernel");
+	mk = module->kernels[kernel];
+	return PTXA_OK;
+}
+
+// The loops of the kernel by id, building the CFG if need be
+static const vector<const Loop *>& Loops(ModuleKernel *mk)
+{
+	if (mk->loops_valid) return mk->loops;
+
+	mk->kernel->Require(ANALYSIS_LOOPS);
+	const CFG *cfg = mk->kernel->GetCFG();
+	mk->loops.assign(cfg->GetNumLoops(), 0);
+	vector <const Loop *> pending(cfg->LoopsBegin(), cfg->LoopsEnd());
+	while (!pending.empty()) {
+		const Loop *loop = pending.back();
+		pending.pop_back();
+		Assert(loop->Id() < mk->loops.size(), "Loop id out of range");
+		mk->loops[loop->Id()] = loop;
+		if (loop->HasInnerLoops())
+			pending.insert(pending.end(), loop->InnerLoopsBegin(), loop->InnerLoopsEnd());
+	}
+	if (mk->factors.size() != mk->loops.size())
+		mk->factors.assign(mk->loops.size(), 1);
+	mk->loops_valid = true;
+	return mk->loops;
+}
+
+static ptxa_status LookupLoop(ModuleKernel *mk, unsigned loop, const Loop *& l)
+{
+	const vector<const Loop *>& loops = Loops(mk);
+	if (loop >= loops.size())
+		return Fail(PTXA_ERR_ARGUMENT, "No such loop");
+	l = loops[loop];
+	return PTXA_OK;
+}
+
+static void GetCounts(const InstCounts& from, ptxa_counts *to)
+{
+	to->alu = from.alu;
+	to->global = from.global;
+	to->shared = from.shared;
+	to->local = from.local;
+	to->branch = from.branch;
+	to->sync = from.sync;
+	to->total = from.GetTotal();
+}
+
+unsigned ptxa_version(void)
+{
+	return PTXA_API_VERSION;
+}
+
+const char * ptxa_last_error(void)
+{
+	return last_error;
+}
+
+ptxa_status ptxa_load(const char *data, size_t size, const char *name, ptxa_module **module)
+{
+	if (module == 0 || (data == 0 && size != 0))
+		return Fail(PTXA_ERR_ARGUMENT, "No ptx to load");
+	PTXA_TRY
+		Reader rdr(name ? name : "<buffer>", new istringstream(string(data ? data : "", size)));
+		return Load(&rdr, module);
+	PTXA_CATCH
+}
+
+ptxa_status ptxa_load_file(const char *path, ptxa_module **module)
+{
+	if (module == 0 || path == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No ptx file to load");
+	PTXA_TRY
+		Reader rdr(path);
+		return Load(&rdr, module);
+	PTXA_CATCH
+}
+
+void ptxa_free(ptxa_module *module)
+{
+	delete module;
+}
+
+unsigned ptxa_num_kernels(const ptxa_module *module)
+{
+	return module ? module->kernels.size() : 0;
+}
+
+const char * ptxa_kernel_name(const ptxa_module *module, unsigned kernel)
+{
+	if (module == 0 || kernel >= module->kernels.size()) return 0;
+	return module->kernels[kernel]->name.c_str();
+}
+
+ptxa_status ptxa_find_kernel(const ptxa_module *module, const char *name, unsigned *kernel)
+{
+	if (module == 0 || name == 0 || kernel == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No kernel name");
+	for (unsigned i = 0; i < module->kernels.size(); ++i) {
+		if (module->kernels[i]->name == name) {
+			*kernel = i;
+			return PTXA_OK;
+		}
+	}
+	return Fail(PTXA_ERR_ARGUMENT, string("No kernel named ") + name);
+}
+
+ptxa_status ptxa_set_warps(ptxa_module *module, unsigned kernel, unsigned warps)
+{
+	ModuleKernel *mk;
+	if (Lookup(module, kernel, mk) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+	if (warps == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No warps");
+	PTXA_TRY
+		mk->kernel->SetNumWarps(warps);
+		mk->kernel->Invalidate();
+		mk->loops_valid = false;
+		return PTXA_OK;
+	PTXA_CATCH
+}
+
+ptxa_status ptxa_set_unroll(ptxa_module *module, unsigned kernel, unsigned loop, unsigned factor)
+{
+	ModuleKernel *mk;
+	const Loop *l;
+	if (Lookup(module, kernel, mk) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+	PTXA_TRY
+		ScratchOutput scope(module);
+		if (LookupLoop(mk, loop, l) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+		if (mk->factors[loop] == factor) return PTXA_OK;
+		mk->factors[loop] = factor;
+		mk->kernel->SetUnrollFactors(mk->factors);
+		mk->loops_valid = false;
+		return PTXA_OK;
+	PTXA_CATCH
+}
+
+ptxa_status ptxa_kernel_counts(ptxa_module *module, unsigned kernel, ptxa_counts *counts)
+{
+	ModuleKernel *mk;
+	if (Lookup(module, kernel, mk) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+	if (counts == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No counts to fill in");
+	PTXA_TRY
+		GetCounts(mk->kernel->GetInstCounts(), counts);
+		return PTXA_OK;
+	PTXA_CATCH
+}
+
+ptxa_status ptxa_kernel_cycles(ptxa_module *module, unsigned kernel, unsigned long long *cycles,
+														unsigned long long *stall_cycles)
+{
+	ModuleKernel *mk;
+	if (Lookup(module, kernel, mk) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+	if (cycles == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No cycles to fill in");
+	PTXA_TRY
+		ScratchOutput scope(module);
+		*cycles = mk->kernel->CountCycles(0);
+		if (stall_cycles) *stall_cycles = mk->kernel->GetCFG()->GetStallCycles();
+		return PTXA_OK;
+	PTXA_CATCH
+}
+
+ptxa_status ptxa_num_loops(ptxa_module *module, unsigned kernel, unsigned *loops)
+{
+	ModuleKernel *mk;
+	if (Lookup(module, kernel, mk) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+	if (loops == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No loop count to fill in");
+	PTXA_TRY
+		ScratchOutput scope(module);
+		*loops = Loops(mk).size();
+		return PTXA_OK;
+	PTXA_CATCH
+}
+
+ptxa_status ptxa_loop_info(ptxa_module *module, unsigned kernel, unsigned loop, ptxa_loop *info)
+{
+	ModuleKernel *mk;
+	const Loop *l;
+	if (Lookup(module, kernel, mk) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+	if (info == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No loop info to fill in");
+	PTXA_TRY
+		ScratchOutput scope(module);
+		if (LookupLoop(mk, loop, l) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+		info->id = l->Id();
+		info->parent = l->GetEnclosingLoop() ? (int) l->GetEnclosingLoop()->Id() : -1;
+		info->depth = l->GetNestingLevel();
+		info->header_line = l->GetHeader()->GetFirstInst()->GetLineNum();
+		info->iterations = l->GetNumIters();
+		info->constant_trip = (l->GetTripKind() == TRIP_CONSTANT);
+		info->unroll_factor = mk->factors[loop];
+		return PTXA_OK;
+	PTXA_CATCH
+}
+
+// The instructions of the loop body, inner loops included, as -loopcounts
+// and -diff count them
+ptxa_status ptxa_loop_counts(ptxa_module *module, unsigned kernel, unsigned loop, ptxa_counts *counts)
+{
+	ModuleKernel *mk;
+	const Loop *l;
+	if (Lookup(module, kernel, mk) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+	if (counts == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No counts to fill in");
+	PTXA_TRY
+		ScratchOutput scope(module);
+		if (LookupLoop(mk, loop, l) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+		InstCounts loop_counts;
+		for (BBSetConstIter iter = l->NatLoopBegin(); iter != l->NatLoopEnd(); ++iter) {
+			const BasicBlock *bb = *iter;
+			for (const Instruction *inst = bb->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+				if (!inst->IsDeleted()) loop_counts.Add(inst);
+				if (inst == bb->GetLastInst()) break;
+			}
+		}
+		GetCounts(loop_counts, counts);
+		return PTXA_OK;
+	PTXA_CATCH
+}
+
+ptxa_status ptxa_loop_cycles(ptxa_module *module, unsigned kernel, unsigned loop, unsigned long long *cycles,
+														 unsigned long long *stall_cycles)
+{
+	ModuleKernel *mk;
+	const Loop *l;
+	if (Lookup(module, kernel, mk) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+	if (cycles == 0)
+		return Fail(PTXA_ERR_ARGUMENT, "No cycles to fill in");
+	PTXA_TRY
+		ScratchOutput scope(module);
+		if (LookupLoop(mk, loop, l) != PTXA_OK) return PTXA_ERR_ARGUMENT;
+		mk->kernel->CountCycles(0);
+		unsigned long long loop_cycles = l->GetCycles(), loop_stalls = l->GetStallCycles();
+		for (const Loop *outer = l->GetEnclosingLoop(); outer != 0; outer = outer->GetEnclosingLoop()) {
+			loop_cycles *= outer->GetNumIters();
+			loop_stalls *= outer->GetNumIters();
+		}
+		*cycles = loop_cycles;
+		if (stall_cycles) *stall_cycles = loop_stalls;
+		return PTXA_OK;
+	PTXA_CATCH
+}
@@ -0,0 +1,95 @@
+#ifndef _PTXANALYZE_H_INCLUDED_
+#define _PTXANALYZE_H_INCLUDED_
+
+#include <stddef.h>
+
+// The C interface of libptxanalyze, for tools that would otherwise run
+// ptx-analyze and parse its reports. A module is loaded once, from a buffer
+// or a file, and every kernel in it is parsed right away; queries after
+// that compute the analyses they need on demand and keep them, and setting
+// the warps or the unroll factors of a kernel only drops the analyses of
+// that kernel. The numbers are those of the reports: -counts, -loopinfo,
+// -cycles, and -unrolled for the unroll factors.
+//
+// Kernels are numbered in the order of their .entry directives, and the
+// loops of a kernel by their ids, the order of the factors in .uconf.
+//
+// The interface is stable: functions and fields are only ever added, at
+// the end of the structs, with PTXA_API_VERSION bumped. A module may be
+// used by one thread at a time; different modules may be used at once.
+// Every call returns a status, and the message of the last failure on
+// the calling thread is kept for ptxa_last_error()
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PTXA_API_VERSION 1
+
+typedef struct ptxa_module ptxa_module;
+
+typedef enum {
+	PTXA_OK = 0,
+	// the file could not be read
+	PTXA_ERR_IO,
+	// the ptx could not be parsed, or an analysis failed on it
+	PTXA_ERR_ANALYSIS,
+	// no such kernel or loop
+	PTXA_ERR_ARGUMENT
+} ptxa_status;
+
+typedef struct {
+	unsigned long alu, global, shared, local, branch, sync;
+	unsigned long total;
+} ptxa_counts;
+
+typedef struct {
+	unsigned id;
+	// the id of the enclosing loop, -1 for an outer loop
+	int parent;
+	unsigned depth;
+	// the line of the first instruction of the header block
+	unsigned header_line;
+	// the iterations the cycle model charges for, after the unroll factor
+	unsigned iterations;
+	// non-zero when the trip count was inferred from an induction variable
+	int constant_trip;
+	unsigned unroll_factor;
+} ptxa_loop;
+
+unsigned ptxa_version(void);
+const char * ptxa_last_error(void);
+
+// The name labels the module in error messages; it may be null
+ptxa_status ptxa_load(const char *data, size_t size, const char *name, ptxa_module **module);
+// gzip and zstd compressed files are read as ptx-analyze reads them
+ptxa_status ptxa_load_file(const char *path, ptxa_module **module);
+void ptxa_free(ptxa_module *module);
+
+unsigned ptxa_num_kernels(const ptxa_module *module);
+// null for a kernel out of range
+const char * ptxa_kernel_name(const ptxa_module *module, unsigned kernel);
+ptxa_status ptxa_find_kernel(const ptxa_module *module, const char *name, unsigned *kernel);
+
+// 32 warps unless set
+ptxa_status ptxa_set_warps(ptxa_module *module, unsigned kernel, unsigned warps);
+// The kernel was unrolled by the given factor for the loop, so the loop
+// runs that many times fewer iterations; 1 unless set, 0 skips the loop
+ptxa_status ptxa_set_unroll(ptxa_module *module, unsigned kernel, unsigned loop, unsigned factor);
+
+ptxa_status ptxa_kernel_counts(ptxa_module *module, unsigned kernel, ptxa_counts *counts);
+ptxa_status ptxa_kernel_cycles(ptxa_module *module, unsigned kernel, unsigned long long *cycles,
+														unsigned long long *stall_cycles);
+ptxa_status ptxa_num_loops(ptxa_module *module, unsigned kernel, unsigned *loops);
+ptxa_status ptxa_loop_info(ptxa_module *module, unsigned kernel, unsigned loop, ptxa_loop *info);
+ptxa_status ptxa_loop_counts(ptxa_module *module, unsigned kernel, unsigned loop, ptxa_counts *counts);
+// The cycles spent in the loop over the whole kernel, for every iteration
+// of the loops around it. The stall cycles may be null
+ptxa_status ptxa_loop_cycles(ptxa_module *module, unsigned kernel, unsigned loop, unsigned long long *cycles,
+														 unsigned long long *stall_cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#include "Generator.h"
+#include <cstdlib>
+#include <fstream>
+using namespace std;
+
+// Generate synthetic decuda-style ptx for testing and benchmarking
+// -instrs=<n> : instructions per kernel
+// -blocks=<n> : basic blocks per kernel (default: one per 16 instructions)
+// -kernels=<n> : number of kernels
+// -loops=<n> : loop nests per kernel
+// -depth=<n> : nesting depth of each loop nest
+// -branches=<f> : fraction of straight-line blocks ending in a forward branch
+// -global=<f>, -shared=<f>, -local=<f> : fraction of memory ops of each kind
+// -calls=<n> : call sites per kernel
+// -seed=<n> : seed of the random instruction mix
+// -o <file> : write to the file instead of stdout
+
+static void PrintUsage()
+{
+	cout << "Usage: ptx-gen [options]" << endl;
+	cout << "where options is one or more of: " << endl;
+	cout << " -instrs=<n>" << endl;
+	cout << " -blocks=<n>" << endl;
+	cout << " -kernels=<n>" << endl;
+	cout << " -loops=<n>" << endl;
+	cout << " -depth=<n>" << endl;
+	cout << " -branches=<fraction>" << endl;
+	cout << " -global=<fraction>" << endl;
+	cout << " -shared=<fraction>" << endl;
+	cout << " -local=<fraction>" << endl;
+	cout << " -calls=<n>" << endl;
+	cout << " -seed=<n>" << endl;
+	cout << " -o <file>" << endl;
+}
+
+int main(int argc, char **argv)
+{
+	GeneratorConfig config;
+	string output;
+
+	for (int i = 1; i < argc; ++i) {
+		string option = argv[i];
+		string value = (option.find('=') != option.npos) ? option.substr(option.find('=') + 1) : "";
+		if (option.find("-instrs=") == 0) config.instructions = strtoull(value.c_str(), 0, 10);
+		else if (option.find("-blocks=") == 0) config.blocks = atoi(value.c_str());
+		else if (option.find("-kernels=") == 0) config.kernels = atoi(value.c_str());
+		else if (option.find("-loops=") == 0) config.loops = atoi(value.c_str());
+		else if (option.find("-depth=") == 0) config.depth = atoi(value.c_str());
+		else if (option.find("-branches=") == 0) config.branches = atof(value.c_str());
+		else if (option.find("-global=") == 0) config.global_ops = atof(value.c_str());
+		else if (option.find("-shared=") == 0) config.shared_ops = atof(value.c_str());
+		else if (option.find("-local=") == 0) config.local_ops = atof(value.c_str());
+		else if (option.find("-calls=") == 0) config.calls = atoi(value.c_str());
+		else if (option.find("-seed=") == 0) config.seed = atoi(value.c_str());
+		else if (option == "-o" && i + 1 < argc) output = argv[++i];
+		else {
+			PrintUsage();
+			return -1;
+		}
+	}
+
+	Generator gen(config);
+	if (output.empty()) {
+		gen.Write(cout);
+		return 0;
+	}
+	ofstream file(output.c_str());
+	if (!file.good()) {
+		cerr << "Unable to write " << output << endl;
+		return -1;
+	}
+	gen.Write(file);
+	return 0;
+}
@@ -1,29 +1,71 @@
 #include "Reader.h"
 #include "Utils.h"
+#include "Stats.h"
 
 // Given a filename, open an input file stream and initialize
 Reader::Reader(string fn) throw (IOException)
+: filename(fn), input(0), buffer(0), linenum(0), from_file(false)
 {
-	filename = fn;
-	input = new ifstream(filename.c_str());	
-	linenum = 0;
-	if (input->fail()) throw IOException();
+	if (filename == "-") {
+		// stdin is never owned, nor closed
+		Decompress(cin.rdbuf(), 0);
+		return;
+	}
+
+	ifstream *file = new ifstream(filename.c_str(), ios::in | ios::binary);
+	if (file->fail()) {
+		delete file;
+		throw IOException();
+	}
+
+	// plain ptx is read from the file stream itself, so that it can seek
+	char magic[4];
+	file->read(magic, sizeof(magic));
+	Codec codec = InputBuffer::Detect(magic, file->gcount());
+	file->clear();
+	file->seekg(0);
+	if (codec == CODEC_NONE) {
+		input = file;
+		from_file = true;
+	}
+	else {
+		Decompress(file->rdbuf(), file);
+	}
+}
+
+// Read from a stream that is already open, such as ptx held in memory.
+// The reader takes ownership of the stream
+Reader::Reader(const string& name, istream *in)
+: filename(name), input(0), buffer(0), linenum(0), from_file(false)
+{
+	Decompress(in->rdbuf(), in);
 }
 
 // copy ctor
 Reader::Reader(const Reader& r)
-: filename(r.filename), input(r.input), linenum(r.linenum) {}
+: filename(r.filename), input(r.input), buffer(r.buffer), linenum(r.linenum), from_file(r.from_file) {}
 
 Reader::~Reader()
 {
-	input->close();
 	delete input;
+	delete buffer;
+}
+
+// Read the source through an InputBuffer, which takes care of compressed
+// input. Errors in decompressing are thrown on to the caller rather than
+// ending the input early
+void Reader::Decompress(streambuf *source, istream *owned)
+{
+	buffer = new InputBuffer(filename, source, owned);
+	input = new istream(buffer);
+	input->exceptions(ios::badbit);
 }
 
 // This is the meat of the Reader. Read the next line from the
 // input file stream and fill it into the caller-supplied buffer
 bool Reader::NextLine(string& line)
 {
+	TIME_PHASE(PHASE_READER);
 	char buffer[Reader::MAX_BUFFER_LENGTH];
 
 	Assert(!(input->bad() || input->eof() || input->fail()), "Reading past EOF");
@@ -32,6 +74,10 @@ bool Reader::NextLine(string& line)
 	line = buffer;
 	++linenum;
 
+	// Enforce the time budget, if any, every so many lines
+	if ((linenum % DEADLINE_CHECK_LINES) == 0)
+		CheckDeadline();
+
 	// Peek ahead to check if we've another line to process
 	input->peek();
 
@@ -39,3 +85,54 @@ bool Reader::NextLine(string& line)
 		return false;
 	return true;
 }
+
+// Skip a braced block, such as the body of a kernel that is not being
+// analyzed, up to and including the line of the matching close brace.
+// The bytes are only looked at for braces, newlines and // comments,
+// nothing is copied or parsed. Returns false if the input ends with it
+bool Reader::SkipBlock()
+{
+	TIME_PHASE(PHASE_READER);
+	streambuf *sb = input->rdbuf();
+	const int eof = char_traits<char>::eof();
+	int depth = 0;
+	bool opened = false;
+
+	Assert(!(input->bad() || input->eof() || input->fail()), "Reading past EOF");
+
+	for (int c = sb->sbumpc(); c != eof; c = sb->sbumpc()) {
+		if (c == '\n') {
+			++linenum;
+			if ((linenum % DEADLINE_CHECK_LINES) == 0)
+				CheckDeadline();
+			if (opened && depth == 0) {
+				if (sb->sgetc() != eof) return true;
+				break;
+			}
+		}
+		else if (c == '/' && sb->sgetc() == '/') {
+			// braces in comments do not count, leave the newline to the loop
+			while (sb->sgetc() != eof && sb->sgetc() != '\n')
+				sb->sbumpc();
+		}
+		else if (c == '{') {
+			++depth;
+			opened = true;
+		}
+		else if (c == '}' && depth > 0) {
+			--depth;
+		}
+	}
+	input->setstate(ios::eofbit);
+	return false;
+}
+
+// Continue reading at the given byte offset, which starts the line after
+// the given line number
+void Reader::Seek(unsigned long long offset, unsigned line)
+{
+	input->clear();
+	input->seekg(offset);
+	Assert(!input->fail(), "Unable to seek to offset " << offset << " of " << filename);
+	linenum = line;
+}
@@ -7,27 +7,42 @@
 using namespace std;
 
 #include "Utils.h"
+#include "InputBuffer.h"
 
 // A helper class for taking care of file I/O. This class takes
 // care of opening the ptx file and supplying lines to the parser
-// when requested
+// when requested. The file name - stands for stdin. Compressed
+// input and stdin are read through an InputBuffer; only plain
+// files on disk can seek, and so use the kernel index
 class Reader
 {
 	// Since I don't expect any other kind of reader, 
 	// I'm specializing Reader to be FileReader instead of subclassing.
 	public:
 	Reader(string fn) throw (IOException);
+	Reader(const string&, istream *);
 	Reader(const Reader& r);
 	~Reader();
 	bool NextLine(string&);
+	bool SkipBlock();
+	void Seek(unsigned long long, unsigned);
 	unsigned GetLineNum() const {return linenum;}
+	inline const string& GetFileName() const {return filename;}
+	inline bool IsFile() const {return from_file;}
+	// ptx cut out of a larger file numbers its lines from where it was cut
+	inline void SetFirstLine(unsigned line) {linenum = line - 1;}
 
 	static const short MAX_BUFFER_LENGTH = 256;
+	static const unsigned DEADLINE_CHECK_LINES = 4096;
 
 	private:
+	void Decompress(streambuf *, istream *);
+
 	string filename;
-	ifstream *input;
+	istream *input;
+	InputBuffer *buffer;
 	unsigned linenum;
+	bool from_file;
 };
 
 #endif
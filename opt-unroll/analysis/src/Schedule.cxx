@@ -0,0 +1,355 @@
+#include "Schedule.h"
+#include "Liveness.h"
+#include "Emitter.h"
+#include "Stats.h"
+#include <algorithm>
+#include <functional>
+#include <queue>
+using namespace std;
+
+typedef enum {SPACE_GLOBAL, SPACE_LOCAL, SPACE_SHARED, NUM_SPACES} MemSpace;
+
+static int GetSpace(const Instruction *inst)
+{
+	if (inst->IsGlobalOp()) return SPACE_GLOBAL;
+	if (inst->IsLocalOp()) return SPACE_LOCAL;
+	if (inst->IsSharedOp()) return SPACE_SHARED;
+	return -1;
+}
+
+Schedule::Schedule(const CFG *c) : cfg(c)
+{
+}
+
+void Schedule::CollectInsts(const BasicBlock *bb, vector<const Instruction *>& insts)
+{
+	for (Instruction *inst = bb->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+		if (!inst->IsDeleted()) insts.push_back(inst);
+		if (inst == bb->GetLastInst()) break;
+	}
+}
+
+const BlockSchedule& Schedule::GetBlock(const BasicBlock *bb) const
+{
+	map<const BasicBlock *, BlockSchedule>::const_iterator iter = blocks.find(bb);
+	if (iter != blocks.end()) return iter->second;
+
+	vector <const Instruction *> insts;
+	if (bb->GetFirstInst()) CollectInsts(bb, insts);
+	return blocks.insert(make_pair(bb, Run(insts, false))).first->second;
+}
+
+// The cycles from issue until the result can be read
+unsigned Schedule::Latency(const Instruction *inst) const
+{
+	if (inst->IsSyncOp() || inst->IsBranchOp() || inst->IsMemStore()) return Issue(inst);
+	if (inst->IsGlobalOp() || inst->IsLocalOp())
+		return GLOBAL_MEM_LATENCY + cfg->TransactionCycles(inst);
+	return OpcodeLatency(inst->GetCode()) + cfg->ConflictCycles(inst);
+}
+
+// The cycles the instruction holds the issue slot for
+unsigned Schedule::Issue(const Instruction *inst) const
+{
+	return cfg->IssueCycles(inst);
+}
+
+// The dependence DAG of the given instructions. Renamed registers leave
+// only the true dependences
+void Schedule::Build(const vector<const Instruction *>& insts, bool rename, vector<SchedNode>& nodes,
+										 vector<SchedEdge>& edges) const
+{
+	vector <int> last_def;
+	vector < vector<unsigned> > readers;
+	int last_store[NUM_SPACES] = {-1, -1, -1};
+	vector <unsigned> loads[NUM_SPACES];
+	int last_sync = -1;
+	vector <unsigned> since_sync;
+
+	nodes.assign(insts.size(), SchedNode());
+	edges.clear();
+	for (unsigned i = 0; i < insts.size(); ++i) {
+		const Instruction *inst = insts[i];
+		nodes[i].issue = Issue(inst);
+		nodes[i].latency = Latency(inst);
+
+		const InstRegs& regs = Liveness::GetRegs(inst);
+		int def = inst->IsMemStore() ? -1 : inst->GetRegDst();
+		unsigned highest = max(def, 0);
+		for (unsigned u = 0; u < regs.num_uses; ++u)
+			highest = max(highest, (unsigned) regs.uses[u]);
+		if (highest >= last_def.size()) {
+			last_def.resize(highest + 1, -1);
+			if (!rename) readers.resize(highest + 1);
+		}
+
+		for (unsigned u = 0; u < regs.num_uses; ++u) {
+			int reg = regs.uses[u];
+			if (last_def[reg] >= 0) edges.push_back(SchedEdge(last_def[reg], i, nodes[last_def[reg]].latency));
+			if (!rename) readers[reg].push_back(i);
+		}
+		if (def >= 0) {
+			if (!rename) {
+				if (last_def[def] >= 0) edges.push_back(SchedEdge(last_def[def], i, 0));
+				for (unsigned r = 0; r < readers[def].size(); ++r) {
+					if (readers[def][r] != i) edges.push_back(SchedEdge(readers[def][r], i, 0));
+				}
+				readers[def].clear();
+			}
+			last_def[def] = i;
+		}
+
+		int space = GetSpace(inst);
+		if (space >= 0 && (inst->IsMemLoad() || inst->IsMemStore())) {
+			if (last_store[space] >= 0) edges.push_back(SchedEdge(last_store[space], i, 0));
+			if (inst->IsMemStore()) {
+				for (unsigned l = 0; l < loads[space].size(); ++l)
+					edges.push_back(SchedEdge(loads[space][l], i, 0));
+				loads[space].clear();
+				last_store[space] = i;
+			}
+			else
+				loads[space].push_back(i);
+		}
+
+		if (inst->IsSyncOp()) {
+			for (unsigned s = 0; s < since_sync.size(); ++s)
+				edges.push_back(SchedEdge(since_sync[s], i, 0));
+			since_sync.clear();
+			last_sync = i;
+		}
+		else {
+			if (last_sync >= 0) edges.push_back(SchedEdge(last_sync, i, 0));
+			since_sync.push_back(i);
+		}
+	}
+
+	// the successors of each node, in the order of the edges
+	vector <SchedEdge> sorted(edges.size());
+	for (unsigned e = 0; e < edges.size(); ++e) {
+		++nodes[edges[e].from].num_succs;
+		++nodes[edges[e].to].num_preds;
+	}
+	unsigned start = 0;
+	for (unsigned i = 0; i < nodes.size(); ++i) {
+		nodes[i].first_succ = start;
+		start += nodes[i].num_succs;
+		nodes[i].num_succs = 0;
+	}
+	for (unsigned e = 0; e < edges.size(); ++e) {
+		SchedNode& from = nodes[edges[e].from];
+		sorted[from.first_succ + from.num_succs++] = edges[e];
+	}
+	edges.swap(sorted);
+}
+
+void Schedule::Dependences(const BasicBlock *bb, vector<const Instruction *>& insts, vector<SchedNode>& nodes,
+													 vector<SchedEdge>& edges) const
+{
+	insts.clear();
+	if (bb->GetFirstInst()) CollectInsts(bb, insts);
+	Build(insts, false, nodes, edges);
+}
+
+// Schedule the instructions in the order they are given, renaming the
+// registers if asked to
+BlockSchedule Schedule::Run(const vector<const Instruction *>& insts, bool rename) const
+{
+	TIME_PHASE(PHASE_SCHEDULE);
+	BlockSchedule result;
+	result.num_instrs = insts.size();
+	if (insts.empty()) return result;
+
+	vector <SchedNode> nodes;
+	vector <SchedEdge> edges;
+	Build(insts, rename, nodes, edges);
+
+	// the edges only go forwards, so the heights settle in a backward pass
+	for (unsigned i = nodes.size(); i-- > 0; ) {
+		SchedNode& node = nodes[i];
+		node.height = node.latency;
+		for (unsigned e = node.first_succ; e < node.first_succ + node.num_succs; ++e)
+			node.height = max(node.height, edges[e].latency + nodes[edges[e].to].height);
+		result.critical_path = max(result.critical_path, node.height);
+		result.resource_bound += node.issue;
+	}
+
+	// the nodes whose predecessors have all issued wait in pending until
+	// their operands are ready; the ready ones go by height, then by order
+	typedef pair<unsigned long long, unsigned> Entry;
+	priority_queue <Entry, vector<Entry>, greater<Entry> > pending;
+	priority_queue <pair<unsigned long long, int> > ready;
+	for (unsigned i = 0; i < nodes.size(); ++i) {
+		if (nodes[i].num_preds == 0) pending.push(Entry(0, i));
+	}
+
+	unsigned long long now = 0;
+	unsigned issued = 0;
+	while (issued < nodes.size()) {
+		while (!pending.empty() && pending.top().first <= now) {
+			unsigned i = pending.top().second;
+			ready.push(make_pair(nodes[i].height, -(int) i));
+			pending.pop();
+		}
+		if (ready.empty()) {
+			now = pending.top().first;
+			continue;
+		}
+
+		unsigned i = -ready.top().second;
+		ready.pop();
+		const SchedNode& node = nodes[i];
+		result.length = max(result.length, now + node.latency);
+		for (unsigned e = node.first_succ; e < node.first_succ + node.num_succs; ++e) {
+			SchedNode& succ = nodes[edges[e].to];
+			succ.earliest = max(succ.earliest, now + edges[e].latency);
+			if (--succ.num_preds == 0) pending.push(Entry(succ.earliest, edges[e].to));
+		}
+		now += node.issue;
+		++issued;
+	}
+	return result;
+}
+
+// Cycles u copies of the body of a single-block inner-most loop take, with
+// only the last copy closing the loop. 0 for any other loop
+unsigned long long Schedule::UnrolledLength(const Loop *loop, unsigned factor) const
+{
+	const BasicBlock *body = loop->GetHeader();
+	if (loop->HasInnerLoops() || loop->GetFooter() != body || body->GetFirstInst() == 0) return 0;
+
+	vector <const Instruction *> insts, copies;
+	CollectInsts(body, insts);
+	bool closing = !insts.empty() && insts.back()->IsBranchOp();
+	for (unsigned u = 0; u < factor; ++u) {
+		bool last = (u + 1 == factor);
+		copies.insert(copies.end(), insts.begin(), (closing && !last) ? insts.end() - 1 : insts.end());
+	}
+	return Run(copies, true).length;
+}
+
+void Schedule::CollectLoops(const Loop *loop, vector<const Loop *>& all) const
+{
+	all.push_back(loop);
+	if (loop->HasInnerLoops()) {
+		for (LoopListConstIter iter = loop->InnerLoopsBegin(); iter != loop->InnerLoopsEnd(); ++iter)
+			CollectLoops(*iter, all);
+	}
+}
+
+static bool CompareLoopIds(const Loop *a, const Loop *b)
+{
+	return a->Id() < b->Id();
+}
+
+static bool CompareBlockIds(const BasicBlock *a, const BasicBlock *b)
+{
+	return a->Id() < b->Id();
+}
+
+// Report the schedule of every block, then of every loop: the sums over
+// its blocks, inner loops included, and the cycles per iteration of the
+// unrolled body for powers of two up to the given factor
+void Schedule::Dump(unsigned max_factor) const
+{
+	vector <const BasicBlock *> sorted;
+	for (BBListConstIter iter = cfg->BlocksBegin(); iter != cfg->BlocksEnd(); ++iter) {
+		if ((*iter)->GetFirstInst()) sorted.push_back(*iter);
+	}
+	sort(sorted.begin(), sorted.end(), CompareBlockIds);
+
+	vector <const Loop *> loops;
+	if (cfg->HasLoops()) {
+		for (LoopListConstIter iter = cfg->LoopsBegin(); iter != cfg->LoopsEnd(); ++iter)
+			CollectLoops(*iter, loops);
+	}
+	sort(loops.begin(), loops.end(), CompareLoopIds);
+
+	BlockSchedule total;
+	for (unsigned i = 0; i < sorted.size(); ++i) {
+		const BlockSchedule& block = GetBlock(sorted[i]);
+		total.num_instrs += block.num_instrs;
+		total.critical_path += block.critical_path;
+		total.resource_bound += block.resource_bound;
+		total.length += block.length;
+	}
+	vector <BlockSchedule> loop_totals(loops.size());
+	vector < vector<unsigned long long> > unrolled(loops.size());
+	for (unsigned l = 0; l < loops.size(); ++l) {
+		for (unsigned u = 1; u <= max_factor; u *= 2) {
+			unsigned long long length = UnrolledLength(loops[l], u);
+			if (length == 0) break;
+			unrolled[l].push_back(length);
+		}
+		for (BBSetConstIter iter = loops[l]->NatLoopBegin(); iter != loops[l]->NatLoopEnd(); ++iter) {
+			const BlockSchedule& block = GetBlock(*iter);
+			loop_totals[l].num_instrs += block.num_instrs;
+			loop_totals[l].critical_path += block.critical_path;
+			loop_totals[l].resource_bound += block.resource_bound;
+			loop_totals[l].length += block.length;
+		}
+	}
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord("schedule");
+		out.Field("critical_path", total.critical_path);
+		out.Field("resource_bound", total.resource_bound);
+		out.Field("length", total.length);
+		out.BeginList("blocks");
+		for (unsigned i = 0; i < sorted.size(); ++i) {
+			const BlockSchedule& block = GetBlock(sorted[i]);
+			out.BeginRecord();
+			out.Field("id", sorted[i]->Id());
+			out.Field("instructions", block.num_instrs);
+			out.Field("critical_path", block.critical_path);
+			out.Field("resource_bound", block.resource_bound);
+			out.Field("length", block.length);
+			out.EndRecord();
+		}
+		out.EndList();
+		out.BeginList("loops");
+		for (unsigned l = 0; l < loops.size(); ++l) {
+			const Loop *loop = loops[l];
+			out.BeginRecord();
+			out.Field("id", loop->Id());
+			out.Field("header", loop->GetHeader()->Id());
+			out.Field("nesting_level", (unsigned) loop->GetNestingLevel());
+			out.Field("critical_path", loop_totals[l].critical_path);
+			out.Field("resource_bound", loop_totals[l].resource_bound);
+			out.Field("length", loop_totals[l].length);
+			out.BeginList("unrolled");
+			for (unsigned f = 0; f < unrolled[l].size(); ++f) {
+				out.BeginRecord();
+				out.Field("factor", 1U << f);
+				out.Field("length", unrolled[l][f]);
+				out.EndRecord();
+			}
+			out.EndList();
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << "Blocks: " << sorted.size() << ", critical path " << total.critical_path << ", resource bound "
+		 << total.resource_bound << ", scheduled " << total.length << " cycles\n";
+	for (unsigned i = 0; i < sorted.size(); ++i) {
+		const BlockSchedule& block = GetBlock(sorted[i]);
+		os << "bb " << sorted[i]->Id() << ": " << block.num_instrs << " instrs, critical path "
+			 << block.critical_path << ", resource bound " << block.resource_bound << ", scheduled "
+			 << block.length << '\n';
+	}
+	for (unsigned l = 0; l < loops.size(); ++l) {
+		const Loop *loop = loops[l];
+		os << "Loop " << loop->Id() << " (Header bb: " << loop->GetHeader()->Id()
+			 << ", Nesting level: " << loop->GetNestingLevel() << "): critical path " << loop_totals[l].critical_path
+			 << ", resource bound " << loop_totals[l].resource_bound << ", scheduled " << loop_totals[l].length;
+		if (!unrolled[l].empty()) os << ", per iteration";
+		for (unsigned f = 0; f < unrolled[l].size(); ++f)
+			os << " x" << (1U << f) << ": " << unrolled[l][f] / (1U << f);
+		os << '\n';
+	}
+}
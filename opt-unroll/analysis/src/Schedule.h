@@ -0,0 +1,91 @@
+#ifndef _SCHEDULE_H_INCLUDED_
+#define _SCHEDULE_H_INCLUDED_
+
+#include "CFG.h"
+#include <map>
+#include <vector>
+using namespace std;
+
+// Instruction-level parallelism within the basic blocks. Each block's
+// instructions form a dependence DAG, built from the registers they name
+// (GetRegDst/GetRegSrc*, read as Liveness reads them): a read waits for the
+// latency of the instruction that wrote the register, and a write waits for
+// the earlier reads and writes of its register to issue. Within a memory
+// space, a store also waits for the earlier loads and stores, and a load for
+// the earlier stores. A bar.sync orders everything before it against
+// everything after it.
+//
+// A list scheduler then issues the DAG one instruction at a time, for its
+// issue cycles, always picking the ready instruction with the longest path
+// to the end of the block. A block takes at least as long as its critical
+// path (the longest latency-weighted path) and as its resource bound (the
+// issue cycles of all of its instructions); the schedule length is how long
+// it really takes a single warp, up to the completion of its last
+// instruction. The latencies are those of the cycle model: global and local
+// loads take GLOBAL_MEM_LATENCY and their extra transactions, shared
+// accesses replay for their bank conflicts, and everything else issues and
+// writes its result in the cycles of its opcode (see Opcodes.h).
+//
+// Blocks are scheduled on demand and the summaries kept, so that walks over
+// the loops reuse them. For the body of an inner-most loop made of a single
+// block, unrolling is estimated by scheduling u copies of the body with the
+// registers renamed - so only true dependences remain, including those
+// carried from one copy to the next - and a single loop-closing branch.
+
+class BlockSchedule
+{
+	public:
+	BlockSchedule() : num_instrs(0), critical_path(0), resource_bound(0), length(0) {}
+	unsigned num_instrs;
+	unsigned long long critical_path;
+	unsigned long long resource_bound;
+	unsigned long long length;
+};
+
+// A node of the dependence DAG; the successors are a range of the edges
+class SchedNode
+{
+	public:
+	SchedNode() : issue(0), latency(0), num_preds(0), first_succ(0), num_succs(0), height(0), earliest(0) {}
+	unsigned issue, latency;
+	unsigned num_preds;
+	unsigned first_succ, num_succs;
+	unsigned long long height, earliest;
+};
+
+class SchedEdge
+{
+	public:
+	SchedEdge(unsigned f = 0, unsigned t = 0, unsigned l = 0) : from(f), to(t), latency(l) {}
+	unsigned from, to;
+	unsigned latency;
+};
+
+class Schedule
+{
+	public:
+	Schedule(const CFG *);
+	const BlockSchedule& GetBlock(const BasicBlock *) const;
+	unsigned long long UnrolledLength(const Loop *, unsigned) const;
+	inline unsigned GetNumScheduled() const {return blocks.size();}
+	void Dump(unsigned) const;
+
+	// the dependence DAG of a block, in the order of its instructions
+	void Dependences(const BasicBlock *, vector<const Instruction *>&, vector<SchedNode>&,
+									 vector<SchedEdge>&) const;
+	unsigned Latency(const Instruction *) const;
+	unsigned Issue(const Instruction *) const;
+
+	static void CollectInsts(const BasicBlock *, vector<const Instruction *>&);
+
+	private:
+	BlockSchedule Run(const vector<const Instruction *>&, bool) const;
+	void Build(const vector<const Instruction *>&, bool, vector<SchedNode>&, vector<SchedEdge>&) const;
+	void CollectLoops(const Loop *, vector<const Loop *>&) const;
+
+	const CFG *cfg;
+	// the blocks scheduled so far
+	mutable map <const BasicBlock *, BlockSchedule> blocks;
+};
+
+#endif
@@ -0,0 +1,398 @@
+#include "Server.h"
+#include "Driver.h"
+#include "Utils.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char *PROTOCOL_HEADER = "PTXA/1";
+
+// Set by SIGINT/SIGTERM to make the accept loop wind down
+static volatile sig_atomic_t stop_requested = 0;
+
+static void RequestStop(int)
+{
+	stop_requested = 1;
+}
+
+// Buffered line and block reads on a socket, plus complete writes
+class Connection
+{
+	public:
+	Connection(int f) : fd(f), pos(0) {}
+	~Connection() {close(fd);}
+
+	bool ReadLine(string& line)
+	{
+		line.clear();
+		while (true) {
+			size_t eol = buffer.find('\n', pos);
+			if (eol != buffer.npos) {
+				line = buffer.substr(pos, eol - pos);
+				pos = eol + 1;
+				return true;
+			}
+			if (!Fill()) return false;
+		}
+	}
+
+	bool ReadBytes(size_t n, string& data)
+	{
+		while (buffer.size() - pos < n) {
+			if (!Fill()) return false;
+		}
+		data = buffer.substr(pos, n);
+		pos += n;
+		return true;
+	}
+
+	bool Write(const string& data)
+	{
+		size_t done = 0;
+		while (done < data.size()) {
+			ssize_t n = write(fd, data.data() + done, data.size() - done);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			done += n;
+		}
+		return true;
+	}
+
+	private:
+	bool Fill()
+	{
+		// drop what has been consumed before growing the buffer
+		if (pos > 0) {
+			buffer.erase(0, pos);
+			pos = 0;
+		}
+		char chunk[65536];
+		ssize_t n;
+		do {
+			n = read(fd, chunk, sizeof(chunk));
+		} while (n < 0 && errno == EINTR);
+		if (n <= 0) return false;
+		buffer.append(chunk, n);
+		return true;
+	}
+
+	int fd;
+	string buffer;
+	size_t pos;
+};
+
+static bool MakeAddress(const string& path, struct sockaddr_un& addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) return false;
+	strcpy(addr.sun_path, path.c_str());
+	return true;
+}
+
+// Open a connection to the server at the given path, or return -1
+static int Connect(const string& path)
+{
+	struct sockaddr_un addr;
+	if (!MakeAddress(path, addr)) return -1;
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// One client connection, served on a pool worker
+class ConnectionTask : public Task
+{
+	public:
+	ConnectionTask(Server *s, int f) : server(s), fd(f) {}
+	void Run() {server->Serve(fd);}
+	bool DeleteWhenDone() const {return true;}
+
+	private:
+	Server *server;
+	int fd;
+};
+
+// $PTX_ANALYZE_SOCKET if set, otherwise a per-user socket under /tmp
+string Server::DefaultSocketPath()
+{
+	const char *env = getenv("PTX_ANALYZE_SOCKET");
+	if (env && *env) return env;
+	ostringstream path;
+	path << "/tmp/ptx-analyze-" << getuid() << ".sock";
+	return path.str();
+}
+
+Server::Server(const string& path, unsigned nthreads)
+: socket_path(path), listen_fd(-1), pool(nthreads), requests(0), hits(0)
+{
+	pthread_mutex_init(&cache_lock, 0);
+
+	struct sockaddr_un addr;
+	Assert(MakeAddress(socket_path, addr), "Socket path too long: " << socket_path);
+
+	// A socket file nobody answers on is left over from a server that died.
+	// Anything else at the path is not ours to remove
+	int fd = Connect(socket_path);
+	if (fd >= 0) {
+		close(fd);
+		Assert(false, "A server is already running on " << socket_path);
+	}
+	struct stat sb;
+	if (lstat(socket_path.c_str(), &sb) == 0) {
+		Assert(S_ISSOCK(sb.st_mode), "Not a socket: " << socket_path);
+		unlink(socket_path.c_str());
+	}
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	Assert(listen_fd >= 0, "Unable to create socket: " << strerror(errno));
+	// PATH reads any file the server can, so only its owner may connect. No
+	// connection is taken before listen(), so nothing gets in ahead of chmod
+	if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || chmod(socket_path.c_str(), 0600) != 0
+			|| listen(listen_fd, SOMAXCONN) != 0) {
+		int err = errno;
+		close(listen_fd);
+		Assert(false, "Unable to listen on " << socket_path << ": " << strerror(err));
+	}
+}
+
+Server::~Server()
+{
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(socket_path.c_str());
+	}
+	// let the connections in flight finish before the cache goes away
+	pool.Wait();
+	pthread_mutex_destroy(&cache_lock);
+}
+
+// Accept connections till interrupted, handing each one to a worker
+void Server::Run()
+{
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = RequestStop;
+	sigemptyset(&sa.sa_mask);
+	// no SA_RESTART: a signal has to break the accept below
+	sigaction(SIGINT, &sa, 0);
+	sigaction(SIGTERM, &sa, 0);
+	// a client going away mid-reply must not take the server down
+	signal(SIGPIPE, SIG_IGN);
+
+	cerr << "Serving on " << socket_path << " with " << pool.GetNumThreads() << " worker(s)" << endl;
+
+	while (!stop_requested) {
+		int fd = accept(listen_fd, 0, 0);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			cerr << "accept failed: " << strerror(errno) << endl;
+			break;
+		}
+		pool.Submit(new ConnectionTask(this, fd));
+	}
+
+	pool.Wait();
+	pthread_mutex_lock(&cache_lock);
+	cerr << "Server stopped after " << requests << " request(s), " << hits << " served from cache" << endl;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+// Read one request off the connection and answer it
+void Server::Serve(int fd)
+{
+	Connection conn(fd);
+	vector<string> options;
+	string line, name, ptx;
+	bool have_input = false;
+
+	if (!conn.ReadLine(line) || line != PROTOCOL_HEADER) {
+		conn.Write("ERR Unknown protocol\n");
+		return;
+	}
+
+	try {
+		while (true) {
+			Assert(conn.ReadLine(line), "Incomplete request");
+			if (line == "END") break;
+
+			size_t sp = line.find(' ');
+			const string& verb = line.substr(0, sp);
+			const string& arg = (sp == line.npos) ? "" : line.substr(sp + 1);
+
+			if (verb == "OPT") {
+				options.push_back(arg);
+			}
+			else if (verb == "NAME") {
+				name = arg;
+			}
+			else if (verb == "PATH") {
+				ifstream file(arg.c_str(), ios::in | ios::binary);
+				Assert(file.good(), "Input file not found: " << arg);
+				ostringstream contents;
+				contents << file.rdbuf();
+				ptx = contents.str();
+				if (name.empty()) name = arg;
+				have_input = true;
+			}
+			else if (verb == "DATA") {
+				istringstream args(arg);
+				unsigned long long size = 0;
+				args >> size;
+				Assert(!args.fail() && size <= MAX_PAYLOAD, "Invalid payload size");
+				if (name.empty()) name = "-";
+				Assert(conn.ReadBytes(size, ptx), "Incomplete payload");
+				have_input = true;
+			}
+			else Assert(false, "Unknown request " << verb);
+		}
+		Assert(have_input, "No input in request");
+
+		double start = WallTime();
+		bool cached = false;
+		const string& result = Analyze(options, name, ptx, cached);
+
+		ostringstream reply;
+		reply << "OK " << result.size() << '\n';
+		if (conn.Write(reply.str()))
+			conn.Write(result);
+
+		ostringstream log;
+		log << "Analyzed " << name << " in " << (WallTime() - start) * 1000 << " ms" << (cached ? " (cached)" : "") << '\n';
+		cerr << log.str();
+	} catch (exception& e) {
+		string msg = e.what();
+		for (unsigned i = 0; i < msg.size(); ++i) {
+			if (msg[i] == '\n') msg[i] = ' ';
+		}
+		conn.Write("ERR " + msg + "\n");
+	} catch (...) {
+		conn.Write("ERR Driver aborted\n");
+	}
+}
+
+// Run the analysis described by the options over the ptx, unless the very
+// same request has been answered before. Options that use files in the
+// current directory would resolve against the server's, so they are refused
+string Server::Analyze(const vector<string>& options, const string& name, const string& ptx, bool& cached)
+{
+	Driver driver(options);
+	Assert(driver.IsServable(), "-unrolled, -usearch and -dotcfg are not served, run them in-process");
+
+	unsigned long long key = FINGERPRINT_SEED;
+	for (unsigned i = 0; i < options.size(); ++i)
+		key = Fingerprint(options[i] + '\n', key);
+	key = Fingerprint(name + '\n', key);
+	key = Fingerprint(ptx, key);
+
+	pthread_mutex_lock(&cache_lock);
+	++requests;
+	pthread_mutex_unlock(&cache_lock);
+
+	string result;
+	cached = Lookup(key, result);
+	if (cached) return result;
+
+	Emitter *out = Emitter::Create(driver.GetFormat());
+	FileSummary summary(name);
+	try {
+		if (driver.GetTimeBudget() > 0)
+			SetDeadline(WallTime() + driver.GetTimeBudget());
+		Reader rdr(name, new istringstream(ptx));
+		driver.Analyze(&rdr, out, 0, summary);
+	} catch (...) {
+		SetOutput(0);
+		SetDeadline(0);
+		delete out;
+		throw;
+	}
+	SetOutput(0);
+	SetDeadline(0);
+	result = out->GetBuffer();
+	delete out;
+
+	Store(key, result);
+	return result;
+}
+
+bool Server::Lookup(unsigned long long key, string& result)
+{
+	pthread_mutex_lock(&cache_lock);
+	map<unsigned long long, string>::const_iterator iter = cache.find(key);
+	bool found = (iter != cache.end());
+	if (found) {
+		result = iter->second;
+		++hits;
+	}
+	pthread_mutex_unlock(&cache_lock);
+	return found;
+}
+
+void Server::Store(unsigned long long key, const string& result)
+{
+	pthread_mutex_lock(&cache_lock);
+	if (cache.find(key) == cache.end()) {
+		cache[key] = result;
+		cache_order.push_back(key);
+		while (cache_order.size() > MAX_CACHED_RESULTS) {
+			cache.erase(cache_order.front());
+			cache_order.pop_front();
+		}
+	}
+	pthread_mutex_unlock(&cache_lock);
+}
+
+// Send the request for one file and collect the reply. The file is named
+// by its absolute path since the server may run in another directory
+bool Server::Request(const string& path, const vector<string>& options, const string& file, const string& ptx, string& reply)
+{
+	int fd = Connect(path);
+	if (fd < 0) return false;
+	// a server that went away must not kill the client; it falls back instead
+	signal(SIGPIPE, SIG_IGN);
+
+	Connection conn(fd);
+	ostringstream request;
+	request << PROTOCOL_HEADER << '\n';
+	for (unsigned i = 0; i < options.size(); ++i)
+		request << "OPT " << options[i] << '\n';
+	request << "NAME " << file << '\n';
+	if (file == "-") {
+		// the server cannot read our stdin, so the ptx goes along as is,
+		// compressed or not
+		Assert(ptx.size() <= MAX_PAYLOAD, "Input too large to send to the server");
+		request << "DATA " << ptx.size() << '\n' << ptx;
+	}
+	else {
+		char *resolved = realpath(file.c_str(), 0);
+		string abs_file = resolved ? resolved : file;
+		free(resolved);
+		request << "PATH " << abs_file << '\n';
+	}
+	request << "END" << '\n';
+
+	string status;
+	if (!conn.Write(request.str()) || !conn.ReadLine(status))
+		return false;
+
+	if (status.compare(0, 4, "ERR ") == 0)
+		Assert(false, "Server error: " << status.substr(4));
+
+	istringstream header(status);
+	string ok;
+	unsigned long long size = 0;
+	header >> ok >> size;
+	Assert(ok == "OK" && !header.fail(), "Unexpected reply from the server: " << status);
+	return conn.ReadBytes(size, reply);
+}
@@ -0,0 +1,69 @@
+#ifndef _SERVER_H_INCLUDED_
+#define _SERVER_H_INCLUDED_
+
+#include "ThreadPool.h"
+#include <pthread.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// A long-running analyzer that serves requests over a Unix domain socket,
+// so that build systems calling the analyzer after every compile pay for
+// process startup only once. Worker threads and the result cache stay
+// alive across requests. The protocol is line based:
+//
+//   PTXA/1                    request header
+//   OPT <option>              zero or more, e.g. OPT -counts
+//   NAME <name>               optional, the input name used in reports
+//   PATH <file>               analyze a file the server can read, or
+//   DATA <bytes>              analyze the ptx that follows
+//   END
+//
+// and the server answers with "OK <bytes>" followed by the analysis in the
+// requested format, or with a single "ERR <message>" line. Options that read
+// or write files in the current directory are refused; the client runs
+// those in-process
+class Server
+{
+	public:
+	Server(const string&, unsigned nthreads);
+	~Server();
+	void Run();
+
+	// Client side: have the server at the given socket analyze a file,
+	// or for the file - the given ptx, read from stdin by the caller and
+	// sent along as DATA. Returns false if no server could be reached or
+	// the connection was lost, so that the caller can run the analysis
+	// itself, and throws AnalysisException if the server reported an
+	// error or answered with something else than a result
+	static bool Request(const string&, const vector<string>&, const string&, const string&, string&);
+	static string DefaultSocketPath();
+
+	static const unsigned MAX_CACHED_RESULTS = 256;
+	static const unsigned long long MAX_PAYLOAD = 256ULL << 20;
+
+	private:
+	Server(const Server&);
+	Server& operator=(const Server&);
+
+	friend class ConnectionTask;
+	void Serve(int);
+	string Analyze(const vector<string>&, const string&, const string&, bool&);
+	bool Lookup(unsigned long long, string&);
+	void Store(unsigned long long, const string&);
+
+	string socket_path;
+	int listen_fd;
+	ThreadPool pool;
+
+	// Results keyed by a fingerprint of the options and the ptx; the
+	// oldest entries are evicted first
+	map <unsigned long long, string> cache;
+	deque <unsigned long long> cache_order;
+	pthread_mutex_t cache_lock;
+	unsigned long long requests, hits;
+};
+
+#endif
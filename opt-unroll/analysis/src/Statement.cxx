@@ -1,6 +1,7 @@
 #include "Statement.h"
 #include "Utils.h"
 #include "Parser.h"
+#include "Stats.h"
 #include <limits.h>
 
 // Implementation of the Statement class
@@ -10,50 +11,54 @@ Statement::Statement(unsigned l, std::string a)
 Statement::Statement(const Statement& s)
 : linenum(s.linenum), ascii(s.ascii) {}
 
+#ifdef PTX_STATS
+void * Statement::operator new(size_t size)
+{
+	MEM_CATEGORY(MEM_STATEMENTS);
+	return ::operator new(size);
+}
+
+void Statement::operator delete(void *ptr)
+{
+	::operator delete(ptr);
+}
+#endif
+
 // Implementation of the Instruction class
 Instruction::Instruction(unsigned l, std::string a, Instruction *p, Instruction *n)
-: Statement(l, a), prev(p), next(n), branch_target(0), is_branch_target(false), reg_src0(-1), reg_src1(-1), reg_src2(-1), reg_dst(-1), \
-  memop_type(MEM_UNKNOWN), deleted(0), alu_op(0), mem_op(0), sync_op(0), global_op(0), shared_op(0), local_op(0), branch_op(0), cond_branch(0), call_op(0), ret_op(0), cycles(0) {}
+: Statement(l, a), prev(p), next(n), code(0), branch_target(0), is_branch_target(false), reg_src0(-1), reg_src1(-1), reg_src2(-1), reg_dst(-1), \
+  memop_type(MEM_UNKNOWN), deleted(0), alu_op(0), mem_op(0), sync_op(0), global_op(0), shared_op(0), local_op(0), branch_op(0), cond_branch(0), call_op(0), ret_op(0), transactions(1), conflicts(1), cycles(0) {}
 
 Instruction::Instruction(const Instruction& i)
-: Statement(i), prev(i.prev), next(i.next), branch_target(i.branch_target), is_branch_target(i.is_branch_target), \
+: Statement(i), prev(i.prev), next(i.next), code(i.code), branch_target(i.branch_target), is_branch_target(i.is_branch_target), \
   reg_src0(i.reg_src0), reg_src1(i.reg_src1), reg_src2(i.reg_src2), reg_dst(i.reg_dst), memop_type(i.memop_type),
 	deleted(i.deleted), alu_op(i.alu_op), mem_op(i.mem_op), sync_op(i.sync_op), global_op(i.global_op), shared_op(i.shared_op),  \
-	local_op(i.local_op), branch_op(i.branch_op), cond_branch(i.cond_branch), call_op(i.call_op) , ret_op(i.ret_op), cycles(i.cycles) {}
-
-bool Instruction::reset_fields = true;
+	local_op(i.local_op), branch_op(i.branch_op), cond_branch(i.cond_branch), call_op(i.call_op) , ret_op(i.ret_op), transactions(i.transactions), conflicts(i.conflicts), \
+	cycles(i.cycles) {}
 
 // Given an instruction string, call the parser to parse the contents, and create
-// the instruction object
+// the instruction object. The prev and next links are set up by the kernel as
+// the instruction is appended to the instruction stream
 Instruction * Instruction::CreateInstruction(const string& str, unsigned linenum)
 {
-	static Instruction *prev = 0;
-
-	if (reset_fields) {
-		reset_fields = false;
-		prev = 0;
-	}
-
 	//string instbuf = (Parser::IsLabel(str)) ? Parser::GetInstructionBufferFromLabel(str) : str;
 	const string& instbuf = str;
 
-	Instruction *instr = new Instruction(linenum, instbuf, prev, 0);
-	instr->SetPrev(prev);
-	if (prev) {
-		prev->SetNext(instr);
-	}
-	prev = instr;
+	Instruction *instr = new Instruction(linenum, instbuf, 0, 0);
 	instr->Classify();
 	return instr;
 }
 
 // This is where we parse the contents of the instruction buffer and populate
-// the various fields of the instr object
+// the various fields of the instr object. The opcode is decoded once, and
+// the flags all follow from its code
 void Instruction::Classify()
 {
 	const string& instrbuf = GetAscii();
 	Parser::ParseRegs(instrbuf, reg_dst, reg_src0, reg_src1, reg_src2);
-	opc = Parser::ParseOpCode(instrbuf);
+	code = Parser::ParseCode(instrbuf);
+	opc = CodeClass(code);
+	const Mnemonic mnemonic = CodeMnemonic(code);
 	switch (opc) {
 		case OPR_ALU:
 			alu_op = 1;
@@ -63,26 +68,22 @@ void Instruction::Classify()
 			/* fall through */
 		case OPR_BRANCH:
 			branch_op = 1;
-			label_number = Parser::IsRet(instrbuf) ? -1 : Parser::ParseLabelNumber(instrbuf);
-			if (Parser::IsCall(instrbuf)) call_op = 1;
-			if (Parser::IsRet(instrbuf)) ret_op = 1;
+			if (mnemonic == MN_CALL) call_op = 1;
+			if (mnemonic == MN_RET || mnemonic == MN_RETURN) ret_op = 1;
+			label_number = ret_op ? -1 : Parser::ParseLabelNumber(instrbuf);
 			break;
 		case OPR_MEM:
 			mem_op = 1;
-			Parser::ParseMemOp(instrbuf, memop_type);
-			if (Parser::IsGlobalOp(instrbuf)) {
-				global_op = 1;
-			}
-			else if (Parser::IsSharedOp(instrbuf)) {
-				shared_op = 1;
-			}
-			else if (Parser::IsLocalOp(instrbuf)) {
-				local_op = 1;
-			}
-			else {
-				// Could be a reg-reg mov/cvt op
-				opc = OPR_ALU;
-				alu_op = 1;
+			Parser::ParseMemOp(instrbuf, code, memop_type);
+			switch (CodeSpace(code)) {
+				case STATE_GLOBAL:
+					global_op = 1;
+					break;
+				case STATE_SHARED:
+					shared_op = 1;
+					break;
+				default:
+					local_op = 1;
 			}
 			break;
 		case OPR_SYNC:
@@ -95,6 +96,30 @@ void Instruction::Classify()
 	return;
 }
 
+// check the instruction type and increment appropriate count
+void InstCounts::Add(const Instruction *inst)
+{
+	if (inst->IsAluOp()) ++alu;
+	else if (inst->IsBranchOp()) ++branch;
+	else if (inst->IsSharedOp()) ++shared;
+	else if (inst->IsLocalOp()) ++local;
+	else if (inst->IsGlobalOp()) ++global;
+	else {
+		Assert(inst->IsSyncOp(), "Unknown op type");
+		++sync;
+	}
+}
+
+void InstCounts::Add(const InstCounts& other)
+{
+	alu += other.alu;
+	global += other.global;
+	shared += other.shared;
+	local += other.local;
+	branch += other.branch;
+	sync += other.sync;
+}
+
 // Implementation of the Label class
 Label * Label::CreateLabel(const string& str, unsigned linenum)
 {
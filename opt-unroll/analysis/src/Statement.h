@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <list>
+#include "Opcodes.h"
 using namespace std;
 
 // todo: using macros is bad practice; replace asap
@@ -12,17 +13,6 @@ using namespace std;
 #define DOT_CHAR		'.'
 #define AT_CHAR			'@'
 
-// A convenient type to track different types of interesting opcodes
-typedef enum opcode_t 
-{
-	OPR_INVALID = -1,
-	OPR_ALU,
-	OPR_BRANCH,
-	OPR_COND_BRANCH,
-	OPR_MEM,
-	OPR_SYNC
-} Opcode;
-
 typedef enum memop_t
 {
 	MEM_UNKNOWN = -1,
@@ -40,6 +30,11 @@ class Statement
 	Statement(unsigned l, std::string a);
 	Statement(const Statement& s);
 	virtual ~Statement() {}
+#ifdef PTX_STATS
+	// -memstats accounts for the statement objects apart from their strings
+	static void * operator new(size_t);
+	static void operator delete(void *);
+#endif
 
 	// member functions
 	inline unsigned GetLineNum() const {return linenum;}
@@ -82,6 +77,8 @@ class Instruction : public Statement
 	inline bool IsBranchTarget() const {return is_branch_target;}
 	inline void SetIsBranchTarget(bool b = true) {is_branch_target = b;}
 	inline Opcode GetOpcode() const {return opc;}
+	inline InstCode GetCode() const {return code;}
+	inline Mnemonic GetMnemonic() const {return CodeMnemonic(code);}
 	inline int GetRegDst() const {return reg_dst;}
 	inline int GetRegSrc0() const {return reg_src0;}
 	inline int GetRegSrc1() const {return reg_src1;}
@@ -89,10 +86,13 @@ class Instruction : public Statement
 	inline int GetMemOpType() const {return memop_type;}
 	inline bool IsMemLoad() const {return memop_type == MEM_LOAD;}
 	inline bool IsMemStore() const {return memop_type == MEM_STORE;}
+	inline unsigned GetTransactions() const {return transactions;}
+	inline void SetTransactions(unsigned t) {transactions = t;}
+	inline unsigned GetConflicts() const {return conflicts;}
+	inline void SetConflicts(unsigned c) {conflicts = c;}
 	void Classify();
 
 	static Instruction * CreateInstruction(const string&, unsigned);
-	static bool reset_fields;
 
 	~Instruction() {}
 
@@ -101,6 +101,8 @@ class Instruction : public Statement
 	unsigned op_count;
 	int label_number;
 	Opcode opc;
+	// the opcode as decoded at parse time, see Opcodes.h
+	InstCode code;
 	Instruction *branch_target;
 	bool is_branch_target;
 	int reg_src0, reg_src1, reg_src2, reg_dst;
@@ -118,6 +120,11 @@ class Instruction : public Statement
 	unsigned cond_branch:1;
 	unsigned call_op:1;
 	unsigned ret_op:1;
+	// transactions per warp of a global access, up to one per thread
+	unsigned transactions:6;
+	// passes a shared access takes for its bank conflicts, up to one per
+	// thread of a half-warp
+	unsigned conflicts:5;
 
 	public:
 	// For debugging: a snapshot of the cycle counter while processing this instr
@@ -126,6 +133,18 @@ class Instruction : public Statement
 
 typedef list<Instruction *>::iterator InstIter;
 
+// Instruction counts by class, over a block, a loop or a whole kernel
+class InstCounts
+{
+	public:
+	InstCounts() : alu(0), global(0), shared(0), local(0), branch(0), sync(0) {}
+	void Add(const Instruction *);
+	void Add(const InstCounts&);
+	inline unsigned long GetTotal() const {return alu + global + shared + local + branch + sync;}
+
+	unsigned long alu, global, shared, local, branch, sync;
+};
+
 // Class Label subclasses from class Statement and represents a ptx label
 // Labels are very crucial to identifying basic-blocks and loops. Each label
 // contains a pointer to the target instruction, as you might expect
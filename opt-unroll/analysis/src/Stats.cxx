@@ -0,0 +1,432 @@
+#include "Stats.h"
+#include "Emitter.h"
+#include "Utils.h"
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <time.h>
+using namespace std;
+
+static __thread Phase current_phase = PHASE_OTHER;
+static __thread PhaseStats *current_stats = 0;
+static __thread MemStats *current_mem = 0;
+static __thread int current_category = -1;
+
+Phase CurrentPhase()
+{
+	return current_phase;
+}
+
+void SetCurrentPhase(Phase phase)
+{
+	current_phase = phase;
+}
+
+PhaseStats * CurrentStats()
+{
+	return current_stats;
+}
+
+void SetStats(PhaseStats *stats)
+{
+	current_stats = stats;
+	if (stats) stats->Start();
+}
+
+MemStats * CurrentMemStats()
+{
+	return current_mem;
+}
+
+void SetMemStats(MemStats *mem)
+{
+	current_mem = mem;
+}
+
+MemCategoryScope::MemCategoryScope(MemCategory category) : saved(current_category)
+{
+	current_category = category;
+}
+
+MemCategoryScope::~MemCategoryScope()
+{
+	current_category = saved;
+}
+
+// A monotonic clock, cheap enough to be read on every line
+double StatsClock()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+const char * PhaseStats::PhaseName(Phase phase)
+{
+	switch (phase) {
+		case PHASE_READER: return "Reader";
+		case PHASE_PARSE: return "Parser::Parse";
+		case PHASE_CONSTRUCT: return "Kernel::Construct";
+		case PHASE_CFG: return "CFG";
+		case PHASE_LOOPS: return "DetectLoops";
+		case PHASE_CYCLES: return "CountCycles";
+		case PHASE_LIVENESS: return "Liveness";
+		case PHASE_COALESCING: return "Coalescing";
+		case PHASE_SCHEDULE: return "Schedule";
+		case PHASE_HOISTING: return "Hoisting";
+		case PHASE_OTHER:
+		default: return "Other";
+	}
+}
+
+void PhaseStats::Clear()
+{
+	for (unsigned i = 0; i < NUM_PHASES; ++i)
+		secs[i] = 0;
+	lines = instructions = blocks = 0;
+	kernels = 0;
+	mark = 0;
+}
+
+// Start charging time from now on
+void PhaseStats::Start()
+{
+	mark = StatsClock();
+}
+
+// Charge the time since the last phase switch, so that the numbers are
+// up to date before they are reported
+void PhaseStats::Checkpoint()
+{
+	Charge(current_phase);
+}
+
+void PhaseStats::Add(const PhaseStats& other)
+{
+	for (unsigned i = 0; i < NUM_PHASES; ++i)
+		secs[i] += other.secs[i];
+	lines += other.lines;
+	instructions += other.instructions;
+	blocks += other.blocks;
+	kernels += other.kernels;
+}
+
+double PhaseStats::GetTotalSeconds() const
+{
+	double total = 0;
+	for (unsigned i = 0; i < NUM_PHASES; ++i)
+		total += secs[i];
+	return total;
+}
+
+static double Rate(unsigned long long count, double secs)
+{
+	return (secs > 0) ? count / secs : 0;
+}
+
+// Report the time of each phase and the rate at which it went through
+// lines, instructions and blocks
+void PhaseStats::Dump(const string& key, const string& title) const
+{
+	Emitter& out = Out();
+	double total = GetTotalSeconds();
+
+	if (out.IsStructured()) {
+		out.BeginRecord(key);
+		out.Field("kernels", kernels);
+		out.Field("lines", lines);
+		out.Field("instructions", instructions);
+		out.Field("blocks", blocks);
+		out.Field("seconds", total);
+		out.BeginList("phases");
+		for (unsigned i = 0; i < NUM_PHASES; ++i) {
+			out.BeginRecord();
+			out.Field("phase", PhaseName((Phase) i));
+			out.Field("seconds", secs[i]);
+			out.Field("lines_per_sec", Rate(lines, secs[i]));
+			out.Field("instructions_per_sec", Rate(instructions, secs[i]));
+			out.Field("blocks_per_sec", Rate(blocks, secs[i]));
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << title << " (" << kernels << " kernel(s), " << lines << " lines, " << instructions
+		 << " instructions, " << blocks << " blocks):" << '\n';
+	os << left << setw(20) << "Phase" << right << setw(12) << "Time (ms)" << setw(8) << "%"
+		 << setw(14) << "Lines/s" << setw(14) << "Instrs/s" << setw(14) << "Blocks/s" << '\n';
+	os << fixed;
+	for (unsigned i = 0; i <= NUM_PHASES; ++i) {
+		double phase_secs = (i < NUM_PHASES) ? secs[i] : total;
+		os << left << setw(20) << ((i < NUM_PHASES) ? PhaseName((Phase) i) : "Total") << right
+			 << setw(12) << setprecision(3) << phase_secs * 1000
+			 << setw(8) << setprecision(1) << ((total > 0) ? 100 * phase_secs / total : 0.0)
+			 << setprecision(0) << setw(14) << Rate(lines, phase_secs)
+			 << setw(14) << Rate(instructions, phase_secs) << setw(14) << Rate(blocks, phase_secs) << '\n';
+	}
+	os.unsetf(ios::floatfield);
+	os.precision(6);
+}
+
+// Implementation of the memory accounting
+static const unsigned INITIAL_TABLE_SIZE = 1 << 12;
+
+const char * MemStats::CategoryName(MemCategory category)
+{
+	switch (category) {
+		case MEM_STATEMENTS: return "Statements";
+		case MEM_STRINGS: return "Strings";
+		case MEM_BLOCKS: return "Blocks";
+		case MEM_LOOPS: return "Loops";
+		case MEM_CYCLES: return "Cycles";
+		case MEM_LIVENESS: return "Liveness";
+		case MEM_COALESCING: return "Coalescing";
+		case MEM_SCHEDULE: return "Schedule";
+		case MEM_HOISTING: return "Hoisting";
+		case MEM_OTHER:
+		default: return "Other";
+	}
+}
+
+void MemWindow::Start(const long long *live, long long live_total)
+{
+	for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i)
+		peak[i] = live[i];
+	peak_total = live_total;
+	for (unsigned p = 0; p < NUM_PHASES; ++p) {
+		phase_peak[p] = 0;
+		for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i)
+			allocs[p][i] = bytes[p][i] = 0;
+	}
+}
+
+MemStats::MemStats() : live_total(0), capacity(INITIAL_TABLE_SIZE), used(0)
+{
+	for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i)
+		live[i] = 0;
+	kernel.Start(live, live_total);
+	total.Start(live, live_total);
+	table = static_cast<Entry *>(calloc(capacity, sizeof(Entry)));
+	Assert(table != 0, "Out of memory");
+}
+
+MemStats::~MemStats()
+{
+	free(table);
+}
+
+void MemStats::StartKernel()
+{
+	kernel.Start(live, live_total);
+}
+
+inline unsigned MemStats::Slot(void *ptr) const
+{
+	unsigned long long key = (unsigned long long) (size_t) ptr;
+	return (unsigned) (((key >> 4) * 11400714819323198485ULL) >> 32) & (capacity - 1);
+}
+
+void MemStats::Grow()
+{
+	Entry *old = table;
+	unsigned old_capacity = capacity;
+	capacity *= 2;
+	table = static_cast<Entry *>(calloc(capacity, sizeof(Entry)));
+	Assert(table != 0, "Out of memory");
+	for (unsigned i = 0; i < old_capacity; ++i) {
+		if (old[i].ptr == 0) continue;
+		unsigned slot = Slot(old[i].ptr);
+		while (table[slot].ptr != 0)
+			slot = (slot + 1) & (capacity - 1);
+		table[slot] = old[i];
+	}
+	free(old);
+}
+
+void MemStats::Allocated(void *ptr, size_t size, MemCategory category)
+{
+	if (2 * (used + 1) > capacity) Grow();
+	unsigned slot = Slot(ptr);
+	while (table[slot].ptr != 0)
+		slot = (slot + 1) & (capacity - 1);
+	table[slot].ptr = ptr;
+	table[slot].size = size;
+	table[slot].category = category;
+	++used;
+
+	live[category] += size;
+	live_total += size;
+	MemWindow *windows[2] = {&kernel, &total};
+	for (unsigned w = 0; w < 2; ++w) {
+		MemWindow *win = windows[w];
+		++win->allocs[current_phase][category];
+		win->bytes[current_phase][category] += size;
+		if (live[category] > win->peak[category]) win->peak[category] = live[category];
+		if (live_total > win->peak_total) win->peak_total = live_total;
+		if (live_total > win->phase_peak[current_phase]) win->phase_peak[current_phase] = live_total;
+	}
+}
+
+// Blocks allocated before tracking started are not in the table and are ignored
+void MemStats::Freed(void *ptr)
+{
+	unsigned slot = Slot(ptr);
+	while (table[slot].ptr != ptr) {
+		if (table[slot].ptr == 0) return;
+		slot = (slot + 1) & (capacity - 1);
+	}
+	live[table[slot].category] -= table[slot].size;
+	live_total -= table[slot].size;
+	--used;
+
+	// shift the rest of the probe sequence back into the hole
+	unsigned hole = slot;
+	table[hole].ptr = 0;
+	for (unsigned next = (hole + 1) & (capacity - 1); table[next].ptr != 0; next = (next + 1) & (capacity - 1)) {
+		unsigned home = Slot(table[next].ptr);
+		bool movable = (hole <= next) ? (home <= hole || home > next) : (home <= hole && home > next);
+		if (movable) {
+			table[hole] = table[next];
+			table[next].ptr = 0;
+			hole = next;
+		}
+	}
+}
+
+// The bytes allocated in the given phase since tracking started
+unsigned long long MemStats::GetAllocatedBytes(Phase phase) const
+{
+	unsigned long long nbytes = 0;
+	for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i)
+		nbytes += total.bytes[phase][i];
+	return nbytes;
+}
+
+// Report the footprint by category and the allocations made in each phase,
+// over the last kernel or since tracking started. The footprint is also
+// given per instruction and per block, to make growth easy to spot
+void MemStats::Dump(const string& key, const string& title, bool whole, unsigned long long instrs,
+		unsigned long long blocks) const
+{
+	const MemWindow& win = whole ? total : kernel;
+	unsigned long long cat_allocs[NUM_MEM_CATEGORIES], phase_allocs[NUM_PHASES], phase_bytes[NUM_PHASES];
+	unsigned long long nallocs = 0, nbytes = 0;
+	for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i)
+		cat_allocs[i] = 0;
+	for (unsigned p = 0; p < NUM_PHASES; ++p) {
+		phase_allocs[p] = phase_bytes[p] = 0;
+		for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i) {
+			cat_allocs[i] += win.allocs[p][i];
+			phase_allocs[p] += win.allocs[p][i];
+			phase_bytes[p] += win.bytes[p][i];
+		}
+		nallocs += phase_allocs[p];
+		nbytes += phase_bytes[p];
+	}
+	double live_per_inst = instrs ? double(live_total) / instrs : 0;
+	double peak_per_inst = instrs ? double(win.peak_total) / instrs : 0;
+	double live_per_block = blocks ? double(live_total) / blocks : 0;
+	double peak_per_block = blocks ? double(win.peak_total) / blocks : 0;
+
+	Emitter& out = Out();
+	if (out.IsStructured()) {
+		out.BeginRecord(key);
+		out.Field("live_bytes", (unsigned long long) live_total);
+		out.Field("peak_bytes", (unsigned long long) win.peak_total);
+		out.Field("allocations", nallocs);
+		out.Field("allocated_bytes", nbytes);
+		out.Field("live_bytes_per_instruction", live_per_inst);
+		out.Field("peak_bytes_per_instruction", peak_per_inst);
+		out.Field("live_bytes_per_block", live_per_block);
+		out.Field("peak_bytes_per_block", peak_per_block);
+		out.BeginList("categories");
+		for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i) {
+			out.BeginRecord();
+			out.Field("category", CategoryName((MemCategory) i));
+			out.Field("live_bytes", (unsigned long long) live[i]);
+			out.Field("peak_bytes", (unsigned long long) win.peak[i]);
+			out.Field("allocations", cat_allocs[i]);
+			out.EndRecord();
+		}
+		out.EndList();
+		out.BeginList("phases");
+		for (unsigned p = 0; p < NUM_PHASES; ++p) {
+			out.BeginRecord();
+			out.Field("phase", PhaseStats::PhaseName((Phase) p));
+			out.Field("allocations", phase_allocs[p]);
+			out.Field("allocated_bytes", phase_bytes[p]);
+			out.Field("peak_bytes", (unsigned long long) win.phase_peak[p]);
+			out.BeginRecord("allocations_by_category");
+			for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i)
+				out.Field(CategoryName((MemCategory) i), win.allocs[p][i]);
+			out.EndRecord();
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	os << title << ": " << live_total << " bytes live, " << win.peak_total << " bytes peak, "
+		 << nallocs << " allocations (" << nbytes << " bytes)" << '\n';
+	os << left << setw(20) << "Category" << right << setw(14) << "Live (bytes)" << setw(14) << "Peak (bytes)"
+		 << setw(12) << "Allocs" << '\n';
+	for (unsigned i = 0; i < NUM_MEM_CATEGORIES; ++i) {
+		os << left << setw(20) << CategoryName((MemCategory) i) << right << setw(14) << live[i]
+			 << setw(14) << win.peak[i] << setw(12) << cat_allocs[i] << '\n';
+	}
+	os << left << setw(20) << "Phase" << right << setw(14) << "Alloc (bytes)" << setw(14) << "Peak (bytes)"
+		 << setw(12) << "Allocs" << '\n';
+	for (unsigned p = 0; p < NUM_PHASES; ++p) {
+		os << left << setw(20) << PhaseStats::PhaseName((Phase) p) << right << setw(14) << phase_bytes[p]
+			 << setw(14) << win.phase_peak[p] << setw(12) << phase_allocs[p] << '\n';
+	}
+	os << fixed << setprecision(1);
+	os << "Bytes per instruction: " << live_per_inst << " live, " << peak_per_inst << " peak" << '\n';
+	os << "Bytes per block: " << live_per_block << " live, " << peak_per_block << " peak" << '\n';
+	os.unsetf(ios::floatfield);
+	os.precision(6);
+}
+
+#ifdef PTX_STATS
+// The category of an allocation made in the given phase
+static MemCategory PhaseCategory(Phase phase)
+{
+	switch (phase) {
+		case PHASE_READER:
+		case PHASE_PARSE: return MEM_STRINGS;
+		case PHASE_CONSTRUCT: return MEM_STATEMENTS;
+		case PHASE_CFG: return MEM_BLOCKS;
+		case PHASE_LOOPS: return MEM_LOOPS;
+		case PHASE_CYCLES: return MEM_CYCLES;
+		case PHASE_LIVENESS: return MEM_LIVENESS;
+		case PHASE_COALESCING: return MEM_COALESCING;
+		case PHASE_SCHEDULE: return MEM_SCHEDULE;
+		case PHASE_HOISTING: return MEM_HOISTING;
+		case PHASE_OTHER:
+		default: return MEM_OTHER;
+	}
+}
+
+// The allocation hooks. Sizes are what malloc actually handed out,
+// rounding included
+void MemStatsAllocated(void *ptr, size_t size)
+{
+	if (current_mem == 0) return;
+	MemStats *mem = current_mem;
+	// keep the table's own bookkeeping out of the picture
+	current_mem = 0;
+	MemCategory category = (current_category >= 0) ? (MemCategory) current_category : PhaseCategory(current_phase);
+	mem->Allocated(ptr, size, category);
+	current_mem = mem;
+}
+
+void MemStatsFreed(void *ptr)
+{
+	if (current_mem) current_mem->Freed(ptr);
+}
+#endif
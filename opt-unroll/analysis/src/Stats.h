@@ -0,0 +1,173 @@
+#ifndef _STATS_H_INCLUDED_
+#define _STATS_H_INCLUDED_
+
+#include <cstddef>
+#include <string>
+using namespace std;
+
+// Phase timers and throughput counters for -stats. Every phase is charged
+// its exclusive time: entering a phase pauses the enclosing one, so the
+// Reader time is not counted again under Parser::Parse, nor Parse under
+// Kernel::Construct. Anything outside the listed phases, such as writing
+// the reports, is charged to PHASE_OTHER.
+//
+// Memory accounting for -memstats tracks every allocation made by the
+// thread while enabled, by the phase it was made in and by category.
+// The category follows from the phase (the CFG phase builds blocks, the
+// cycle counts build the cycle maps, etc.), except for statement objects,
+// which are tagged wherever they are created.
+//
+// The library leaves operator new alone: allocations are only seen when
+// the program reports them through MemStatsAllocated() and MemStatsFreed().
+// ptx-analyze and ptx-bench replace the global operator new and delete to
+// do so (see Allocator.cxx); a program embedding the library may do the
+// same, or keep its own allocator and go without -memstats.
+//
+// The instrumentation is only compiled in with PTX_STATS defined (the
+// default, see the Makefile); otherwise TIME_PHASE and MEM_CATEGORY expand
+// to nothing and the allocation hooks are left out
+
+// A monotonic clock, cheap enough to be read on every line
+double StatsClock();
+
+typedef enum {PHASE_READER, PHASE_PARSE, PHASE_CONSTRUCT, PHASE_CFG, PHASE_LOOPS, PHASE_CYCLES,
+	PHASE_LIVENESS, PHASE_COALESCING, PHASE_SCHEDULE, PHASE_HOISTING, PHASE_OTHER, NUM_PHASES} Phase;
+
+class PhaseStats
+{
+	public:
+	PhaseStats() {Clear();}
+	void Clear();
+	void Start();
+	void Checkpoint();
+	void Add(const PhaseStats&);
+	void Dump(const string&, const string&) const;
+	double GetTotalSeconds() const;
+
+	static const char * PhaseName(Phase);
+
+	double secs[NUM_PHASES];
+	unsigned long long lines, instructions, blocks;
+	unsigned kernels;
+
+	// charge the time since the last switch to the given phase
+	inline void Charge(Phase phase)
+	{
+		double now = StatsClock();
+		secs[phase] += now - mark;
+		mark = now;
+	}
+
+	private:
+	double mark;
+};
+
+typedef enum {MEM_STATEMENTS, MEM_STRINGS, MEM_BLOCKS, MEM_LOOPS, MEM_CYCLES, MEM_LIVENESS, MEM_COALESCING,
+	MEM_SCHEDULE, MEM_HOISTING, MEM_OTHER, NUM_MEM_CATEGORIES} MemCategory;
+
+// Allocation counters over a window of time, such as one kernel
+class MemWindow
+{
+	public:
+	void Start(const long long *, long long);
+	long long peak[NUM_MEM_CATEGORIES];
+	long long peak_total;
+	long long phase_peak[NUM_PHASES];
+	unsigned long long allocs[NUM_PHASES][NUM_MEM_CATEGORIES];
+	unsigned long long bytes[NUM_PHASES][NUM_MEM_CATEGORIES];
+};
+
+class MemStats
+{
+	public:
+	MemStats();
+	~MemStats();
+	void Allocated(void *, size_t, MemCategory);
+	void Freed(void *);
+	void StartKernel();
+	void Dump(const string&, const string&, bool, unsigned long long, unsigned long long) const;
+	unsigned long long GetAllocatedBytes(Phase) const;
+	inline long long GetPeakBytes() const {return total.peak_total;}
+
+	static const char * CategoryName(MemCategory);
+
+	private:
+	MemStats(const MemStats&);
+	MemStats& operator=(const MemStats&);
+
+	class Entry
+	{
+		public:
+		void *ptr;
+		size_t size;
+		MemCategory category;
+	};
+	void Grow();
+	unsigned Slot(void *) const;
+
+	long long live[NUM_MEM_CATEGORIES];
+	long long live_total;
+	MemWindow kernel, total;
+
+	// the blocks allocated while tracking, in an open-addressed table that
+	// lives on malloc so that tracking does not track itself
+	Entry *table;
+	unsigned capacity, used;
+};
+
+// The phase the current thread is in
+Phase CurrentPhase();
+void SetCurrentPhase(Phase);
+
+// The statistics the current thread charges its phases and allocations
+// to, if any
+PhaseStats * CurrentStats();
+void SetStats(PhaseStats *);
+MemStats * CurrentMemStats();
+void SetMemStats(MemStats *);
+
+class PhaseTimer
+{
+	public:
+	PhaseTimer(Phase p) : saved(CurrentPhase())
+	{
+		PhaseStats *stats = CurrentStats();
+		if (stats) stats->Charge(saved);
+		SetCurrentPhase(p);
+	}
+	~PhaseTimer()
+	{
+		PhaseStats *stats = CurrentStats();
+		if (stats) stats->Charge(CurrentPhase());
+		SetCurrentPhase(saved);
+	}
+
+	private:
+	Phase saved;
+};
+
+// Overrides the category of the allocations made in its scope
+class MemCategoryScope
+{
+	public:
+	MemCategoryScope(MemCategory);
+	~MemCategoryScope();
+
+	private:
+	int saved;
+};
+
+#ifdef PTX_STATS
+// Report a block the allocator handed out, of its usable size, or took
+// back, to the memory statistics of the current thread if any
+void MemStatsAllocated(void *, size_t);
+void MemStatsFreed(void *);
+
+#define TIME_PHASE(phase) PhaseTimer _phase_timer(phase)
+#define MEM_CATEGORY(category) MemCategoryScope _mem_category(category)
+#else
+#define TIME_PHASE(phase)
+#define MEM_CATEGORY(category)
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+#include "ThreadPool.h"
+#include "Utils.h"
+#include <iostream>
+#include <unistd.h>
+
+// Run the task, keeping what it threw rather than letting it take the
+// worker, and the whole process with it, down
+void Task::Execute()
+{
+	try {
+		Run();
+	} catch (exception& e) {
+		failed = true;
+		message = e.what();
+	} catch (...) {
+		failed = true;
+		message = "Task aborted";
+	}
+}
+
+// Spawn the workers; a thread count of 0 picks one worker per online cpu
+ThreadPool::ThreadPool(unsigned nthreads) : pending(0), shutdown(false)
+{
+	if (nthreads == 0) nthreads = DefaultNumThreads();
+
+	pthread_mutex_init(&lock, 0);
+	pthread_cond_init(&work_ready, 0);
+	pthread_cond_init(&work_done, 0);
+
+	for (unsigned i = 0; i < nthreads; ++i) {
+		pthread_t tid;
+		int err = pthread_create(&tid, 0, ThreadPool::WorkerMain, this);
+		Assert(err == 0, "Unable to create worker thread");
+		workers.push_back(tid);
+	}
+}
+
+// Drain outstanding work, then tell the workers to exit and reap them
+ThreadPool::~ThreadPool()
+{
+	Wait();
+
+	pthread_mutex_lock(&lock);
+	shutdown = true;
+	pthread_cond_broadcast(&work_ready);
+	pthread_mutex_unlock(&lock);
+
+	for (unsigned i = 0; i < workers.size(); ++i) {
+		pthread_join(workers[i], 0);
+	}
+
+	pthread_cond_destroy(&work_done);
+	pthread_cond_destroy(&work_ready);
+	pthread_mutex_destroy(&lock);
+}
+
+void ThreadPool::Submit(Task *task)
+{
+	pthread_mutex_lock(&lock);
+	queue.push_back(task);
+	++pending;
+	pthread_cond_signal(&work_ready);
+	pthread_mutex_unlock(&lock);
+}
+
+// Block the caller till every task submitted so far has finished running
+void ThreadPool::Wait()
+{
+	pthread_mutex_lock(&lock);
+	while (pending > 0) {
+		pthread_cond_wait(&work_done, &lock);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+unsigned ThreadPool::DefaultNumThreads()
+{
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return (ncpus > 0) ? (unsigned) ncpus : 1;
+}
+
+void * ThreadPool::WorkerMain(void *arg)
+{
+	ThreadPool *pool = static_cast<ThreadPool *>(arg);
+
+	while (true) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->queue.empty() && !pool->shutdown) {
+			pthread_cond_wait(&pool->work_ready, &pool->lock);
+		}
+		if (pool->queue.empty()) {
+			// shutting down and nothing left to do
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		Task *task = pool->queue.front();
+		pool->queue.pop_front();
+		pthread_mutex_unlock(&pool->lock);
+
+		task->Execute();
+		if (task->DeleteWhenDone()) {
+			// nobody is left to look at the failure
+			if (task->Failed())
+				cerr << task->GetMessage() << endl;
+			delete task;
+		}
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->pending == 0) {
+			pthread_cond_broadcast(&pool->work_done);
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return 0;
+}
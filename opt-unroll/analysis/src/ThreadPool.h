@@ -0,0 +1,59 @@
+#ifndef _THREADPOOL_H_INCLUDED_
+#define _THREADPOOL_H_INCLUDED_
+
+#include <pthread.h>
+#include <deque>
+#include <string>
+#include <vector>
+using namespace std;
+
+// A unit of work that can be handed over to the thread pool. The pool
+// does not take ownership of tasks - the submitter is responsible for
+// keeping them alive until Wait() returns and releasing them afterwards.
+// Fire-and-forget tasks that nobody waits on can ask the pool to delete
+// them once they have run. A task that throws is marked as failed, with
+// the message of what it threw, for the submitter to check once it is done
+class Task
+{
+	public:
+	Task() : failed(false) {}
+	virtual ~Task() {}
+	virtual void Run() = 0;
+	virtual bool DeleteWhenDone() const {return false;}
+	void Execute();
+	inline bool Failed() const {return failed;}
+	inline const string& GetMessage() const {return message;}
+
+	protected:
+	bool failed;
+	string message;
+};
+
+// A minimal fixed-size pool of worker threads fed from a single queue.
+// Tasks are expected to be independent of each other; there is no
+// ordering guarantee beyond FIFO dispatch
+class ThreadPool
+{
+	public:
+	ThreadPool(unsigned nthreads = 0);
+	~ThreadPool();
+	void Submit(Task *);
+	void Wait();
+	inline unsigned GetNumThreads() const {return workers.size();}
+
+	static unsigned DefaultNumThreads();
+
+	private:
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+	static void * WorkerMain(void *);
+
+	vector <pthread_t> workers;
+	deque <Task *> queue;
+	pthread_mutex_t lock;
+	pthread_cond_t work_ready, work_done;
+	unsigned pending;
+	bool shutdown;
+};
+
+#endif
@@ -0,0 +1,333 @@
+#include "TripCount.h"
+#include "Parser.h"
+#include <climits>
+#include <cstdlib>
+#include <set>
+#include <sstream>
+using namespace std;
+
+// The comparison that holds when the given one does not, and the one that
+// holds with its operands swapped
+static string Negate(const string& cc)
+{
+	if (cc == "lt") return "ge";
+	if (cc == "le") return "gt";
+	if (cc == "gt") return "le";
+	if (cc == "ge") return "lt";
+	if (cc == "eq") return "ne";
+	if (cc == "ne") return "eq";
+	return "";
+}
+
+static string Swap(const string& cc)
+{
+	if (cc == "lt") return "gt";
+	if (cc == "le") return "ge";
+	if (cc == "gt") return "lt";
+	if (cc == "ge") return "le";
+	return cc;
+}
+
+static bool IsImmediate(const string& operand)
+{
+	return !operand.empty() && (isdigit(operand[0]) || (operand[0] == '-' && operand.size() > 1 && isdigit(operand[1])));
+}
+
+// Immediates are 32 bits wide, so 0xffffffff is -1
+static long ParseImmediate(const string& operand)
+{
+	return (long) (int) (unsigned) strtoul(operand.c_str(), 0, 0);
+}
+
+static string ToString(long value)
+{
+	ostringstream os;
+	os << value;
+	return os.str();
+}
+
+// The opcode and operands, split at spaces and commas
+void TripCount::Tokenize(const Instruction *inst, vector<string>& tokens)
+{
+	const string& buf = inst->GetAscii();
+	unsigned start = Parser::IsLabel(buf) ? Parser::GetInstPos(buf) : 0;
+	tokens.clear();
+	while (start < buf.size()) {
+		while (start < buf.size() && (buf[start] == SPACE_CHAR || buf[start] == '\t' || buf[start] == ',')) ++start;
+		if (start == buf.size()) break;
+		unsigned end = start;
+		while (end < buf.size() && buf[end] != SPACE_CHAR && buf[end] != '\t' && buf[end] != ',') ++end;
+		tokens.push_back(buf.substr(start, end - start));
+		start = end;
+	}
+}
+
+// The register a $rN operand names, -1 for anything else, halves of
+// registers included
+int TripCount::ParseRegister(const string& operand)
+{
+	if (operand.size() < 3 || operand[0] != '$' || operand[1] != 'r') return -1;
+	for (unsigned i = 2; i < operand.size(); ++i) {
+		if (!isdigit(operand[i])) return -1;
+	}
+	return atoi(operand.c_str() + 2);
+}
+
+TripCount::TripCount(const Loop *l)
+: loop(l), kind(TRIP_DEFAULT), iterations(l->GetNumIters()), compare(0)
+{
+	const BasicBlock *footer = loop->GetFooter();
+	if (footer == 0) return;
+	const Instruction *branch = footer->GetLastInst();
+	if (!branch->IsCondBranch() || branch->GetBranchTarget() != loop->GetHeader()->GetFirstInst()) return;
+
+	// @$pN.<flag> bra
+	vector <string> tokens;
+	Tokenize(branch, tokens);
+	if (tokens.empty() || tokens[0][0] != AT_CHAR) return;
+	size_t dot = tokens[0].find(DOT_CHAR);
+	if (dot == string::npos) return;
+	const string& pred = tokens[0].substr(1, dot - 1);
+	const string& flag = tokens[0].substr(dot + 1);
+	bool holds;
+	if (flag == "ne" || flag == "lt") holds = true;
+	else if (flag == "eq" || flag == "ge") holds = false;
+	else return;
+
+	// the last write of the predicate in the footer, which must be a compare
+	vector <string> operands;
+	if (branch == footer->GetFirstInst()) return;
+	for (const Instruction *inst = branch->GetPrev(); inst != 0; inst = inst->GetPrev()) {
+		Tokenize(inst, tokens);
+		if (tokens.size() > 1 && (tokens[1] == pred || tokens[1].compare(0, pred.size() + 1, pred + "|") == 0)) {
+			compare = inst;
+			operands = tokens;
+			break;
+		}
+		if (inst == footer->GetFirstInst()) break;
+	}
+	if (compare == 0 || operands.size() < 4) return;
+
+	// set.<cc>.<type> or setp.<cc>.<type>
+	const string& opcode = operands[0];
+	size_t first_dot = opcode.find(DOT_CHAR);
+	if (first_dot == string::npos) return;
+	if (compare->GetMnemonic() != MN_SET && compare->GetMnemonic() != MN_SETP) return;
+	size_t second_dot = opcode.find(DOT_CHAR, first_dot + 1);
+	string cc = opcode.substr(first_dot + 1, (second_dot == string::npos) ? string::npos : second_dot - first_dot - 1);
+	if (!holds) cc = Negate(cc);
+	if (cc.empty()) return;
+
+	// the induction variable on either side
+	long step = 0;
+	bool post = false;
+	string bound_operand;
+	int reg = ParseRegister(operands[2]);
+	if (reg >= 0 && FindIncrement(reg, step, post)) bound_operand = operands[3];
+	else {
+		reg = ParseRegister(operands[3]);
+		if (reg < 0 || !FindIncrement(reg, step, post)) return;
+		bound_operand = operands[2];
+		cc = Swap(cc);
+	}
+
+	const TripTerm& init = FindValue(reg);
+	const TripTerm& bound = ParseTerm(bound_operand);
+	if (init.known && bound.known) Count(cc, init, bound, step, post);
+}
+
+// Whether the loop leaves the register alone
+bool TripCount::IsInvariant(const Loop *loop, int reg)
+{
+	for (BBSetConstIter iter = loop->NatLoopBegin(); iter != loop->NatLoopEnd(); ++iter) {
+		const BasicBlock *bb = *iter;
+		for (const Instruction *inst = bb->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+			if (!inst->IsDeleted() && !inst->IsMemStore() && inst->GetRegDst() == reg) return false;
+			if (inst == bb->GetLastInst()) break;
+		}
+	}
+	return true;
+}
+
+// The single write of the register in the loop, 0 if there are none or
+// several of them. Tells whether it is in the header or the footer
+const Instruction * TripCount::FindDef(const Loop *loop, int reg, bool& every_iteration)
+{
+	const Instruction *def = 0;
+	const BasicBlock *block = 0;
+	for (BBSetConstIter iter = loop->NatLoopBegin(); iter != loop->NatLoopEnd(); ++iter) {
+		const BasicBlock *bb = *iter;
+		for (const Instruction *inst = bb->GetFirstInst(); inst != 0; inst = inst->GetNext()) {
+			if (!inst->IsDeleted() && !inst->IsMemStore() && inst->GetRegDst() == reg) {
+				if (def) return 0;
+				def = inst;
+				block = bb;
+			}
+			if (inst == bb->GetLastInst()) break;
+		}
+	}
+	every_iteration = (block == loop->GetHeader() || block == loop->GetFooter());
+	return def;
+}
+
+// The single write of the register in the loop, if it adds a constant step
+// to it in a block every iteration runs through: the header or the footer
+const Instruction * TripCount::FindStep(const Loop *loop, int reg, long& step)
+{
+	bool every_iteration;
+	const Instruction *increment = FindDef(loop, reg, every_iteration);
+	if (increment == 0 || !every_iteration) return 0;
+
+	vector <string> tokens;
+	Tokenize(increment, tokens);
+	if (tokens.size() != 4 || tokens[0][0] == AT_CHAR || ParseRegister(tokens[1]) != reg) return 0;
+	const Mnemonic mnemonic = increment->GetMnemonic();
+	if (mnemonic == MN_ADD && ParseRegister(tokens[1]) == ParseRegister(tokens[2]) && IsImmediate(tokens[3]))
+		step = ParseImmediate(tokens[3]);
+	else if (mnemonic == MN_ADD && ParseRegister(tokens[1]) == ParseRegister(tokens[3]) && IsImmediate(tokens[2]))
+		step = ParseImmediate(tokens[2]);
+	else if (mnemonic == MN_SUB && ParseRegister(tokens[1]) == ParseRegister(tokens[2]) && IsImmediate(tokens[3]))
+		step = -ParseImmediate(tokens[3]);
+	else
+		return 0;
+	return (step == 0) ? 0 : increment;
+}
+
+// The increment of an induction variable, and whether it is taken before
+// the compare
+const Instruction * TripCount::FindIncrement(int reg, long& step, bool& post) const
+{
+	const Instruction *increment = FindStep(loop, reg, step);
+	if (increment == 0) return 0;
+
+	// a step after the compare in the footer is taken for the next one
+	post = true;
+	const BasicBlock *footer = loop->GetFooter();
+	for (const Instruction *inst = compare; inst != 0; inst = inst->GetNext()) {
+		if (inst == increment) post = false;
+		if (inst == footer->GetLastInst()) break;
+	}
+	return increment;
+}
+
+// The value the register holds on entry to the loop, from the last mov to
+// it on the way from the preheader back
+TripTerm TripCount::FindValue(int reg) const
+{
+	const BasicBlock *bb = 0;
+	for (BBListConstIter iter = loop->GetHeader()->PredBegin(); iter != loop->GetHeader()->PredEnd(); ++iter) {
+		if (loop->InNatLoop(*iter)) continue;
+		if (bb) return TripTerm();
+		bb = *iter;
+	}
+
+	set <const BasicBlock *> visited;
+	vector <string> tokens;
+	while (bb != 0 && visited.insert(bb).second) {
+		for (const Instruction *inst = bb->GetLastInst(); inst != 0; inst = inst->GetPrev()) {
+			if (!inst->IsDeleted() && !inst->IsMemStore() && inst->GetRegDst() == reg) {
+				Tokenize(inst, tokens);
+				if (tokens.size() != 3 || tokens[0][0] == AT_CHAR || ParseRegister(tokens[1]) != reg
+						|| inst->GetMnemonic() != MN_MOV || ParseRegister(tokens[2]) >= 0)
+					return TripTerm();
+				return ParseTerm(tokens[2]);
+			}
+			if (inst == bb->GetFirstInst()) break;
+		}
+		bb = (bb->NumPred() == 1) ? *bb->PredBegin() : 0;
+	}
+	return TripTerm();
+}
+
+// An immediate, a parameter or constant at a fixed address, or a register
+// the loop leaves alone
+TripTerm TripCount::ParseTerm(const string& operand) const
+{
+	TripTerm term;
+	if (IsImmediate(operand)) {
+		term.known = true;
+		term.value = ParseImmediate(operand);
+	}
+	else if (operand.find('[') != string::npos && operand.find('$') == string::npos
+					 && (operand[0] == 's' || operand[0] == 'c')) {
+		term.known = true;
+		term.name = operand;
+	}
+	else if (ParseRegister(operand) >= 0) {
+		int reg = ParseRegister(operand);
+		if (IsInvariant(loop, reg)) return FindValue(reg);
+	}
+	return term;
+}
+
+// The trip count of a loop that compares v_k = init + (k - 1 + post) * step
+// with the bound after the k-th run of the body, and goes on while cc holds
+void TripCount::Count(const string& comparison, const TripTerm& init, const TripTerm& bound, long step, bool post)
+{
+	// integers, so <= b is < b + 1 and >= b is > b - 1
+	string cc = comparison;
+	long adjust = 0;
+	if (cc == "le") {cc = "lt"; adjust = 1;}
+	else if (cc == "ge") {cc = "gt"; adjust = -1;}
+
+	if (init.IsConstant() && bound.IsConstant()) {
+		long long first = init.value + (post ? step : 0), last = bound.value + adjust, count = 0;
+		if (cc == "lt") {
+			if (first < last && step <= 0) return;
+			if (first < last) count = (last - first + step - 1) / step;
+		}
+		else if (cc == "gt") {
+			if (first > last && step >= 0) return;
+			if (first > last) count = (first - last - step - 1) / -step;
+		}
+		else if (cc == "ne") {
+			if ((last - first) % step != 0 || (last - first) / step < 0) return;
+			count = (last - first) / step;
+		}
+		else if (cc == "eq")
+			count = (first == last) ? 1 : 0;
+		else
+			return;
+		if (count >= UINT_MAX) return;
+		kind = TRIP_CONSTANT;
+		iterations = 1 + count;
+		expr = ToString(iterations);
+		return;
+	}
+
+	// symbolic: (high - low) / stride runs, one more if the step follows
+	// the compare
+	const TripTerm *high, *low;
+	long stride;
+	if ((cc == "lt" || cc == "ne") && step > 0) {
+		high = &bound;
+		low = &init;
+		stride = step;
+	}
+	else if ((cc == "gt" || cc == "ne") && step < 0) {
+		high = &init;
+		low = &bound;
+		stride = -step;
+		adjust = -adjust;
+	}
+	else
+		return;
+
+	long constant = adjust + (high->name.empty() ? high->value : 0) - (low->name.empty() ? low->value : 0);
+	string diff;
+	if (!high->name.empty()) {
+		diff = high->name;
+		if (!low->name.empty()) diff += " - " + low->name;
+		if (constant > 0) diff += " + " + ToString(constant);
+		else if (constant < 0) diff += " - " + ToString(-constant);
+	}
+	else
+		diff = ToString(constant) + " - " + low->name;
+
+	if (diff.find(SPACE_CHAR) != string::npos && stride != 1) diff = "(" + diff + ")";
+	if (stride == 1) expr = diff;
+	else if (cc == "ne") expr = diff + " / " + ToString(stride);
+	else expr = "ceil(" + diff + " / " + ToString(stride) + ")";
+	if (!post) expr += " + 1";
+	kind = TRIP_SYMBOLIC;
+}
@@ -0,0 +1,74 @@
+#ifndef _TRIPCOUNT_H_INCLUDED_
+#define _TRIPCOUNT_H_INCLUDED_
+
+#include "CFG.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+// Trip counts of loops from their induction variables. A loop is counted
+// when its single footer ends in a conditional branch back to the header,
+// on a predicate set in the footer by comparing a register against a bound
+// (set.<cc>/setp.<cc> $pN|.., a, b). The register must be an induction
+// variable: written exactly once in the loop, by an add or sub of an
+// immediate to itself, in the header or the footer - blocks every iteration
+// runs through. Its value on entry, and the bound if it is a register not
+// written in the loop, are followed back from the preheader through blocks
+// with a single predecessor, to a mov of an immediate or of a kernel
+// parameter (s[0x..]) or constant (cN[0x..]).
+//
+// decuda's set writes all ones to its register when the comparison holds
+// and zero otherwise, so the branch's .ne (and .lt) loops while it holds
+// and .eq (and .ge) while it does not. The loops are do-while loops: the
+// body runs once, and then as long as the comparison of the induction
+// variable, incremented before or after the compare, keeps holding:
+//
+//   trip count = 1 + #{k >= 1 : cc(v_k, bound) holds for v_1 .. v_k}
+//
+// Constant trip counts replace the default count of the loop. A bound or
+// initial value only known at launch gives a symbolic trip count, such as
+// ceil((s[0x0018] - 1) / 4), which is reported while the cycle model keeps
+// the default count.
+
+// An initial value or bound: a constant, or the name of a parameter or
+// constant whose value is only known at launch
+class TripTerm
+{
+	public:
+	TripTerm() : known(false), value(0) {}
+	inline bool IsConstant() const {return known && name.empty();}
+	bool known;
+	long value;
+	string name;
+};
+
+class TripCount
+{
+	public:
+	TripCount(const Loop *);
+	inline TripKind GetKind() const {return kind;}
+	inline unsigned GetIterations() const {return iterations;}
+	inline const string& GetExpr() const {return expr;}
+
+	static void Tokenize(const Instruction *, vector<string>&);
+	static const Instruction * FindStep(const Loop *, int, long&);
+	static bool IsInvariant(const Loop *, int);
+	static const Instruction * FindDef(const Loop *, int, bool&);
+
+	private:
+	const Instruction * FindIncrement(int, long&, bool&) const;
+	TripTerm FindValue(int) const;
+	TripTerm ParseTerm(const string&) const;
+	void Count(const string&, const TripTerm&, const TripTerm&, long, bool);
+
+	static int ParseRegister(const string&);
+
+	const Loop *loop;
+	TripKind kind;
+	unsigned iterations;
+	string expr;
+	// the compare feeding the back-edge branch
+	const Instruction *compare;
+};
+
+#endif
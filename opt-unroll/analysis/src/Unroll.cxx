@@ -0,0 +1,486 @@
+#include "Unroll.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+#include "Emitter.h"
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <queue>
+using namespace std;
+
+// Reduce a loop body to the segment profile used by the cycle model. The walk
+// mirrors CFG::CountLoopCycles: every instruction issues in the cycles of its
+// opcode, runs of global/local ops form one blocking group and inner loops
+// drain the pipeline. Each copy of a group pays for its own extra
+// transactions, and each shared access for the replays of its bank conflicts
+LoopProfile::LoopProfile(const Loop *l, unsigned long long w, const CFG *cfg)
+: loop(l), weight(w), trip_count(l->GetNumIters()), body_size(l->GetNumInstrs()),
+	tail_cycles(0), overhead_cycles(0), innermost(!l->HasInnerLoops()), searchable(true)
+{
+	// loops with multiple footers cannot be walked by the cycle model either
+	if (l->GetFooter() == 0) {
+		searchable = false;
+		return;
+	}
+
+	map<const Instruction *, const Loop *> inner_headers;
+	if (l->HasInnerLoops()) {
+		for (LoopListConstIter iter = l->InnerLoopsBegin(); iter != l->InnerLoopsEnd(); ++iter) {
+			inner_headers.insert(pair<const Instruction *, const Loop *>((*iter)->GetHeader()->GetFirstInst(), *iter));
+		}
+	}
+
+	Instruction *inst = l->GetHeader()->GetFirstInst();
+	Instruction *end = l->GetFooter()->GetLastInst()->GetNext();
+	unsigned long long current = 0, transaction_cycles = 0;
+
+	while (inst != end) {
+		if (inst == 0) {
+			searchable = false;
+			return;
+		}
+
+		map<const Instruction *, const Loop *>::const_iterator inner = inner_headers.find(inst);
+		if (inner != inner_headers.end()) {
+			// inner loops are costed on their own, here they only close a segment
+			segments.push_back(LoopSegment(current, SEG_FLUSH));
+			current = 0;
+			if (inner->second->GetFooter() == 0) {
+				searchable = false;
+				return;
+			}
+			inst = inner->second->GetFooter()->GetLastInst()->GetNext();
+			continue;
+		}
+
+		current += cfg->IssueCycles(inst);
+		if (inst->IsGlobalOp() || inst->IsLocalOp()) {
+			Instruction *next = inst->GetNext();
+			bool grouped = (next != 0 && next != end && (next->IsGlobalOp() || next->IsLocalOp())
+											&& inner_headers.find(next) == inner_headers.end());
+			transaction_cycles += cfg->TransactionCycles(inst);
+			if (!grouped) {
+				segments.push_back(LoopSegment(current, SEG_MEM, transaction_cycles));
+				current = transaction_cycles = 0;
+			}
+		}
+		else if (inst->IsSyncOp()) {
+			segments.push_back(LoopSegment(current, SEG_SYNC));
+			current = 0;
+		}
+		inst = inst->GetNext();
+	}
+	tail_cycles = current;
+
+	// the loop-closing branch is the only instruction that unrolling removes
+	if (l->GetFooter()->GetLastInst()->IsBranchOp())
+		overhead_cycles = min<unsigned long long>(4, tail_cycles);
+}
+
+// Cycles taken by one iteration of the body unrolled u times. The cycles after
+// the last blocking point wrap around into the first segment of the next iteration
+unsigned long long LoopProfile::BodyCycles(unsigned u, unsigned num_warps) const
+{
+	unsigned long long total = 0;
+	unsigned copies = innermost ? u : 1;
+
+	if (segments.empty())
+		return (copies * tail_cycles - (copies - 1) * overhead_cycles) * num_warps;
+
+	for (unsigned i = 0; i < segments.size(); ++i) {
+		unsigned long long cycles = copies * segments[i].cycles;
+		if (i == 0)
+			cycles += copies * tail_cycles - (copies - 1) * overhead_cycles;
+
+		if (segments[i].kind == SEG_MEM)
+			total += max<unsigned long long>(cycles * num_warps,
+																			 GLOBAL_MEM_LATENCY + copies * segments[i].transaction_cycles);
+		else
+			total += cycles * num_warps;
+	}
+
+	// Copies of an outer loop body stay separated by the inner loops, so their
+	// blocking groups cannot be merged; only the branch overhead goes away
+	if (!innermost)
+		total = u * total - (u - 1) * overhead_cycles * num_warps;
+	return total;
+}
+
+// Total cycles spent in this loop (inner loops excluded) over the whole kernel
+// run when it is unrolled u times, including the remainder iterations
+unsigned long long LoopProfile::Evaluate(unsigned u, unsigned num_warps) const
+{
+	Assert(u > 0, "Invalid unroll factor");
+	unsigned long long cycles = (trip_count / u) * BodyCycles(u, num_warps);
+	if (trip_count % u)
+		cycles += (trip_count % u) * BodyCycles(1, num_warps);
+	return weight * cycles;
+}
+
+// Number of copies of the body in the unrolled code, counting the remainder loop
+unsigned LoopProfile::Copies(unsigned u) const
+{
+	return u + ((trip_count % u) ? 1 : 0);
+}
+
+unsigned long long LoopProfile::CodeSize(unsigned u) const
+{
+	return (unsigned long long) body_size * Copies(u);
+}
+
+// A unit of work for the thread pool: evaluate one unroll factor of one loop
+class UnrollCandidateTask : public Task
+{
+	public:
+	UnrollCandidateTask(const LoopProfile *p, UnrollCandidate *c, unsigned w)
+	: profile(p), candidate(c), num_warps(w) {}
+	void Run()
+	{
+		candidate->cycles = profile->Evaluate(candidate->factor, num_warps);
+		candidate->code_size = profile->CodeSize(candidate->factor);
+	}
+
+	private:
+	const LoopProfile *profile;
+	UnrollCandidate *candidate;
+	unsigned num_warps;
+};
+
+static bool CompareProfileIds(const LoopProfile *x, const LoopProfile *y)
+{
+	return x->GetLoop()->Id() < y->GetLoop()->Id();
+}
+
+static bool CompareCandidates(const UnrollCandidate *x, const UnrollCandidate *y)
+{
+	if (x->cycles != y->cycles) return x->cycles < y->cycles;
+	return x->code_size < y->code_size;
+}
+
+UnrollSearch::UnrollSearch(const CFG *c, unsigned nwarps, unsigned mfactor, unsigned nthreads)
+: cfg(c), num_warps(nwarps), max_factor(mfactor), num_threads(nthreads), rolled_cycles(0), pruned(0)
+{
+	if (max_factor == 0) max_factor = 1;
+}
+
+UnrollSearch::~UnrollSearch()
+{
+	for (unsigned i = 0; i < profiles.size(); ++i) {
+		delete profiles[i];
+	}
+	profiles.clear();
+}
+
+// Profile a loop and all the loops nested inside it. The weight of a loop is
+// the number of times it is entered, i.e the product of enclosing trip counts
+void UnrollSearch::CollectLoops(const Loop *loop, unsigned long long weight)
+{
+	profiles.push_back(new LoopProfile(loop, weight, cfg));
+	if (loop->HasInnerLoops()) {
+		for (LoopListConstIter iter = loop->InnerLoopsBegin(); iter != loop->InnerLoopsEnd(); ++iter) {
+			CollectLoops(*iter, weight * loop->GetNumIters());
+		}
+	}
+}
+
+void UnrollSearch::Run(unsigned nconfigs)
+{
+	if (!cfg->HasLoops()) return;
+
+	for (LoopListConstIter iter = cfg->LoopsBegin(); iter != cfg->LoopsEnd(); ++iter) {
+		CollectLoops(*iter, 1);
+	}
+	// .uconf lists factors in the order loops were discovered
+	sort(profiles.begin(), profiles.end(), CompareProfileIds);
+
+	for (unsigned i = 0; i < profiles.size(); ++i) {
+		LoopProfile *profile = profiles[i];
+		profile->candidates.push_back(UnrollCandidate(1));
+		if (!profile->IsSearchable()) continue;
+		for (unsigned u = 2; u <= max_factor && u <= profile->GetTripCount(); ++u) {
+			profile->candidates.push_back(UnrollCandidate(u));
+		}
+	}
+
+	// Evaluate every (loop, factor) pair on the pool; the profiles are
+	// read-only at this point so the tasks need no locking
+	vector <Task *> tasks;
+	{
+		ThreadPool pool(num_threads);
+		for (unsigned i = 0; i < profiles.size(); ++i) {
+			LoopProfile *profile = profiles[i];
+			for (unsigned j = 0; j < profile->candidates.size(); ++j) {
+				Task *task = new UnrollCandidateTask(profile, &profile->candidates[j], num_warps);
+				tasks.push_back(task);
+				pool.Submit(task);
+			}
+		}
+		pool.Wait();
+	}
+	string message;
+	for (unsigned i = 0; i < tasks.size(); ++i) {
+		if (tasks[i]->Failed() && message.empty()) message = tasks[i]->GetMessage();
+		delete tasks[i];
+	}
+	Assert(message.empty(), message);
+
+	for (unsigned i = 0; i < profiles.size(); ++i) {
+		rolled_cycles += profiles[i]->candidates[0].cycles;
+		Prune(profiles[i]);
+	}
+	RankConfigs(nconfigs);
+}
+
+// Drop every factor that is no faster than some other factor of the same loop
+// while generating at least as much code
+void UnrollSearch::Prune(LoopProfile *profile)
+{
+	vector <UnrollCandidate>& cands = profile->candidates;
+	for (unsigned i = 0; i < cands.size(); ++i) {
+		for (unsigned j = 0; j < cands.size() && !cands[i].dominated; ++j) {
+			if (i == j) continue;
+			if (cands[j].cycles <= cands[i].cycles && cands[j].code_size <= cands[i].code_size
+					&& (cands[j].cycles < cands[i].cycles || cands[j].code_size < cands[i].code_size)) {
+				cands[i].dominated = true;
+				++pruned;
+			}
+		}
+		if (!cands[i].dominated)
+			profile->front.push_back(&cands[i]);
+	}
+	sort(profile->front.begin(), profile->front.end(), CompareCandidates);
+}
+
+unsigned long long
+UnrollSearch::ConfigCodeSize(const Loop *loop, const map<const Loop *, unsigned>& factors) const
+{
+	unsigned long long size = loop->GetNumInstrs();
+	if (loop->HasInnerLoops()) {
+		for (LoopListConstIter iter = loop->InnerLoopsBegin(); iter != loop->InnerLoopsEnd(); ++iter) {
+			size -= (*iter)->GetNumInstrs();
+			size += ConfigCodeSize(*iter, factors);
+		}
+	}
+	unsigned u = factors.find(loop)->second;
+	unsigned trip_count = loop->GetNumIters();
+	return size * (u + ((trip_count % u) ? 1 : 0));
+}
+
+typedef pair<unsigned long long, vector<unsigned> > RankEntry;
+
+// Loops are costed independently of each other, so the k best configurations
+// are the k smallest sums over the per-loop fronts. Enumerate them best-first
+// from the configuration that picks the fastest factor for every loop
+void UnrollSearch::RankConfigs(unsigned nconfigs)
+{
+	priority_queue<RankEntry, vector<RankEntry>, greater<RankEntry> > worklist;
+	set<vector<unsigned> > seen;
+
+	vector<unsigned> best(profiles.size(), 0);
+	unsigned long long best_cycles = 0;
+	for (unsigned i = 0; i < profiles.size(); ++i) {
+		best_cycles += profiles[i]->front[0]->cycles;
+	}
+	worklist.push(RankEntry(best_cycles, best));
+	seen.insert(best);
+
+	while (!worklist.empty() && ranked.size() < nconfigs) {
+		RankEntry entry = worklist.top();
+		worklist.pop();
+
+		UnrollConfig config;
+		map<const Loop *, unsigned> factors;
+		config.cycles = entry.first;
+		for (unsigned i = 0; i < profiles.size(); ++i) {
+			unsigned factor = profiles[i]->front[entry.second[i]]->factor;
+			config.choice.push_back(factor);
+			factors.insert(pair<const Loop *, unsigned>(profiles[i]->GetLoop(), factor));
+		}
+		config.code_size = 0;
+		for (LoopListConstIter iter = cfg->LoopsBegin(); iter != cfg->LoopsEnd(); ++iter) {
+			config.code_size += ConfigCodeSize(*iter, factors);
+		}
+		ranked.push_back(config);
+
+		// the neighbours of a configuration swap in the next factor for one loop
+		for (unsigned i = 0; i < profiles.size(); ++i) {
+			unsigned idx = entry.second[i];
+			if (idx + 1 >= profiles[i]->front.size()) continue;
+			vector<unsigned> next = entry.second;
+			++next[i];
+			if (seen.find(next) != seen.end()) continue;
+			seen.insert(next);
+			unsigned long long cycles = entry.first - profiles[i]->front[idx]->cycles
+																	+ profiles[i]->front[idx + 1]->cycles;
+			worklist.push(RankEntry(cycles, next));
+		}
+	}
+}
+
+void UnrollSearch::DumpRanking() const
+{
+	Emitter& out = Out();
+
+	if (out.IsStructured()) {
+		out.BeginRecord("usearch");
+		out.Field("warps", num_warps);
+		out.Field("max_factor", max_factor);
+		out.Field("rolled_cycles", rolled_cycles);
+		out.Field("pruned", pruned);
+		out.BeginList("loops");
+		for (unsigned i = 0; i < profiles.size(); ++i) {
+			const LoopProfile *profile = profiles[i];
+			out.BeginRecord();
+			out.Field("id", profile->GetLoop()->Id());
+			out.Field("header", profile->GetLoop()->GetHeader()->Id());
+			out.Field("trip_count", profile->GetTripCount());
+			out.Field("searched", (unsigned) profile->IsSearchable());
+			out.BeginList("kept");
+			for (unsigned j = 0; j < profile->front.size(); ++j) {
+				out.Value((unsigned long long) profile->front[j]->factor);
+			}
+			out.EndList();
+			out.EndRecord();
+		}
+		out.EndList();
+		out.BeginList("ranking");
+		for (unsigned i = 0; i < ranked.size(); ++i) {
+			out.BeginRecord();
+			out.Field("rank", i + 1);
+			out.Field("cycles", ranked[i].cycles);
+			out.Field("code_size", ranked[i].code_size);
+			out.BeginList("factors");
+			for (unsigned j = 0; j < ranked[i].choice.size(); ++j) {
+				out.Value((unsigned long long) ranked[i].choice[j]);
+			}
+			out.EndList();
+			out.EndRecord();
+		}
+		out.EndList();
+		out.EndRecord();
+		return;
+	}
+
+	ostream& os = out.Stream();
+	if (profiles.empty()) {
+		os << "No loops found, nothing to unroll" << '\n';
+		return;
+	}
+
+	os << "Unroll factor search (warps = " << num_warps << ", max factor = " << max_factor << ")" << '\n';
+	for (unsigned i = 0; i < profiles.size(); ++i) {
+		const LoopProfile *profile = profiles[i];
+		const Loop *loop = profile->GetLoop();
+		os << "Loop " << loop->Id() << " (Header bb: " << loop->GetHeader()->Id()
+			 << ", Trip count: " << profile->GetTripCount() << "): ";
+		if (!profile->IsSearchable()) {
+			os << "not searched (multiple footers)" << '\n';
+			continue;
+		}
+		os << "factors";
+		for (unsigned j = 0; j < profile->front.size(); ++j) {
+			os << " " << profile->front[j]->factor;
+		}
+		os << " kept, " << (profile->candidates.size() - profile->front.size()) << " pruned" << '\n';
+	}
+	os << "Evaluated " << rolled_cycles << " loop cycles with no unrolling, "
+		 << pruned << " dominated candidate(s) pruned" << '\n';
+
+	os << setw(5) << "Rank" << setw(16) << "Loop cycles" << setw(12) << "Code size"
+		 << setw(10) << "Speedup" << "  Factors" << '\n';
+	for (unsigned i = 0; i < ranked.size(); ++i) {
+		const UnrollConfig& config = ranked[i];
+		double speedup = (config.cycles > 0) ? double(rolled_cycles) / config.cycles : 1.0;
+		os << setw(5) << (i + 1) << setw(16) << config.cycles << setw(12) << config.code_size
+			 << setw(9) << fixed << setprecision(2) << speedup << "x" << " ";
+		for (unsigned j = 0; j < config.choice.size(); ++j) {
+			os << " " << config.choice[j];
+		}
+		os << '\n';
+	}
+	os.unsetf(ios::floatfield);
+	os.precision(6);
+}
+
+// Split a line of .uconf into the kernel it is for, empty for a line of
+// factors alone, and the factors. Returns false for a blank line
+static bool ParseUconfLine(const string& line, string& kernel, vector<unsigned>& factors)
+{
+	istringstream in(line);
+	string token;
+	kernel.clear();
+	factors.clear();
+	if (!(in >> token)) return false;
+	if (isdigit(token[0]))
+		factors.push_back(strtoul(token.c_str(), 0, 10));
+	else
+		kernel = token;
+	unsigned factor;
+	while (in >> factor)
+		factors.push_back(factor);
+	return true;
+}
+
+bool ReadUconf(const string& path, const string& kernel, vector<unsigned>& factors)
+{
+	ifstream uconf_file(path.c_str());
+	if (uconf_file.bad() || uconf_file.fail()) return false;
+
+	string line, name;
+	vector<unsigned> line_factors, fallback;
+	bool found = false, has_fallback = false;
+	while (getline(uconf_file, line)) {
+		if (!ParseUconfLine(line, name, line_factors)) continue;
+		if (name.empty()) {
+			fallback = line_factors;
+			has_fallback = true;
+		}
+		else if (name == kernel) {
+			factors = line_factors;
+			found = true;
+		}
+	}
+	if (!found && has_fallback) {
+		factors = fallback;
+		found = true;
+	}
+	return found;
+}
+
+// Write the best configuration as the line of the kernel, keeping the lines
+// of the other kernels of the module
+bool UnrollSearch::WriteUconf(const string& path, const string& kernel) const
+{
+	if (ranked.empty()) return false;
+
+	vector<string> lines;
+	{
+		ifstream old_file(path.c_str());
+		string line, name;
+		vector<unsigned> factors;
+		while (getline(old_file, line)) {
+			if (ParseUconfLine(line, name, factors) && name != kernel)
+				lines.push_back(line);
+		}
+	}
+	ostringstream entry;
+	if (!kernel.empty()) entry << kernel << " ";
+	const UnrollConfig& best = ranked[0];
+	for (unsigned i = 0; i < best.choice.size(); ++i) {
+		entry << best.choice[i] << ((i + 1 < best.choice.size()) ? " " : "");
+	}
+	lines.push_back(entry.str());
+
+	ofstream uconf_file(path.c_str());
+	if (uconf_file.bad() || uconf_file.fail()) {
+		cerr << "Error writing unroll config file " << path << endl;
+		return false;
+	}
+	for (unsigned i = 0; i < lines.size(); ++i)
+		uconf_file << lines[i] << endl;
+	uconf_file.close();
+	return true;
+}
@@ -0,0 +1,110 @@
+#ifndef _UNROLL_H_INCLUDED_
+#define _UNROLL_H_INCLUDED_
+
+#include "CFG.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+// Unroll-factor search. Rather than unrolling the ptx for real, each loop
+// body is reduced to the profile the cycle model cares about: the issue
+// cycles between consecutive blocking points (global/local mem ops, syncs
+// and inner loops). Unrolling an inner-most loop by a factor u lets the u
+// copies of each group of mem ops issue together, so the issue cycles of
+// a segment grow u-fold while its memory latency is paid only once (the
+// transactions of uncoalesced accesses past the first still are paid by
+// every copy, see Coalescing.h). The loop-closing branch is paid once per
+// unrolled iteration, and the trip_count % u remainder iterations run the
+// original body.
+
+typedef enum {SEG_MEM, SEG_SYNC, SEG_FLUSH} SegmentKind;
+
+class LoopSegment
+{
+	public:
+	LoopSegment(unsigned long long c, SegmentKind k, unsigned long long t = 0) : cycles(c), kind(k), transaction_cycles(t) {}
+	unsigned long long cycles;
+	SegmentKind kind;
+	// the cycles a group of mem ops waits for its extra transactions
+	unsigned long long transaction_cycles;
+};
+
+class UnrollCandidate
+{
+	public:
+	UnrollCandidate(unsigned f = 1) : factor(f), cycles(0), code_size(0), dominated(false) {}
+	unsigned factor;
+	unsigned long long cycles;
+	unsigned long long code_size;
+	bool dominated;
+};
+
+class LoopProfile
+{
+	public:
+	LoopProfile(const Loop *, unsigned long long, const CFG *);
+	unsigned long long Evaluate(unsigned, unsigned) const;
+	unsigned long long CodeSize(unsigned) const;
+	unsigned Copies(unsigned) const;
+	inline const Loop * GetLoop() const {return loop;}
+	inline bool IsSearchable() const {return searchable;}
+	inline unsigned GetTripCount() const {return trip_count;}
+
+	// The candidates evaluated for this loop, and the ones that survived pruning
+	vector <UnrollCandidate> candidates;
+	vector <UnrollCandidate *> front;
+
+	private:
+	unsigned long long BodyCycles(unsigned, unsigned) const;
+
+	const Loop *loop;
+	unsigned long long weight;
+	unsigned trip_count;
+	unsigned body_size;
+	vector <LoopSegment> segments;
+	unsigned long long tail_cycles;
+	unsigned long long overhead_cycles;
+	bool innermost, searchable;
+};
+
+class UnrollConfig
+{
+	public:
+	vector <unsigned> choice;
+	unsigned long long cycles;
+	unsigned long long code_size;
+};
+
+// .uconf holds the unroll factors of the kernels of a module, a line per
+// kernel: its .entry name, then a factor per loop in the order of the loop
+// ids. A line of factors alone, as written before the lines were keyed,
+// applies to every kernel without a line of its own
+bool ReadUconf(const string&, const string&, vector<unsigned>&);
+
+class UnrollSearch
+{
+	public:
+	UnrollSearch(const CFG *, unsigned nwarps, unsigned max_factor, unsigned nthreads);
+	~UnrollSearch();
+	void Run(unsigned nconfigs = DEFAULT_RANKED_CONFIGS);
+	void DumpRanking() const;
+	bool WriteUconf(const string&, const string&) const;
+
+	static const unsigned DEFAULT_MAX_FACTOR = 16;
+	static const unsigned DEFAULT_RANKED_CONFIGS = 10;
+
+	private:
+	void CollectLoops(const Loop *, unsigned long long);
+	void Prune(LoopProfile *);
+	void RankConfigs(unsigned);
+	unsigned long long ConfigCodeSize(const Loop *, const map<const Loop *, unsigned>&) const;
+
+	const CFG *cfg;
+	unsigned num_warps, max_factor, num_threads;
+	vector <LoopProfile *> profiles;
+	vector <UnrollConfig> ranked;
+	unsigned long long rolled_cycles;
+	unsigned pruned;
+};
+
+#endif
@@ -1,6 +1,49 @@
 #include "Utils.h"
 #include <fstream>
+#include <sys/time.h>
 using namespace std;
+
+AssertMessage::AssertMessage() : stream(new ostringstream()) {}
+
+AssertMessage::~AssertMessage()
+{
+	delete stream;
+}
+
+void ThrowAnalysisException(const AssertMessage& msg)
+{
+	throw AnalysisException(msg.str());
+}
+
+double WallTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static __thread double deadline = 0;
+
+void SetDeadline(double d)
+{
+	deadline = d;
+}
+
+void CheckDeadline()
+{
+	if (deadline > 0 && WallTime() > deadline)
+		throw TimeoutException();
+}
+
+unsigned long long Fingerprint(const string& data, unsigned long long seed)
+{
+	unsigned long long hash = seed;
+	for (unsigned i = 0; i < data.size(); ++i) {
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
 #include "CFG.h"
 
 
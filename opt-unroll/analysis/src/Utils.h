@@ -3,18 +3,38 @@
 
 // A bunch of utilities
 
-#include <cassert>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <stdexcept>
 
+// A failed check aborts the analysis of the current input by throwing, so
+// that a driver analyzing many inputs can carry on with the next one. The
+// message is put together and thrown out of line, so that a check costs
+// its caller a pointer of stack and not a whole ostringstream: that adds
+// up in recursive code such as CFG::DoDFS()
 #define Assert(expr, msg) do {			\
-	if (!(expr)) {											\
-		std::cerr << msg << std::endl;	\
-		assert(expr);										\
-	}																	\
+	if (__builtin_expect(!(expr), 0))			\
+		ThrowAnalysisException(AssertMessage() << msg);	\
 } while (0);
 
+// The message of a failed Assert, streamed into a buffer of its own
+class AssertMessage
+{
+	public:
+	AssertMessage();
+	~AssertMessage();
+	template <typename T> AssertMessage& operator << (const T& value) {*stream << value; return *this;}
+	std::string str() const {return stream->str();}
+
+	private:
+	AssertMessage(const AssertMessage&);
+	AssertMessage& operator=(const AssertMessage&);
+
+	std::ostringstream *stream;
+};
+
+void ThrowAnalysisException(const AssertMessage&) __attribute__ ((noreturn, noinline, cold));
 
 class IOException : public std::runtime_error
 {
@@ -22,4 +42,31 @@ class IOException : public std::runtime_error
 	IOException() : std::runtime_error("I/O Exception") {}
 };
 
+class AnalysisException : public std::runtime_error
+{
+	public:
+	AnalysisException(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+class TimeoutException : public std::runtime_error
+{
+	public:
+	TimeoutException() : std::runtime_error("Time budget exceeded") {}
+};
+
+// Wall-clock time in seconds, for time budgets and reports
+double WallTime();
+
+// The time budget of the analysis on the current thread, as a WallTime()
+// past which CheckDeadline() throws TimeoutException; 0 for none. The long
+// running steps check it as they go: the reader every so many lines, and
+// the analyses as they start and once per block or loop
+void SetDeadline(double);
+void CheckDeadline();
+
+// A 64-bit FNV-1a hash of a string, used to recognize inputs seen before.
+// Chain calls through the seed to hash several strings as one
+static const unsigned long long FINGERPRINT_SEED = 14695981039346656037ULL;
+unsigned long long Fingerprint(const std::string&, unsigned long long seed = FINGERPRINT_SEED);
+
 #endif
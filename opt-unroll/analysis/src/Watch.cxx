@@ -0,0 +1,217 @@
+#include "Watch.h"
+#include "KernelIndex.h"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+Watcher::Watcher(const Driver *d, const string& f, OutputFormat fmt)
+: driver(d), file(f), format(fmt), inotify_fd(-1), version(0)
+{
+	size_t slash = file.find_last_of('/');
+	const string& dir = (slash == file.npos) ? "." : (slash == 0 ? "/" : file.substr(0, slash));
+	base_name = (slash == file.npos) ? file : file.substr(slash + 1);
+
+	// the directory, so that a file replaced by a rename is still seen
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	Assert(inotify_fd >= 0, "Unable to watch " << file << ": " << strerror(errno));
+	if (inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		int err = errno;
+		close(inotify_fd);
+		Assert(false, "Unable to watch " << dir << ": " << strerror(err));
+	}
+}
+
+Watcher::~Watcher()
+{
+	for (map<unsigned long long, CachedKernel *>::iterator iter = cache.begin(); iter != cache.end(); ++iter)
+		delete iter->second;
+	close(inotify_fd);
+}
+
+// Report on the file as it is, then again after every change, until the
+// watch fails
+void Watcher::Run()
+{
+	Update();
+	while (Wait())
+		Update();
+}
+
+// Cut the ptx into the text of its kernels. A kernel ends with the line
+// that closes its outermost brace, as Parser::TrackBraces() has it, and
+// whatever comes before its .entry belongs to it as well
+void Watcher::Split(Reader *rdr, vector<KernelText>& kernels)
+{
+	string line;
+	unsigned depth = 0;
+	bool more = true;
+	kernels.push_back(KernelText(1));
+	while (more) {
+		more = rdr->NextLine(line);
+		KernelText& kernel = kernels.back();
+		kernel.text += line;
+		kernel.text += '\n';
+		if (Parser::IsEntry(line))
+			kernel.name = Parser::GetEntryName(line);
+		if (!Parser::IsComment(line)) continue;
+
+		if (line.find_first_of("{") != line.npos) {
+			++depth;
+		}
+		else if (line.find_first_of("}") != line.npos && depth > 0 && --depth == 0) {
+			if (more) kernels.push_back(KernelText(rdr->GetLineNum() + 1));
+		}
+	}
+}
+
+// Write the reports of a kernel into its cache entry. With a parser, the
+// kernel is read off it first; otherwise the kernel kept in the entry is
+// reported again
+void Watcher::Report(CachedKernel *cached, Parser *parser)
+{
+	Emitter *fragment = Emitter::Create(format, true);
+	FileSummary summary(file);
+	map<string, unsigned> dot_names;
+
+	SetOutput(fragment);
+	try {
+		fragment->BeginFragment(file);
+		if (parser && driver->IsStreaming()) {
+			driver->CountKernel(*parser, fragment, summary);
+		}
+		else {
+			if (parser) {
+				cached->kernel = driver->BuildKernel(*parser);
+				cached->name = parser->GetKernelName();
+			}
+			driver->Report(cached->kernel, cached->name, fragment, dot_names, summary);
+		}
+		fragment->EndKernel();
+	} catch (...) {
+		SetOutput(0);
+		delete fragment;
+		throw;
+	}
+	SetOutput(0);
+	cached->report = fragment->GetBuffer();
+	delete fragment;
+}
+
+// Analyze the current version of the file, reusing what is known about
+// the kernels that did not change, and write out the reports of all its
+// kernels. A version that cannot be read or analyzed is reported, and the
+// kernels of the previous one are kept for the next
+void Watcher::Update()
+{
+	double start = WallTime();
+	unsigned analyzed = 0, moved = 0;
+	vector<KernelText> kernels;
+	Emitter *out = Emitter::Create(format);
+	KernelSelector selector(driver->GetKernelPattern());
+	++version;
+
+	try {
+		Reader rdr(file);
+		Split(&rdr, kernels);
+
+		out->BeginModule(file);
+		for (unsigned i = 0; i < kernels.size(); ++i) {
+			const KernelText& text = kernels[i];
+			if (!selector.Matches(text.name)) continue;
+
+			unsigned long long key = Fingerprint(text.text);
+			map<unsigned long long, CachedKernel *>::iterator iter = cache.find(key);
+			CachedKernel *cached = (iter == cache.end()) ? 0 : iter->second;
+			// the very same text twice in the file is analyzed twice
+			bool shared = (cached != 0 && cached->version == version);
+
+			if (cached == 0 || shared) {
+				cached = new CachedKernel();
+				cached->first_line = text.first_line;
+				try {
+					Reader kernel_rdr(file, new istringstream(text.text));
+					kernel_rdr.SetFirstLine(text.first_line);
+					Parser parser(&kernel_rdr);
+					parser.Reinit();
+					Report(cached, &parser);
+				} catch (...) {
+					delete cached;
+					throw;
+				}
+				if (!shared) cache[key] = cached;
+				++analyzed;
+			}
+			else if (cached->kernel && cached->first_line != text.first_line) {
+				// the counts of the streaming mode carry no line numbers
+				cached->kernel->ShiftLines((int) text.first_line - (int) cached->first_line);
+				cached->first_line = text.first_line;
+				Report(cached, 0);
+				++moved;
+			}
+			cached->version = version;
+			out->Embed(cached->report);
+			if (shared) delete cached;
+		}
+		out->EndKernels();
+		out->EndModule();
+		out->Flush(cout);
+	} catch (IOException& ioe) {
+		cerr << "Unable to read " << file << endl;
+		delete out;
+		return;
+	} catch (exception& e) {
+		cerr << "Analysis of " << file << " failed: " << e.what() << endl;
+		delete out;
+		return;
+	}
+	delete out;
+
+	// kernels gone from the file
+	map<unsigned long long, CachedKernel *>::iterator iter = cache.begin();
+	while (iter != cache.end()) {
+		if (iter->second->version != version) {
+			delete iter->second;
+			cache.erase(iter++);
+		}
+		else ++iter;
+	}
+
+	ostringstream log;
+	log << "Watching " << file << ": " << kernels.size() << " kernel(s), " << analyzed << " analyzed, "
+			<< moved << " moved, in " << (WallTime() - start) * 1000 << " ms" << '\n';
+	cerr << log.str();
+}
+
+// Block until the file has been written or replaced, and the writes have
+// settled. Returns false if the watch broke down
+bool Watcher::Wait()
+{
+	char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	bool changed = false;
+	int timeout = -1;
+
+	while (true) {
+		struct pollfd pfd;
+		pfd.fd = inotify_fd;
+		pfd.events = POLLIN;
+		int ready = poll(&pfd, 1, timeout);
+		if (ready < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		if (ready == 0) return true;
+
+		ssize_t len = read(inotify_fd, events, sizeof(events));
+		if (len < 0 && errno == EINTR) continue;
+		if (len <= 0) return false;
+		for (char *ptr = events; ptr < events + len; ) {
+			const struct inotify_event *event = (const struct inotify_event *) ptr;
+			if (event->len > 0 && base_name == event->name) changed = true;
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+		if (changed) timeout = WATCH_SETTLE_MSECS;
+	}
+}
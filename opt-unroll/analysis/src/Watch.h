@@ -0,0 +1,78 @@
+#ifndef _WATCH_H_INCLUDED_
+#define _WATCH_H_INCLUDED_
+
+#include "Driver.h"
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// -watch: analyze a ptx file, then again every time it is rewritten, as
+// an autotuner regenerating it many times a minute does. The file is
+// watched with inotify, through its directory, so that files replaced by
+// a rename are seen as well.
+//
+// Each version of the file is cut into the text of its kernels the way the
+// parser delimits them, by matching braces, and each kernel is keyed by a
+// fingerprint of its text. A kernel seen in the previous version has its
+// reports reused as they are. One that only moved within the file, because
+// a kernel in front of it grew or shrank, is renumbered and reported again
+// without being parsed. Only the kernels whose text changed are parsed and
+// analyzed. The kernels stay in memory between versions, and the ones gone
+// from the file are dropped.
+
+// Let a burst of writes settle before reading the file
+#define WATCH_SETTLE_MSECS 20
+
+// The text of one kernel, the line it starts at and its .entry name
+class KernelText
+{
+	public:
+	KernelText(unsigned l = 1) : first_line(l) {}
+	string text;
+	unsigned first_line;
+	string name;
+};
+
+class CachedKernel
+{
+	public:
+	CachedKernel() : kernel(0), first_line(0), version(0) {}
+	~CachedKernel() {delete kernel;}
+
+	// none when only counts are asked for
+	Kernel *kernel;
+	string name;
+	unsigned first_line;
+	// the kernel's reports, as the emitter wrote them
+	string report;
+	// the last version of the file it was seen in
+	unsigned version;
+};
+
+class Watcher
+{
+	public:
+	Watcher(const Driver *, const string&, OutputFormat);
+	~Watcher();
+	void Run();
+
+	static void Split(Reader *, vector<KernelText>&);
+
+	private:
+	Watcher(const Watcher&);
+	Watcher& operator=(const Watcher&);
+
+	void Update();
+	void Report(CachedKernel *, Parser *);
+	bool Wait();
+
+	const Driver *driver;
+	string file, base_name;
+	OutputFormat format;
+	int inotify_fd;
+	map <unsigned long long, CachedKernel *> cache;
+	unsigned version;
+};
+
+#endif